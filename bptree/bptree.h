@@ -0,0 +1,2250 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * B+ Tree implementation, thread unsafe, and comparator is not supported
+ */
+
+#ifndef CONTAINER_BTREE_H
+#define CONTAINER_BTREE_H
+
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif /* __AVX2__ */
+
+#include "../definition.h"
+#include "../interleave.h"
+#include "node_pool.h"
+
+namespace mem_container {
+/*
+ * intra-node key search
+ * Linear: sequential scan for small quantities
+ * Binary: branchless binary search
+ * Simd: avx2 compare and movemask for 4/8-byte integer keys, binary search for the others
+ * Auto: Simd when it applies, otherwise Binary for large nodes and Linear for small ones
+ */
+enum class BPTreeSearch { Auto, Linear, Binary, Simd };
+
+namespace bptree_helper {
+template <typename K>
+constexpr bool simd_searchable = std::is_integral<K>::value && (sizeof(K) == 4 || sizeof(K) == 8);
+
+template <BPTreeSearch SEARCH, typename K, size_t N>
+constexpr BPTreeSearch resolve_search()
+{
+    if constexpr (SEARCH == BPTreeSearch::Simd || SEARCH == BPTreeSearch::Auto) {
+#if defined(__AVX2__)
+        if constexpr (simd_searchable<K>) {
+            return BPTreeSearch::Simd;
+        }
+#endif /* __AVX2__ */
+        if constexpr (SEARCH == BPTreeSearch::Simd) {
+            return BPTreeSearch::Binary;
+        }
+        return N > 32 ? BPTreeSearch::Binary : BPTreeSearch::Linear;
+    }
+    return SEARCH;
+}
+
+/* whether key sorts before x, that is key < x for lower bound and key <= x for upper bound */
+template <bool upper, typename K>
+inline bool before(const K &key, const K &x) { return upper ? !(x < key) : key < x; }
+
+#if defined(__AVX2__)
+template <typename K>
+inline __m256i simd_set1(K x)
+{
+    return sizeof(K) == 4 ? _mm256_set1_epi32((int)x) : _mm256_set1_epi64x((long long)x);
+}
+template <typename K>
+inline __m256i simd_cmpgt(__m256i a, __m256i b)
+{
+    return sizeof(K) == 4 ? _mm256_cmpgt_epi32(a, b) : _mm256_cmpgt_epi64(a, b);
+}
+
+template <bool upper, typename K>
+inline size_t simd_count_before(const K *keys, size_t n, const K &x)
+{
+    constexpr size_t lanes = 32 / sizeof(K);
+    /* unsigned keys compare as signed ones after flipping the sign bit */
+    constexpr K flip = std::is_signed<K>::value ? K(0) : K(K(1) << (sizeof(K) * 8 - 1));
+    const __m256i bias = simd_set1<K>(flip);
+    const __m256i needle = simd_set1<K>(K(x ^ flip));
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(keys + i)), bias);
+        __m256i gt = upper ? simd_cmpgt<K>(block, needle) : simd_cmpgt<K>(needle, block);
+        size_t nbefore = __builtin_popcount((uint32_t)_mm256_movemask_epi8(gt)) / sizeof(K);
+        if (upper) {
+            nbefore = lanes - nbefore;
+        }
+        if (nbefore < lanes) {
+            return i + nbefore;
+        }
+    }
+    while (i < n && before<upper>(keys[i], x)) {
+        ++i;
+    }
+    return i;
+}
+#endif /* __AVX2__ */
+
+/* number of leading keys in keys[0, n) sorting before x */
+template <BPTreeSearch SEARCH, bool upper, typename K>
+inline size_t count_before(const K *keys, size_t n, const K &x)
+{
+    if constexpr (SEARCH == BPTreeSearch::Binary) {
+        if (n == 0) {
+            return 0;
+        }
+        const K *base = keys;
+        while (n > 1) {
+            size_t half = n / 2;
+            base = before<upper>(base[half], x) ? base + half : base;
+            n -= half;
+        }
+        return (base - keys) + before<upper>(*base, x);
+#if defined(__AVX2__)
+    } else if constexpr (SEARCH == BPTreeSearch::Simd) {
+        return simd_count_before<upper>(keys, n, x);
+#endif /* __AVX2__ */
+    } else {
+        size_t i = 0;
+        while (i < n && before<upper>(keys[i], x)) {
+            ++i;
+        }
+        return i;
+    }
+}
+constexpr static const size_t cache_line_size = 64;
+constexpr static const size_t page_size = 4096;
+/* node header (size and type tag) padded to key alignment */
+template <typename K>
+constexpr size_t header_size() { return (8 + alignof(K) - 1) / alignof(K) * alignof(K); }
+/* keys per leaf so that a leaf fits in node_bytes */
+template <typename K, typename V>
+constexpr size_t leaf_fanout(size_t node_bytes)
+{
+    return std::max<size_t>((node_bytes - header_size<K>() - 2 * sizeof(void *)) / (sizeof(K) + sizeof(V)), 3);
+}
+/* keys per internal node so that it fits in node_bytes */
+template <typename K>
+constexpr size_t internal_fanout(size_t node_bytes)
+{
+    return std::max<size_t>((node_bytes - header_size<K>() - sizeof(void *)) / (sizeof(K) + sizeof(void *)), 3);
+}
+
+template <typename MONOID>
+struct monoid_summary { using type = typename MONOID::value_type; };
+template <>
+struct monoid_summary<void> { using type = EmptyObject; };
+
+/* key count and monoid summary of every child subtree, kept by internal nodes of an augmented tree */
+template <typename A, size_t N>
+struct ChildAnnotation {
+    size_t count[N];
+    A summary[N];
+};
+} /* namespace bptree_helper */
+
+/*
+ * monoids for augmented trees, a monoid provides
+ *     using value_type = ...;
+ *     static value_type identity();
+ *     static value_type lift(const K &key, const V &value);
+ *     static value_type combine(const value_type &a, const value_type &b);
+ * combine has to be associative, it is always applied in key order
+ */
+template <typename V>
+struct SumMonoid {
+    using value_type = V;
+    static inline V identity() { return V(); }
+    template <typename K>
+    static inline V lift(const K &, const V &value) { return value; }
+    static inline V combine(const V &a, const V &b) { return a + b; }
+};
+template <typename V>
+struct MinMonoid {
+    using value_type = V;
+    static inline V identity() { return std::numeric_limits<V>::max(); }
+    template <typename K>
+    static inline V lift(const K &, const V &value) { return value; }
+    static inline V combine(const V &a, const V &b) { return b < a ? b : a; }
+};
+template <typename V>
+struct MaxMonoid {
+    using value_type = V;
+    static inline V identity() { return std::numeric_limits<V>::lowest(); }
+    template <typename K>
+    static inline V lift(const K &, const V &value) { return value; }
+    static inline V combine(const V &a, const V &b) { return a < b ? b : a; }
+};
+
+/*
+ * MAX_BPTREE_NODE_SIZE is the fanout of leaves and MAX_BPTREE_INTERNAL_SIZE the one of internal nodes,
+ * see CacheAlignedBPTree for fanouts derived from key and value sizes.
+ * POOLED tree carves its nodes from per tree slabs and drops them all at once on destroy,
+ * memory contexts already do that for postgres.
+ * a non void MONOID makes an augmented tree, internal nodes keep the key count and the monoid
+ * summary of every child, which gives rank, select and range aggregates in O(log n)
+ */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE = 16, BPTreeSearch SEARCH = BPTreeSearch::Auto,
+          size_t MAX_BPTREE_INTERNAL_SIZE = MAX_BPTREE_NODE_SIZE, bool POOLED = !CONTAINER_USE_POSTGRES_MMGR,
+          typename MONOID = void>
+class BPTree {
+public:
+    static_assert(MAX_BPTREE_NODE_SIZE >= 3 && MAX_BPTREE_INTERNAL_SIZE >= 3, "bptree node is too small to split");
+    constexpr static const BPTreeSearch search_strategy =
+        bptree_helper::resolve_search<SEARCH, K, std::max(MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE)>();
+    constexpr static const bool augmented = !std::is_void<MONOID>::value;
+    constexpr static const bool pooled = POOLED;
+    using key_type = K;
+    using value_type = V;
+    using monoid_type = MONOID;
+    using summary_type = typename bptree_helper::monoid_summary<MONOID>::type;
+    using annotation_type = std::conditional_t<augmented,
+        bptree_helper::ChildAnnotation<summary_type, MAX_BPTREE_INTERNAL_SIZE + 1>, EmptyObject>;
+    struct LeafNode;
+    struct InternalNode;
+    /*
+     * common header of both node kinds, no virtual dispatch, is_leaf is the type tag.
+     * key arrays of both kinds start right after the header so keys() does not branch
+     */
+    struct Node {
+        uint32_t size{0};
+        bool is_leaf;
+        Node(bool leaf) : is_leaf(leaf) {}
+
+        inline K *keys() { return is_leaf ? static_cast<LeafNode *>(this)->key : static_cast<InternalNode *>(this)->key; }
+        inline const K *keys() const
+        {
+            return is_leaf ? static_cast<const LeafNode *>(this)->key : static_cast<const InternalNode *>(this)->key;
+        }
+        /* first key not less than x */
+        inline size_t item_index_of(const K &x) const
+        {
+            return bptree_helper::count_before<search_strategy, false>(keys(), size, x);
+        }
+        /* first key greater than x */
+        inline size_t child_index_of(const K &x) const
+        {
+            return bptree_helper::count_before<search_strategy, true>(keys(), size, x);
+        }
+    };
+    struct alignas(bptree_helper::cache_line_size) InternalNode : public Node, public BaseObject {
+        K key[MAX_BPTREE_INTERNAL_SIZE];
+        Node *ptr[MAX_BPTREE_INTERNAL_SIZE + 1];
+#if __cplusplus >= 202002L
+        [[no_unique_address]] annotation_type annotation;
+#else
+        annotation_type annotation;
+#endif /* __cplusplus c++20 or greater */
+        InternalNode() : Node(false) {}
+    };
+    struct alignas(bptree_helper::cache_line_size) LeafNode : public Node, public BaseObject {
+        K key[MAX_BPTREE_NODE_SIZE];
+        V values[MAX_BPTREE_NODE_SIZE];
+        LeafNode *next{NULL};
+        LeafNode *prev{NULL};
+        LeafNode() : Node(true) {}
+    };
+    using node_type = Node;
+    using internal_node_type = InternalNode;
+    using leaf_node_type = LeafNode;
+
+    struct iterator {
+        leaf_node_type *node;
+        size_t index;
+        iterator(leaf_node_type *n, size_t i) : node(n), index(i) {}
+        iterator &operator++()
+        {
+            if (index + 1 < node->size) {
+                ++index;
+            } else {
+                node = node->next;
+                index = 0;
+                if (node) {
+                    prefetch_leaf(node->next);
+                }
+            }
+            return *this;
+        }
+        iterator &operator--()
+        {
+            if (index > 0) {
+                --index;
+            } else {
+                node = node->prev;
+                index = node->size - 1;
+            }
+            return *this;
+        }
+        bool operator==(const iterator &other) const { return node == other.node && index == other.index; }
+        bool operator!=(const iterator &other) const { return !(*this == other); }
+        V &operator*() { return node->values[index]; }
+        V &value() { return node->values[index]; }
+        const K &key() const { return node->key[index]; }
+    };
+    struct const_iterator {
+        const leaf_node_type *node;
+        size_t index;
+        const_iterator(const leaf_node_type *n, size_t i) : node(n), index(i) {}
+        const_iterator &operator++()
+        {
+            if (index + 1 < node->size) {
+                ++index;
+            } else {
+                node = node->next;
+                index = 0;
+                if (node) {
+                    prefetch_leaf(node->next);
+                }
+            }
+            return *this;
+        }
+        const_iterator &operator--()
+        {
+            if (index > 0) {
+                --index;
+            } else {
+                node = node->prev;
+                index = node->size - 1;
+            }
+            return *this;
+        }
+        bool operator==(const const_iterator &other) const { return node == other.node && index == other.index; }
+        bool operator!=(const const_iterator &other) const { return !(*this == other); }
+        const V &operator*() const { return node->values[index]; }
+        const V &value() const { return node->values[index]; }
+        const K &key() const { return node->key[index]; }
+    };
+
+    /*
+     * a run of whole leaves handed out by partition, from first up to but excluding stop,
+     * stop is NULL for a run reaching the end of the tree
+     */
+    struct Partition {
+        leaf_node_type *first;
+        leaf_node_type *stop;
+        iterator begin() const { return iterator(first, 0); }
+        iterator end() const { return iterator(stop, 0); }
+        /* visit the keys of every leaf as visitor(keys, values, n), see scan_spans */
+        template <typename Func>
+        size_t scan_spans(Func &&visitor) const { return scan_leaves(first, 0, stop, NULL, visitor); }
+    };
+
+    iterator begin() { return iterator(find_start_leaf(), 0); }
+    iterator end() const { return iterator(NULL, 0); }
+    const_iterator cbegin() const { return const_iterator(find_start_leaf(), 0); }
+    const_iterator cend() const { return const_iterator(NULL, 0); }
+
+    BPTree() : BPTree(false) {}
+    /* huge_page backs pooled nodes with transparent huge pages */
+    explicit BPTree(bool huge_page)
+    {
+        static_assert(std::is_standard_layout<K>::value && std::is_standard_layout<V>::value, "bptree only support pod types");
+        static_assert(std::is_standard_layout<summary_type>::value, "monoid summary has to be pod");
+        CreateMemCxt();
+        if constexpr (POOLED) {
+            _leaf_pool.set_huge_page(huge_page);
+            _internal_pool.set_huge_page(huge_page);
+        }
+    }
+    BPTree(const BPTree &) = delete;
+    BPTree &operator=(const BPTree &) = delete;
+    BPTree(BPTree &&other) : _root(other._root), _last(other._last), _size(other._size), _size_known(other._size_known)
+    {
+        _compacting = other._compacting;
+        _compact_next = other._compact_next;
+        other._root = NULL;
+        other._last = NULL;
+        other._size = 0;
+        other._compacting = false;
+        ++other._structure_version;
+        swap_pool(other);
+        ExchangeMemCxt(other);
+    }
+    BPTree &operator=(BPTree &&other)
+    {
+        if (this != &other) {
+            destroy();
+            _root = other._root;
+            _last = other._last;
+            _size = other._size;
+            _size_known = other._size_known;
+            _compacting = other._compacting;
+            _compact_next = other._compact_next;
+            other._root = NULL;
+            other._last = NULL;
+            other._size = 0;
+            other._compacting = false;
+            ++other._structure_version;
+            swap_pool(other);
+            ExchangeMemCxt(other);
+        }
+        return *this;
+    }
+    ~BPTree()
+    {
+#ifndef NO_DESTROYER
+        destroy();
+#endif /* NO_DESTROYER */
+    }
+    iterator find_left(const K &x);
+    const_iterator cfind_left(const K &x) const;
+    iterator find(const K &x);
+    const_iterator cfind(const K &x) const;
+    V *search(const K &x);
+    const V *search(const K &) const;
+#ifdef CONTAINER_HAS_INTERLEAVE
+    /*
+     * search keys[0, n) with group lookups interleaved, results[i] is the value of keys[i] or NULL.
+     * every lookup prefetches the node it descends to and yields to the next one of the group
+     */
+    void search_batch(const K *keys, size_t n, const V **results, size_t group = 16) const
+    {
+        interleave(n, group, [this, keys](size_t i) { return search_interleaved(keys[i]); },
+                   [results](size_t i, const V *res) { results[i] = res; });
+    }
+    /* one lookup of search_batch, for pipelines of their own on interleave() */
+    Interleaved<const V *> search_interleaved(K x) const;
+#endif /* CONTAINER_HAS_INTERLEAVE */
+    V &operator[](const K &x)
+    {
+        V *res = search(x);
+        if (res) {
+            return *res;
+        }
+        insert(x, V());
+        return *search(x);
+    }
+    /* segfault if key does not exist */
+    inline const V &operator[](const K &x) const { return *search(x); }
+    /* keys above the current maximum are appended to the rightmost leaf without a descent */
+    void insert(const K &, const V &);
+    /*
+     * hint is the position x would be inserted before, as for std::map. the leaf of the hint takes
+     * x directly if x falls between the neighbours of the hint inside that leaf and the leaf is not
+     * full, otherwise this is a plain insert
+     */
+    void insert_hint(iterator hint, const K &, const V &);
+    /*
+     * replace the content with n strictly ascending keys in O(n), leaves are built left to
+     * right and internal levels bottom up, nodes are filled to fill_factor of their fanout
+     * (not less than the half that removal keeps)
+     */
+    void bulk_load(const K *keys, const V *values, size_t n, float fill_factor = 1.0f);
+    /* visit keys in [lo, hi) in order as visitor(key, value), stop once visitor returns false, returns the number visited */
+    template <typename Func>
+    size_t scan(const K &lo, const K &hi, Func &&visitor);
+    template <typename Func>
+    size_t scan(const K &lo, const K &hi, Func &&visitor) const
+    {
+        return const_cast<BPTree *>(this)->scan(lo, hi, [&visitor](const K &k, V &v) { return visitor(k, (const V &)v); });
+    }
+    /*
+     * visit keys in [lo, hi) a leaf at a time as visitor(keys, values, n), keys and values are
+     * contiguous arrays of n entries, stop once visitor returns false, returns the number visited.
+     * leaves two ahead are prefetched, so the visitor may run vectorized code over the arrays
+     */
+    template <typename Func>
+    size_t scan_spans(const K &lo, const K &hi, Func &&visitor);
+    template <typename Func>
+    size_t scan_spans(const K &lo, const K &hi, Func &&visitor) const
+    {
+        return const_cast<BPTree *>(this)->scan_spans(lo, hi, [&visitor](const K *keys, V *values, size_t n) {
+            return visitor(keys, (const V *)values, n);
+        });
+    }
+    /*
+     * cut the tree into at most n runs of whole leaves in key order, for scans on n threads.
+     * runs are cut at the first level with n nodes or more, so they hold about the same number
+     * of keys, returns the number of runs written to parts
+     */
+    size_t partition(size_t n, Partition *parts);
+    /*
+     * remove keys in [lo, hi), subtrees inside the range are dropped as a whole and only the nodes
+     * on the two boundary paths are rebalanced, returns the number removed
+     */
+    size_t erase_range(const K &lo, const K &hi);
+    /*
+     * move the keys not less than x into the returned tree in O(log n), nodes on the path to x are
+     * cut in two and the pieces on either side grafted back together, rebalancing only along the
+     * way. a plain tree keeps no key counts in its nodes, so neither tree knows its size after a
+     * split and the next size() on each is a full scan of its leaves, O(n). augmented trees add
+     * up the counts at the root and stay O(log n) throughout.
+     * a pooled tree shares its slabs with the returned one, destroying either of them hands its
+     * nodes back one by one for the other to reuse
+     */
+    BPTree split(const K &x);
+    /*
+     * append every key of other, all of them greater than the keys here, in O(log n), the shorter
+     * tree is grafted onto the edge of the taller one. other is left empty, a pooled tree takes
+     * over its slabs, both have to agree on huge pages
+     */
+    void join(BPTree &other);
+    /*
+     * merge neighbouring leaves whose keys fit in one, and for a pooled tree move every leaf that
+     * neither follows the one before it in memory nor opens a slab to fresh slab memory right
+     * after it, so that leaves lie in key order in memory. a sweep over a compacted tree moves
+     * nothing. at most budget leaves are visited per call, the next call resumes at the key it
+     * stopped at, inserts and removes in between are fine. returns true once the sweep reached
+     * the last leaf, the call after that starts over. vacated pooled slots are reused by later
+     * inserts, slabs left empty go back
+     */
+    bool compact(size_t budget);
+    /* it has to point into this tree, equal keys are told apart by the leaf it points to */
+    void remove(iterator it);
+    bool remove(const K &);
+    /* replace the value of an existing key, values of an augmented tree must only change this way */
+    bool update(const K &, const V &);
+    /* O(1), except right after a split of a plain tree, see split */
+    inline size_t size() const
+    {
+        if (!_size_known) {
+            _size = count_keys();
+            _size_known = true;
+        }
+        return _size;
+    }
+    /* augmented tree only, number of keys less than x */
+    size_t rank(const K &x) const;
+    /* augmented tree only, the k-th smallest key counting from 0, end() if k >= size() */
+    iterator select(size_t k)
+    {
+        leaf_node_type *leaf = select_leaf(k);
+        return iterator(leaf, k);
+    }
+    const_iterator cselect(size_t k) const
+    {
+        const leaf_node_type *leaf = select_leaf(k);
+        return const_iterator(leaf, k);
+    }
+    /* augmented tree only, monoid summary of keys in [lo, hi) */
+    summary_type aggregate(const K &lo, const K &hi) const;
+    inline bool empty() const { return !_root; }
+    /* changes whenever leaves are created, merged or dropped, or the separators between them move */
+    inline size_t structure_version() const { return _structure_version; }
+    struct LeafStats {
+        size_t leaves;
+        size_t keys;
+        /* leaves placed right after their predecessor in memory, a scan streams through those */
+        size_t sequential;
+        inline double fill() const { return leaves ? double(keys) / double(leaves * MAX_BPTREE_NODE_SIZE) : 0; }
+    };
+    /* bytes of the slabs behind a pooled tree, slabs shared with split off trees included */
+    inline size_t pool_bytes() const
+    {
+        if constexpr (POOLED) {
+            return _leaf_pool.bytes() + _internal_pool.bytes();
+        } else {
+            return 0;
+        }
+    }
+    /* fill factor and memory order of the leaves, O(number of leaves) */
+    LeafStats leaf_stats() const
+    {
+        LeafStats res{0, 0, 0};
+        for (const leaf_node_type *leaf = find_start_leaf(); leaf; leaf = leaf->next) {
+            ++res.leaves;
+            res.keys += leaf->size;
+            res.sequential += leaf->prev && leaf->prev + 1 == leaf;
+        }
+        return res;
+    }
+    /*
+     * visit leaves in order as visitor(leaf, low), low points to the smallest key the tree
+     * routes to the leaf, NULL for the first leaf
+     */
+    template <typename Func>
+    void visit_leaves(Func &&visitor) const
+    {
+        if (_root) {
+            visit_leaves_internal(_root, NULL, visitor);
+        }
+    }
+#ifdef BTREE_DEBUG
+    __attribute__((noinline, used))
+    void display() const { display_internal(_root); }
+    void display_internal(const node_type *node) const;
+#endif /* BTREE_DEBUG */
+    inline void check_invariant() const { check_invariant(_root); }
+    inline void destroy()
+    {
+        if constexpr (POOLED) {
+            /* slabs shared with a tree split off this one stay, the nodes go back for it to reuse */
+            if (_leaf_pool.shared() || _internal_pool.shared()) {
+                clean_up(_root);
+            }
+            _leaf_pool.destroy();
+            _internal_pool.destroy();
+        } else {
+            clean_up(_root);
+        }
+        _root = NULL;
+        _last = NULL;
+        _size = 0;
+        _size_known = true;
+        _compacting = false;
+        ++_structure_version;
+        DestroyMemCxt();
+    }
+private:
+    MemCxtHolder;
+    node_type *_root{NULL};
+    /* rightmost leaf, the target of appends */
+    leaf_node_type *_last{NULL};
+    /* a split leaves _size stale until size() counts the keys again */
+    mutable size_t _size{0};
+    mutable bool _size_known{true};
+    size_t _structure_version{0};
+    /* a compaction sweep is under way and resumes at the leaf of _compact_next */
+    bool _compacting{false};
+    K _compact_next{};
+    using leaf_pool_type = std::conditional_t<POOLED, NodePool<leaf_node_type>, EmptyObject>;
+    using internal_pool_type = std::conditional_t<POOLED, NodePool<internal_node_type>, EmptyObject>;
+#if __cplusplus >= 202002L
+    [[no_unique_address]] leaf_pool_type _leaf_pool;
+    [[no_unique_address]] internal_pool_type _internal_pool;
+#else
+    leaf_pool_type _leaf_pool;
+    internal_pool_type _internal_pool;
+#endif /* __cplusplus c++20 or greater */
+    /* internal nodes from the root down to a leaf and the child index taken in each */
+    constexpr static const size_t max_height = 64;
+    struct Path {
+        internal_node_type *node[max_height];
+        size_t index[max_height];
+        size_t depth{0};
+    };
+    leaf_node_type *descend(const K &x, Path &path) const;
+    /* path down to leaf itself, false if leaf is not in the tree */
+    bool path_to(const leaf_node_type *leaf, Path &path) const;
+    void insert_internal(K split_key, const V &, Path &path, node_type *left, node_type *right);
+    /* x goes to position i of src, child right of it in an internal node, equal keys make a search by x ambiguous */
+    node_type *insert_split(const K &x, const V &, node_type *child, node_type *src, size_t i, K &split_key);
+    /* x is above every key, a full rightmost leaf is split 90/10 instead of in halves */
+    void append(const K &x, const V &v);
+    void remove_at(Path &path, leaf_node_type *, size_t pos);
+    void remove_internal(Path &path, size_t pos);
+    size_t erase_range_internal(node_type *, const K *lo, const K *hi);
+    size_t drop_subtree(node_type *);
+    void fix_children(internal_node_type *);
+    void rebalance_children(internal_node_type *, size_t left);
+    /* _root becomes left and right of heights lh and rh joined, sep lies between their keys, returns the height of the result */
+    size_t graft(node_type *left, size_t lh, const K &sep, node_type *right, size_t rh);
+    size_t count_keys() const;
+    /* compaction of the children of path.node[depth - 1] from path.index[depth - 1] on, returns the leaves visited */
+    size_t compact_children(Path &path, size_t budget);
+    static inline bool underfull(const node_type *node)
+    {
+        return node->is_leaf ? node->size < (MAX_BPTREE_NODE_SIZE + 1) / 2 : node->size + 1 < (MAX_BPTREE_INTERNAL_SIZE + 1) / 2;
+    }
+    leaf_node_type *find_start_leaf() const;
+    static inline leaf_node_type *leftmost_leaf(node_type *cursor)
+    {
+        while (!cursor->is_leaf) {
+            cursor = reinterpret_cast<internal_node_type *>(cursor)->ptr[0];
+        }
+        return reinterpret_cast<leaf_node_type *>(cursor);
+    }
+    static inline leaf_node_type *rightmost_leaf(node_type *cursor)
+    {
+        while (!cursor->is_leaf) {
+            cursor = reinterpret_cast<internal_node_type *>(cursor)->ptr[cursor->size];
+        }
+        return reinterpret_cast<leaf_node_type *>(cursor);
+    }
+    /* leaves are at height 0 */
+    static inline size_t height_of(const node_type *cursor)
+    {
+        size_t res = 0;
+        for (; !cursor->is_leaf; ++res) {
+            cursor = reinterpret_cast<const internal_node_type *>(cursor)->ptr[0];
+        }
+        return res;
+    }
+    static inline void prefetch_leaf(const leaf_node_type *leaf)
+    {
+        if (leaf) {
+            for (size_t i = 0; i < sizeof(leaf_node_type); i += bptree_helper::cache_line_size) {
+                __builtin_prefetch((const char *)leaf + i);
+            }
+        }
+    }
+    /* leaves from leaf (starting at index i) up to stop or the leaf holding hi, as in scan_spans */
+    template <typename Func>
+    static size_t scan_leaves(leaf_node_type *leaf, size_t i, const leaf_node_type *stop, const K *hi, Func &visitor);
+    template <typename Func>
+    void visit_leaves_internal(const node_type *cursor, const K *low, Func &visitor) const
+    {
+        if (cursor->is_leaf) {
+            visitor(reinterpret_cast<const leaf_node_type *>(cursor), low);
+            return;
+        }
+        const internal_node_type *node = reinterpret_cast<const internal_node_type *>(cursor);
+        for (size_t i = 0; i <= node->size; ++i) {
+            visit_leaves_internal(node->ptr[i], i > 0 ? &node->key[i - 1] : low, visitor);
+        }
+    }
+    leaf_node_type *select_leaf(size_t &k) const;
+    summary_type aggregate_internal(const node_type *, const K *lo, const K *hi) const;
+    /* recompute the annotation of ptr[i] from the child itself */
+    static void refresh_entry(internal_node_type *, size_t i);
+    static inline void refresh_all(internal_node_type *node)
+    {
+        if constexpr (augmented) {
+            for (size_t i = 0; i <= node->size; ++i) {
+                refresh_entry(node, i);
+            }
+        }
+    }
+    /* refresh the entries taken by path above level depth, after the subtree under it changed */
+    static inline void refresh_path(const Path &path, size_t depth)
+    {
+        if constexpr (augmented) {
+            while (depth > 0) {
+                --depth;
+                refresh_entry(path.node[depth], path.index[depth]);
+            }
+        }
+    }
+    /* annotations follow their children, same as memmove on ptr */
+    static inline void move_annotation(internal_node_type *dst, size_t dst_pos, internal_node_type *src, size_t src_pos, size_t n)
+    {
+        if constexpr (augmented) {
+            memmove(dst->annotation.count + dst_pos, src->annotation.count + src_pos, sizeof(size_t) * n);
+            memmove(dst->annotation.summary + dst_pos, src->annotation.summary + src_pos, sizeof(summary_type) * n);
+        }
+    }
+    void clean_up(node_type *);
+    /* number of nodes to spread n entries over, each holding at most max_fill and about fill */
+    static inline size_t bulk_node_count(size_t n, size_t fill, size_t max_fill)
+    {
+        return std::max(std::max(n / fill, (n + max_fill - 1) / max_fill), size_t(1));
+    }
+    inline void swap_pool(BPTree &other)
+    {
+        if constexpr (POOLED) {
+            _leaf_pool.swap(other._leaf_pool);
+            _internal_pool.swap(other._internal_pool);
+        }
+    }
+    inline leaf_node_type *new_leaf()
+    {
+        if constexpr (POOLED) {
+            return new (_leaf_pool.alloc()) leaf_node_type();
+        } else {
+            return NEW leaf_node_type();
+        }
+    }
+    inline internal_node_type *new_internal()
+    {
+        if constexpr (POOLED) {
+            return new (_internal_pool.alloc()) internal_node_type();
+        } else {
+            return NEW internal_node_type();
+        }
+    }
+    inline void free_node(node_type *node)
+    {
+        if constexpr (POOLED) {
+            if (node->is_leaf) {
+                _leaf_pool.release(node);
+            } else {
+                _internal_pool.release(node);
+            }
+        } else if (node->is_leaf) {
+            delete static_cast<leaf_node_type *>(node);
+        } else {
+            delete static_cast<internal_node_type *>(node);
+        }
+    }
+#ifdef BTREE_VERIFY_DATA
+    K check_invariant(const node_type *) const;
+#else
+    void check_invariant(const node_type *) const {}
+#endif /* BTREE_VERIFY_DATA */
+};
+
+/* fanouts derived from key and value sizes so that every node spans NODE_BYTES, a multiple of cache line */
+template <typename K, typename V, size_t NODE_BYTES = 4 * bptree_helper::cache_line_size, BPTreeSearch SEARCH = BPTreeSearch::Auto>
+using CacheAlignedBPTree = BPTree<K, V, bptree_helper::leaf_fanout<K, V>(NODE_BYTES), SEARCH, bptree_helper::internal_fanout<K>(NODE_BYTES)>;
+/* nodes span a 4KiB page */
+template <typename K, typename V, BPTreeSearch SEARCH = BPTreeSearch::Auto>
+using PageAlignedBPTree = CacheAlignedBPTree<K, V, bptree_helper::page_size, SEARCH>;
+/* subtree counts and MONOID summaries, see SumMonoid */
+template <typename K, typename V, typename MONOID, size_t MAX_BPTREE_NODE_SIZE = 16, BPTreeSearch SEARCH = BPTreeSearch::Auto>
+using AugmentedBPTree = BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_NODE_SIZE, !CONTAINER_USE_POSTGRES_MMGR, MONOID>;
+} /* namespace mem_container */
+
+/* place for implementation */
+
+#ifdef BTREE_DEBUG
+#include <iostream>
+#endif /* BTREE_DEBUG */
+
+using namespace mem_container;
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+typename BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::leaf_node_type *BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::find_start_leaf() const
+{
+    if (!_root) {
+        return NULL;
+    }
+    return leftmost_leaf(_root);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+V *BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::search(const K &x)
+{
+    auto it = find(x);
+    if (it == end()) {
+        return NULL;
+    }
+    return &(*it);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+const V *BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::search(const K &x) const
+{
+    auto it = cfind(x);
+    if (it == cend()) {
+        return NULL;
+    }
+    return &(*it);
+}
+
+#ifdef CONTAINER_HAS_INTERLEAVE
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+Interleaved<const V *> BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::search_interleaved(K x) const
+{
+    /* wide nodes are searched in a few scattered lines, their first lines are enough to get going */
+    constexpr size_t node_bytes = std::min(std::max(sizeof(leaf_node_type), sizeof(internal_node_type)), 8 * bptree_helper::cache_line_size);
+    const node_type *cursor = _root;
+    if (!cursor) {
+        co_return NULL;
+    }
+    while (!cursor->is_leaf) {
+        cursor = reinterpret_cast<const internal_node_type *>(cursor)->ptr[cursor->child_index_of(x)];
+        co_await prefetch_and_yield(cursor, node_bytes);
+    }
+    const leaf_node_type *leaf = reinterpret_cast<const leaf_node_type *>(cursor);
+    size_t i = leaf->item_index_of(x);
+    co_return i < leaf->size && x == leaf->key[i] ? &leaf->values[i] : NULL;
+}
+#endif /* CONTAINER_HAS_INTERLEAVE */
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+typename BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::iterator BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::find_left(const K &x)
+{
+    if (!_root) {
+        return end();
+    }
+    node_type *cursor = _root;
+    while (!cursor->is_leaf) {
+        cursor = reinterpret_cast<internal_node_type *>(cursor)->ptr[cursor->child_index_of(x)];
+    }
+    size_t i = cursor->child_index_of(x);
+    if (i == 0) {
+        leaf_node_type *node = reinterpret_cast<leaf_node_type *>(cursor)->prev;
+        return node ? iterator(node, node->size - 1) : end();
+    }
+    return iterator(reinterpret_cast<leaf_node_type *>(cursor), i - 1);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+typename BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::const_iterator BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::cfind_left(const K &x) const
+{
+    if (!_root) {
+        return cend();
+    }
+    node_type *cursor = _root;
+    while (!cursor->is_leaf) {
+        cursor = reinterpret_cast<internal_node_type *>(cursor)->ptr[cursor->child_index_of(x)];
+    }
+    size_t i = cursor->child_index_of(x);
+    if (i == 0) {
+        leaf_node_type *node = reinterpret_cast<leaf_node_type *>(cursor)->prev;
+        return node ? const_iterator(node, node->size - 1) : cend();
+    }
+    return const_iterator(reinterpret_cast<leaf_node_type *>(cursor), i - 1);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+typename BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::iterator BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::find(const K &x)
+{
+    if (!_root) {
+        return end();
+    }
+    node_type *cursor = _root;
+    while (!cursor->is_leaf) {
+        cursor = reinterpret_cast<internal_node_type *>(cursor)->ptr[cursor->child_index_of(x)];
+    }
+    size_t i = cursor->item_index_of(x);
+    if (i < cursor->size && x == cursor->keys()[i]) {
+        return iterator(reinterpret_cast<leaf_node_type *>(cursor), i);
+    }
+    return end();
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+typename BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::const_iterator BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::cfind(const K &x) const
+{
+    if (!_root) {
+        return cend();
+    }
+    node_type *cursor = _root;
+    while (!cursor->is_leaf) {
+        cursor = reinterpret_cast<internal_node_type *>(cursor)->ptr[cursor->child_index_of(x)];
+    }
+    size_t i = cursor->item_index_of(x);
+    if (i < cursor->size && x == cursor->keys()[i]) {
+        return const_iterator(reinterpret_cast<leaf_node_type *>(cursor), i);
+    }
+    return cend();
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+typename BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::node_type *BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::insert_split(const K &x, const V &v, node_type *child, node_type *src, size_t i, K &split_key)
+{
+    node_type *new_node = src->is_leaf ? (node_type *)new_leaf() : (node_type *)new_internal();
+    const size_t max_size = src->is_leaf ? MAX_BPTREE_NODE_SIZE : MAX_BPTREE_INTERNAL_SIZE;
+    CONTAINER_ASSERT(src->size == max_size);
+    src->size = (max_size + 1) / 2;
+    new_node->size = max_size - (max_size + 1) / 2;
+
+    if (i < src->size) {
+        if (!src->is_leaf) {
+            split_key = src->keys()[src->size - 1];
+            memcpy(new_node->keys(), src->keys() + src->size, sizeof(K) * new_node->size);
+            memmove(src->keys() + i + 1, src->keys() + i, sizeof(K) * (src->size - i - 1));
+            src->keys()[i] = x;
+            node_type **new_ptr = reinterpret_cast<internal_node_type *>(new_node)->ptr;
+            node_type **src_ptr = reinterpret_cast<internal_node_type *>(src)->ptr;
+            memcpy(new_ptr, src_ptr + src->size, sizeof(node_type *) * (new_node->size + 1));
+            memmove(src_ptr + i + 1, src_ptr + i, sizeof(node_type *) * (src->size - i));
+            src_ptr[i + 1] = child;
+        } else {
+            memcpy(new_node->keys(), src->keys() + src->size, sizeof(K) * new_node->size);
+            memmove(src->keys() + i + 1, src->keys() + i, sizeof(K) * (src->size - i));
+            src->keys()[i] = x;
+            V *new_val = reinterpret_cast<leaf_node_type *>(new_node)->values;
+            V *src_val = reinterpret_cast<leaf_node_type *>(src)->values;
+            memcpy(new_val, src_val + src->size, sizeof(V) * new_node->size);
+            memmove(src_val + i + 1, src_val + i, sizeof(V) * (src->size - i));
+            src_val[i] = v;
+            ++src->size;
+        }
+    } else {
+        i -= src->size;
+        if (!src->is_leaf) {
+            node_type **new_ptr = reinterpret_cast<internal_node_type *>(new_node)->ptr;
+            node_type **src_ptr = reinterpret_cast<internal_node_type *>(src)->ptr;
+            if (i == 0) {
+                split_key = x;
+                memcpy(new_node->keys(), src->keys() + src->size, sizeof(K) * new_node->size);
+                memcpy(new_ptr + 1, src_ptr + src->size + 1, sizeof(node_type *) * (new_node->size));
+                new_ptr[i] = child;
+            } else {
+                split_key = src->keys()[src->size];
+                memcpy(new_ptr, src_ptr + src->size + 1, sizeof(node_type *) * i);
+                new_ptr[i] = child;
+                memcpy(new_ptr + i + 1, src_ptr + src->size + i + 1, sizeof(node_type *) * (new_node->size - i));
+                --i;
+                memcpy(new_node->keys(), src->keys() + src->size + 1, sizeof(K) * i);
+                memcpy(new_node->keys() + i + 1, src->keys() + src->size + i + 1, sizeof(K) * (new_node->size - i));
+                new_node->keys()[i] = x;
+            }
+        } else {
+            memcpy(new_node->keys(), src->keys() + src->size, sizeof(K) * i);
+            memcpy(new_node->keys() + i + 1, src->keys() + src->size + i, sizeof(K) * (new_node->size - i));
+            new_node->keys()[i] = x;
+            V *new_val = reinterpret_cast<leaf_node_type *>(new_node)->values;
+            V *src_val = reinterpret_cast<leaf_node_type *>(src)->values;
+            memcpy(new_val, src_val + src->size, sizeof(V) * i);
+            new_val[i] = v;
+            memcpy(new_val + i + 1, src_val + src->size + i, sizeof(V) * (new_node->size - i));
+            ++new_node->size;
+        }
+    }
+    if (src->is_leaf) {
+        reinterpret_cast<leaf_node_type *>(new_node)->next = reinterpret_cast<leaf_node_type *>(src)->next;
+        reinterpret_cast<leaf_node_type *>(src)->next = reinterpret_cast<leaf_node_type *>(new_node);
+        reinterpret_cast<leaf_node_type *>(new_node)->prev = reinterpret_cast<leaf_node_type *>(src);
+        if (reinterpret_cast<leaf_node_type *>(new_node)->next) {
+            reinterpret_cast<leaf_node_type *>(new_node)->next->prev = reinterpret_cast<leaf_node_type *>(new_node);
+        } else {
+            _last = reinterpret_cast<leaf_node_type *>(new_node);
+        }
+        split_key = new_node->keys()[0];
+    }
+    return new_node;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::insert(const K &x, const V &v)
+{
+    if (!_root) {
+        _root = new_leaf();
+        reinterpret_cast<leaf_node_type *>(_root)->key[0] = x;
+        reinterpret_cast<leaf_node_type *>(_root)->values[0] = v;
+        _root->size = 1;
+        reinterpret_cast<leaf_node_type *>(_root)->next = NULL;
+        reinterpret_cast<leaf_node_type *>(_root)->prev = NULL;
+        _last = reinterpret_cast<leaf_node_type *>(_root);
+        _size = 1;
+        ++_structure_version;
+        return;
+    }
+    /* a leaf is only empty as the root of an empty tree, which is freed right away */
+    if constexpr (!augmented) {
+        if (_last->key[_last->size - 1] < x) {
+            append(x, v);
+            return;
+        }
+    }
+
+    Path path;
+    leaf_node_type *leaf = descend(x, path);
+    ++_size;
+    if (leaf->size < MAX_BPTREE_NODE_SIZE) {
+        size_t i = leaf->item_index_of(x);
+        memmove(leaf->key + i + 1, leaf->key + i, sizeof(K) * (leaf->size - i));
+        leaf->key[i] = x;
+        memmove(leaf->values + i + 1, leaf->values + i, sizeof(V) * (leaf->size - i ));
+        leaf->values[i] = v;
+        ++leaf->size;
+        refresh_path(path, path.depth);
+        check_invariant(path.depth > 0 ? path.node[path.depth - 1] : NULL);
+        return;
+    }
+
+    K split_key;
+    node_type *new_leaf = insert_split(x, v, NULL, leaf, leaf->item_index_of(x), split_key);
+    insert_internal(split_key, v, path, leaf, new_leaf);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::append(const K &x, const V &v)
+{
+    leaf_node_type *leaf = _last;
+    ++_size;
+    if (leaf->size < MAX_BPTREE_NODE_SIZE) {
+        leaf->key[leaf->size] = x;
+        leaf->values[leaf->size] = v;
+        ++leaf->size;
+        return;
+    }
+    /* the next appends fill the new leaf, so the full one keeps nine tenth of its keys */
+    Path path;
+    leaf_node_type *found = descend(x, path);
+    CONTAINER_ASSERT(found == leaf);
+    (void)found;
+    leaf_node_type *right = new_leaf();
+    size_t n = MAX_BPTREE_NODE_SIZE / 10;
+    leaf->size -= n;
+    memcpy(right->key, leaf->key + leaf->size, sizeof(K) * n);
+    memcpy(right->values, leaf->values + leaf->size, sizeof(V) * n);
+    right->key[n] = x;
+    right->values[n] = v;
+    right->size = n + 1;
+    right->next = NULL;
+    right->prev = leaf;
+    leaf->next = right;
+    _last = right;
+    insert_internal(right->key[0], v, path, leaf, right);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::insert_hint(iterator hint, const K &x, const V &v)
+{
+    if constexpr (!augmented) {
+        leaf_node_type *leaf = hint.node ? hint.node : _last;
+        size_t i = hint.node ? hint.index : (leaf ? leaf->size : 0);
+        /*
+         * separators above the leaf are not known here, so x has to stay inside the keys of the
+         * leaf unless the leaf is the first or the last one
+         */
+        if (leaf && leaf->size < MAX_BPTREE_NODE_SIZE && (i > 0 ? leaf->key[i - 1] < x : !leaf->prev) &&
+            (i < leaf->size ? x < leaf->key[i] : !leaf->next)) {
+            memmove(leaf->key + i + 1, leaf->key + i, sizeof(K) * (leaf->size - i));
+            leaf->key[i] = x;
+            memmove(leaf->values + i + 1, leaf->values + i, sizeof(V) * (leaf->size - i));
+            leaf->values[i] = v;
+            ++leaf->size;
+            ++_size;
+            return;
+        }
+    }
+    insert(x, v);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::bulk_load(const K *keys, const V *values, size_t n, float fill_factor)
+{
+    destroy();
+    if (n == 0) {
+        return;
+    }
+    _size = n;
+    auto fill_of = [fill_factor](size_t max_size, size_t min_size) {
+        return std::clamp(size_t(max_size * fill_factor + 0.5f), std::max<size_t>(min_size, 1), max_size);
+    };
+
+    /* nodes of the level under construction and the smallest key of their subtrees */
+    size_t nnode = bulk_node_count(n, fill_of(MAX_BPTREE_NODE_SIZE, (MAX_BPTREE_NODE_SIZE + 1) / 2), MAX_BPTREE_NODE_SIZE);
+    node_type **level = (node_type **)malloc(sizeof(node_type *) * nnode);
+    K *low_keys = (K *)malloc(sizeof(K) * nnode);
+    leaf_node_type *prev = NULL;
+    for (size_t i = 0, pos = 0; i < nnode; ++i) {
+        leaf_node_type *leaf = new_leaf();
+        leaf->size = n / nnode + (i < n % nnode);
+        memcpy(leaf->key, keys + pos, sizeof(K) * leaf->size);
+        memcpy(leaf->values, values + pos, sizeof(V) * leaf->size);
+        pos += leaf->size;
+        leaf->prev = prev;
+        if (prev) {
+            prev->next = leaf;
+        }
+        prev = leaf;
+        level[i] = leaf;
+        low_keys[i] = leaf->key[0];
+    }
+
+    size_t fill = fill_of(MAX_BPTREE_INTERNAL_SIZE, (MAX_BPTREE_INTERNAL_SIZE + 1) / 2 - 1) + 1;
+    while (nnode > 1) {
+        size_t nparent = bulk_node_count(nnode, fill, MAX_BPTREE_INTERNAL_SIZE + 1);
+        for (size_t i = 0, pos = 0; i < nparent; ++i) {
+            internal_node_type *parent = new_internal();
+            size_t nchild = nnode / nparent + (i < nnode % nparent);
+            parent->size = nchild - 1;
+            memcpy(parent->ptr, level + pos, sizeof(node_type *) * nchild);
+            memcpy(parent->key, low_keys + pos + 1, sizeof(K) * parent->size);
+            refresh_all(parent);
+            /* levels shrink, so the slots of this level are reused in place */
+            level[i] = parent;
+            low_keys[i] = low_keys[pos];
+            pos += nchild;
+        }
+        nnode = nparent;
+    }
+    _root = level[0];
+    _last = prev;
+    free(level);
+    free(low_keys);
+    check_invariant(_root);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+template <typename Func>
+size_t BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::scan(const K &lo, const K &hi, Func &&visitor)
+{
+    if (!_root || !(lo < hi)) {
+        return 0;
+    }
+    node_type *cursor = _root;
+    while (!cursor->is_leaf) {
+        cursor = reinterpret_cast<internal_node_type *>(cursor)->ptr[cursor->child_index_of(lo)];
+    }
+    leaf_node_type *leaf = reinterpret_cast<leaf_node_type *>(cursor);
+    size_t res = 0;
+    prefetch_leaf(leaf->next);
+    for (size_t i = leaf->item_index_of(lo); leaf; leaf = leaf->next, i = 0) {
+        /* the next leaf is on its way already */
+        if (leaf->next) {
+            prefetch_leaf(leaf->next->next);
+        }
+        /* only the leaf holding hi needs a bound check per key */
+        bool last = leaf->size > 0 && !(leaf->key[leaf->size - 1] < hi);
+        size_t end = last ? leaf->item_index_of(hi) : leaf->size;
+        for (; i < end; ++i) {
+            ++res;
+            if (!visitor((const K &)leaf->key[i], leaf->values[i])) {
+                return res;
+            }
+        }
+        if (last) {
+            break;
+        }
+    }
+    return res;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+template <typename Func>
+size_t BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::scan_spans(const K &lo, const K &hi, Func &&visitor)
+{
+    if (!_root || !(lo < hi)) {
+        return 0;
+    }
+    node_type *cursor = _root;
+    while (!cursor->is_leaf) {
+        cursor = reinterpret_cast<internal_node_type *>(cursor)->ptr[cursor->child_index_of(lo)];
+    }
+    leaf_node_type *leaf = reinterpret_cast<leaf_node_type *>(cursor);
+    return scan_leaves(leaf, leaf->item_index_of(lo), NULL, &hi, visitor);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+template <typename Func>
+size_t BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::scan_leaves(leaf_node_type *leaf, size_t i, const leaf_node_type *stop, const K *hi, Func &visitor)
+{
+    size_t res = 0;
+    if (leaf != stop) {
+        prefetch_leaf(leaf->next);
+    }
+    for (; leaf != stop; leaf = leaf->next, i = 0) {
+        if (leaf->next) {
+            prefetch_leaf(leaf->next->next);
+        }
+        bool last = hi && leaf->size > 0 && !(leaf->key[leaf->size - 1] < *hi);
+        size_t end = last ? leaf->item_index_of(*hi) : leaf->size;
+        if (i < end) {
+            res += end - i;
+            if (!visitor((const K *)leaf->key + i, leaf->values + i, end - i)) {
+                return res;
+            }
+        }
+        if (last) {
+            break;
+        }
+    }
+    return res;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+size_t BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::partition(size_t n, Partition *parts)
+{
+    if (!_root || n == 0) {
+        return 0;
+    }
+    /* a level of fewer than n nodes has fewer than n * fanout children */
+    size_t capacity = n * (MAX_BPTREE_INTERNAL_SIZE + 1);
+    node_type **level = (node_type **)malloc(sizeof(node_type *) * capacity);
+    node_type **below = (node_type **)malloc(sizeof(node_type *) * capacity);
+    size_t count = 1;
+    level[0] = _root;
+    while (count < n && !level[0]->is_leaf) {
+        size_t nbelow = 0;
+        for (size_t i = 0; i < count; ++i) {
+            internal_node_type *node = reinterpret_cast<internal_node_type *>(level[i]);
+            memcpy(below + nbelow, node->ptr, sizeof(node_type *) * (node->size + 1));
+            nbelow += node->size + 1;
+        }
+        std::swap(level, below);
+        count = nbelow;
+    }
+    size_t res = std::min(n, count);
+    for (size_t i = 0; i < res; ++i) {
+        parts[i].first = leftmost_leaf(level[count * i / res]);
+        parts[i].stop = i + 1 < res ? leftmost_leaf(level[count * (i + 1) / res]) : NULL;
+    }
+    free(level);
+    free(below);
+    return res;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+size_t BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::erase_range(const K &lo, const K &hi)
+{
+    if (!_root || !(lo < hi)) {
+        return 0;
+    }
+    ++_structure_version;
+    /* every leaf strictly between the two boundary leaves is dropped */
+    node_type *left = _root;
+    node_type *right = _root;
+    while (!left->is_leaf) {
+        left = reinterpret_cast<internal_node_type *>(left)->ptr[left->child_index_of(lo)];
+        right = reinterpret_cast<internal_node_type *>(right)->ptr[right->item_index_of(hi)];
+    }
+    if (left != right) {
+        reinterpret_cast<leaf_node_type *>(left)->next = reinterpret_cast<leaf_node_type *>(right);
+        reinterpret_cast<leaf_node_type *>(right)->prev = reinterpret_cast<leaf_node_type *>(left);
+    }
+    size_t res = erase_range_internal(_root, &lo, &hi);
+    _size -= res;
+    while (!_root->is_leaf && _root->size == 0) {
+        node_type *child = reinterpret_cast<internal_node_type *>(_root)->ptr[0];
+        free_node(_root);
+        _root = child;
+    }
+    if (_root->size == 0) {
+        free_node(_root);
+        _root = NULL;
+        _last = NULL;
+    }
+    check_invariant(_root);
+    return res;
+}
+
+/* lo or hi is NULL when the subtree lies entirely above or below it */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+size_t BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::erase_range_internal(node_type *cursor, const K *lo, const K *hi)
+{
+    if (cursor->is_leaf) {
+        leaf_node_type *leaf = reinterpret_cast<leaf_node_type *>(cursor);
+        size_t begin = lo ? leaf->item_index_of(*lo) : 0;
+        size_t end = hi ? leaf->item_index_of(*hi) : leaf->size;
+        memmove(leaf->key + begin, leaf->key + end, sizeof(K) * (leaf->size - end));
+        memmove(leaf->values + begin, leaf->values + end, sizeof(V) * (leaf->size - end));
+        leaf->size -= end - begin;
+        return end - begin;
+    }
+    internal_node_type *node = reinterpret_cast<internal_node_type *>(cursor);
+    size_t first = lo ? node->child_index_of(*lo) : 0;
+    size_t last = hi ? node->item_index_of(*hi) : node->size;
+    size_t res = 0;
+    if (lo && hi && first == last) {
+        res = erase_range_internal(node->ptr[first], lo, hi);
+        fix_children(node);
+        refresh_all(node);
+        return res;
+    }
+    if (lo) {
+        res += erase_range_internal(node->ptr[first], lo, NULL);
+    }
+    if (hi) {
+        res += erase_range_internal(node->ptr[last], NULL, hi);
+    }
+    /* children in [begin, end) are covered by the range */
+    size_t begin = lo ? first + 1 : 0;
+    size_t end = hi ? last : node->size + 1;
+    for (size_t i = begin; i < end; ++i) {
+        res += drop_subtree(node->ptr[i]);
+    }
+    size_t ndrop = end - begin;
+    size_t key_begin = begin > 0 ? begin - 1 : 0;
+    memmove(node->key + key_begin, node->key + key_begin + ndrop, sizeof(K) * (node->size - key_begin - ndrop));
+    memmove(node->ptr + begin, node->ptr + end, sizeof(node_type *) * (node->size + 1 - end));
+    node->size -= ndrop;
+    fix_children(node);
+    refresh_all(node);
+    return res;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+size_t BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::drop_subtree(node_type *cursor)
+{
+    size_t res = 0;
+    if (cursor->is_leaf) {
+        res = cursor->size;
+    } else {
+        for (size_t i = 0; i < cursor->size + 1; ++i) {
+            res += drop_subtree(reinterpret_cast<internal_node_type *>(cursor)->ptr[i]);
+        }
+    }
+    free_node(cursor);
+    return res;
+}
+
+/* merge or redistribute underfull children until none is left, unless a single child remains */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::fix_children(internal_node_type *cursor)
+{
+    size_t i = 0;
+    while (cursor->size > 0 && i <= cursor->size) {
+        if (!underfull(cursor->ptr[i])) {
+            ++i;
+            continue;
+        }
+        i = i > 0 ? i - 1 : 0;
+        rebalance_children(cursor, i);
+    }
+}
+
+/* merge ptr[left + 1] into ptr[left] if they fit in one node, otherwise split their entries evenly */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::rebalance_children(internal_node_type *cursor, size_t left)
+{
+    if (cursor->ptr[left]->is_leaf) {
+        leaf_node_type *a = reinterpret_cast<leaf_node_type *>(cursor->ptr[left]);
+        leaf_node_type *b = reinterpret_cast<leaf_node_type *>(cursor->ptr[left + 1]);
+        if (a->size + b->size <= MAX_BPTREE_NODE_SIZE) {
+            memcpy(a->key + a->size, b->key, sizeof(K) * b->size);
+            memcpy(a->values + a->size, b->values, sizeof(V) * b->size);
+            a->size += b->size;
+            a->next = b->next;
+            if (b->next) {
+                b->next->prev = a;
+            } else {
+                _last = a;
+            }
+            memmove(cursor->key + left, cursor->key + left + 1, sizeof(K) * (cursor->size - left - 1));
+            memmove(cursor->ptr + left + 1, cursor->ptr + left + 2, sizeof(node_type *) * (cursor->size - left - 1));
+            --cursor->size;
+            free_node(b);
+            return;
+        }
+        size_t target = (a->size + b->size) / 2;
+        if (a->size < target) {
+            size_t n = target - a->size;
+            memcpy(a->key + a->size, b->key, sizeof(K) * n);
+            memcpy(a->values + a->size, b->values, sizeof(V) * n);
+            memmove(b->key, b->key + n, sizeof(K) * (b->size - n));
+            memmove(b->values, b->values + n, sizeof(V) * (b->size - n));
+            a->size += n;
+            b->size -= n;
+        } else if (a->size > target) {
+            size_t n = a->size - target;
+            memmove(b->key + n, b->key, sizeof(K) * b->size);
+            memmove(b->values + n, b->values, sizeof(V) * b->size);
+            memcpy(b->key, a->key + target, sizeof(K) * n);
+            memcpy(b->values, a->values + target, sizeof(V) * n);
+            a->size -= n;
+            b->size += n;
+        }
+        cursor->key[left] = b->key[0];
+        return;
+    }
+
+    internal_node_type *a = reinterpret_cast<internal_node_type *>(cursor->ptr[left]);
+    internal_node_type *b = reinterpret_cast<internal_node_type *>(cursor->ptr[left + 1]);
+    if (a->size + b->size + 1 <= MAX_BPTREE_INTERNAL_SIZE) {
+        a->key[a->size] = cursor->key[left];
+        memcpy(a->key + a->size + 1, b->key, sizeof(K) * b->size);
+        memcpy(a->ptr + a->size + 1, b->ptr, sizeof(node_type *) * (b->size + 1));
+        a->size += b->size + 1;
+        memmove(cursor->key + left, cursor->key + left + 1, sizeof(K) * (cursor->size - left - 1));
+        memmove(cursor->ptr + left + 1, cursor->ptr + left + 2, sizeof(node_type *) * (cursor->size - left - 1));
+        --cursor->size;
+        free_node(b);
+        fix_children(a);
+        refresh_all(a);
+        return;
+    }
+    /* children move across the separator in the parent */
+    size_t target = (a->size + b->size) / 2;
+    if (a->size < target) {
+        size_t n = target - a->size;
+        a->key[a->size] = cursor->key[left];
+        memcpy(a->key + a->size + 1, b->key, sizeof(K) * (n - 1));
+        memcpy(a->ptr + a->size + 1, b->ptr, sizeof(node_type *) * n);
+        cursor->key[left] = b->key[n - 1];
+        memmove(b->key, b->key + n, sizeof(K) * (b->size - n));
+        memmove(b->ptr, b->ptr + n, sizeof(node_type *) * (b->size + 1 - n));
+        a->size += n;
+        b->size -= n;
+    } else if (a->size > target) {
+        size_t n = a->size - target;
+        memmove(b->key + n, b->key, sizeof(K) * b->size);
+        memmove(b->ptr + n, b->ptr, sizeof(node_type *) * (b->size + 1));
+        b->key[n - 1] = cursor->key[left];
+        memcpy(b->key, a->key + target + 1, sizeof(K) * (n - 1));
+        memcpy(b->ptr, a->ptr + target + 1, sizeof(node_type *) * n);
+        cursor->key[left] = a->key[target];
+        a->size -= n;
+        b->size += n;
+    }
+    /* a child that had no sibling to rebalance with may sit in either half now */
+    fix_children(a);
+    fix_children(b);
+    refresh_all(a);
+    refresh_all(b);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+typename BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::leaf_node_type *BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::descend(const K &x, Path &path) const
+{
+    node_type *cursor = _root;
+    path.depth = 0;
+    while (!cursor->is_leaf) {
+        CONTAINER_ASSERT(path.depth < max_height);
+        internal_node_type *node = reinterpret_cast<internal_node_type *>(cursor);
+        size_t i = node->child_index_of(x);
+        path.node[path.depth] = node;
+        path.index[path.depth++] = i;
+        cursor = node->ptr[i];
+    }
+    return reinterpret_cast<leaf_node_type *>(cursor);
+}
+
+/* equal keys may run over several leaves, descend to the leftmost one that may hold the first key of leaf and step right */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+bool BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::path_to(const leaf_node_type *leaf, Path &path) const
+{
+    const K &x = leaf->key[0];
+    node_type *cursor = _root;
+    path.depth = 0;
+    while (!cursor->is_leaf) {
+        CONTAINER_ASSERT(path.depth < max_height);
+        internal_node_type *node = reinterpret_cast<internal_node_type *>(cursor);
+        size_t i = node->item_index_of(x);
+        path.node[path.depth] = node;
+        path.index[path.depth++] = i;
+        cursor = node->ptr[i];
+    }
+    while (cursor != leaf) {
+        /* past the run of keys equal to x, leaf cannot come later */
+        if (cursor->size > 0 && x < reinterpret_cast<leaf_node_type *>(cursor)->key[0]) {
+            return false;
+        }
+        size_t depth = path.depth;
+        while (depth > 0 && path.index[depth - 1] == path.node[depth - 1]->size) {
+            --depth;
+        }
+        if (depth == 0) {
+            return false;
+        }
+        cursor = path.node[depth - 1]->ptr[++path.index[depth - 1]];
+        for (; depth < path.depth; ++depth) {
+            internal_node_type *node = reinterpret_cast<internal_node_type *>(cursor);
+            path.node[depth] = node;
+            path.index[depth] = 0;
+            cursor = node->ptr[0];
+        }
+    }
+    return true;
+}
+
+/* right was split off left, link it into the parents recorded in path, splitting them upward as needed */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::insert_internal(K split_key, const V &v, Path &path, node_type *left, node_type *right)
+{
+    ++_structure_version;
+    while (path.depth > 0) {
+        internal_node_type *cursor = path.node[--path.depth];
+        size_t i = path.index[path.depth];
+        if (cursor->size < MAX_BPTREE_INTERNAL_SIZE) {
+            memmove(cursor->key + i + 1, cursor->key + i, sizeof(K) * (cursor->size - i));
+            cursor->key[i] = split_key;
+            memmove(cursor->ptr + i + 2, cursor->ptr + i + 1, sizeof(node_type *) * (cursor->size - i));
+            move_annotation(cursor, i + 2, cursor, i + 1, cursor->size - i);
+            cursor->ptr[i + 1] = right;
+            ++cursor->size;
+            refresh_entry(cursor, i);
+            refresh_entry(cursor, i + 1);
+            refresh_path(path, path.depth);
+            check_invariant(cursor);
+            return;
+        }
+        K x = split_key;
+        right = insert_split(x, v, right, cursor, i, split_key);
+        left = cursor;
+        refresh_all(cursor);
+        refresh_all(reinterpret_cast<internal_node_type *>(right));
+    }
+    internal_node_type *new_root = new_internal();
+    new_root->key[0] = split_key;
+    new_root->ptr[0] = left;
+    new_root->ptr[1] = right;
+    new_root->size = 1;
+    refresh_all(new_root);
+    _root = new_root;
+    check_invariant(_root);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+size_t BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::count_keys() const
+{
+    if (!_root) {
+        return 0;
+    }
+    size_t res = 0;
+    if constexpr (augmented) {
+        if (!_root->is_leaf) {
+            const internal_node_type *root = reinterpret_cast<const internal_node_type *>(_root);
+            for (size_t i = 0; i <= root->size; ++i) {
+                res += root->annotation.count[i];
+            }
+            return res;
+        }
+    }
+    for (const leaf_node_type *leaf = find_start_leaf(); leaf; leaf = leaf->next) {
+        res += leaf->size;
+    }
+    return res;
+}
+
+/* the root of the shorter tree may be underfull, it is merged or evened out with its new neighbour first */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+size_t BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::graft(node_type *left, size_t lh, const K &sep, node_type *right, size_t rh)
+{
+    if (!left || !right) {
+        _root = left ? left : right;
+        return left ? lh : rh;
+    }
+    if (lh == rh) {
+        internal_node_type *root = new_internal();
+        root->key[0] = sep;
+        root->ptr[0] = left;
+        root->ptr[1] = right;
+        root->size = 1;
+        if (underfull(left) || underfull(right)) {
+            rebalance_children(root, 0);
+        }
+        if (root->size == 0) {
+            _root = root->ptr[0];
+            free_node(root);
+            return lh;
+        }
+        refresh_all(root);
+        _root = root;
+        return lh + 1;
+    }
+    /* down the edge of the taller tree to the node as high as the shorter one */
+    bool taller_left = lh > rh;
+    node_type *cursor = taller_left ? left : right;
+    Path path;
+    for (size_t h = std::max(lh, rh); h > std::min(lh, rh); --h) {
+        internal_node_type *node = reinterpret_cast<internal_node_type *>(cursor);
+        size_t i = taller_left ? node->size : 0;
+        path.node[path.depth] = node;
+        path.index[path.depth++] = i;
+        cursor = node->ptr[i];
+    }
+    _root = taller_left ? left : right;
+    internal_node_type *pair = new_internal();
+    pair->key[0] = sep;
+    pair->ptr[0] = taller_left ? cursor : left;
+    pair->ptr[1] = taller_left ? right : cursor;
+    pair->size = 1;
+    if (underfull(taller_left ? right : left)) {
+        rebalance_children(pair, 0);
+    }
+    internal_node_type *parent = path.node[path.depth - 1];
+    parent->ptr[path.index[path.depth - 1]] = pair->ptr[0];
+    if (pair->size == 0) {
+        free_node(pair);
+        refresh_path(path, path.depth);
+        return std::max(lh, rh);
+    }
+    K split_key = pair->key[0];
+    node_type *a = pair->ptr[0];
+    node_type *b = pair->ptr[1];
+    free_node(pair);
+    node_type *root = _root;
+    insert_internal(split_key, V(), path, a, b);
+    return std::max(lh, rh) + (_root != root);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID> BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::split(const K &x)
+{
+    BPTree res;
+    if (!_root) {
+        return res;
+    }
+    if constexpr (POOLED) {
+        res._leaf_pool.share(_leaf_pool);
+        res._internal_pool.share(_internal_pool);
+    }
+    ++_structure_version;
+    Path path;
+    leaf_node_type *leaf = descend(x, path);
+    size_t pos = leaf->item_index_of(x);
+    /* the leaf chain is cut right before the first key not less than x */
+    node_type *left = NULL;
+    node_type *right = NULL;
+    if (pos == 0) {
+        right = leaf;
+        _last = leaf->prev;
+        if (leaf->prev) {
+            leaf->prev->next = NULL;
+        }
+        leaf->prev = NULL;
+    } else if (pos == leaf->size) {
+        left = leaf;
+        if (leaf->next) {
+            leaf->next->prev = NULL;
+        }
+        leaf->next = NULL;
+        _last = leaf;
+    } else {
+        leaf_node_type *piece = res.new_leaf();
+        piece->size = leaf->size - pos;
+        memcpy(piece->key, leaf->key + pos, sizeof(K) * piece->size);
+        memcpy(piece->values, leaf->values + pos, sizeof(V) * piece->size);
+        leaf->size = pos;
+        piece->next = leaf->next;
+        if (leaf->next) {
+            leaf->next->prev = piece;
+        }
+        piece->prev = NULL;
+        leaf->next = NULL;
+        left = leaf;
+        right = piece;
+        _last = leaf;
+    }
+    res._last = reinterpret_cast<leaf_node_type *>(right);
+
+    /* every node on the path gives its children before and after the cut to either side */
+    size_t lh = 0;
+    size_t rh = 0;
+    for (size_t depth = path.depth; depth > 0; --depth) {
+        internal_node_type *node = path.node[depth - 1];
+        size_t i = path.index[depth - 1];
+        size_t height = path.depth - depth + 1;
+        size_t nright = node->size - i;
+        if (nright > 0) {
+            node_type *piece = node->ptr[i + 1];
+            if (nright > 1) {
+                internal_node_type *copy = res.new_internal();
+                copy->size = nright - 1;
+                memcpy(copy->key, node->key + i + 1, sizeof(K) * copy->size);
+                memcpy(copy->ptr, node->ptr + i + 1, sizeof(node_type *) * nright);
+                move_annotation(copy, 0, node, i + 1, nright);
+                piece = copy;
+            }
+            /* the piece lies right of everything grafted so far, merges in graft keep its rightmost leaf */
+            res._last = rightmost_leaf(piece);
+            rh = res.graft(right, rh, node->key[i], piece, nright > 1 ? height : height - 1);
+            right = res._root;
+        }
+        if (i == 0) {
+            free_node(node);
+        } else if (i == 1) {
+            K sep = node->key[0];
+            node_type *child = node->ptr[0];
+            free_node(node);
+            lh = graft(child, height - 1, sep, left, lh);
+            left = _root;
+        } else {
+            K sep = node->key[i - 1];
+            node->size = i - 1;
+            lh = graft(node, height, sep, left, lh);
+            left = _root;
+        }
+    }
+    _root = left;
+    res._root = right;
+    if constexpr (augmented) {
+        _size = count_keys();
+        res._size = res.count_keys();
+    } else {
+        _size_known = false;
+        res._size_known = false;
+    }
+    check_invariant(_root);
+    res.check_invariant(res._root);
+    return res;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::join(BPTree &other)
+{
+    if (!other._root) {
+        return;
+    }
+    if (!_root) {
+        *this = std::move(other);
+        return;
+    }
+    leaf_node_type *first = other.find_start_leaf();
+    CONTAINER_ASSERT(_last->key[_last->size - 1] < first->key[0]);
+    if constexpr (POOLED) {
+        _leaf_pool.absorb(other._leaf_pool);
+        _internal_pool.absorb(other._internal_pool);
+    }
+    ++_structure_version;
+    _last->next = first;
+    first->prev = _last;
+    _last = other._last;
+    _size += other._size;
+    _size_known = _size_known && other._size_known;
+    node_type *right = other._root;
+    other._root = NULL;
+    other._last = NULL;
+    other._size = 0;
+    other._size_known = true;
+    ++other._structure_version;
+    graft(_root, height_of(_root), first->key[0], right, height_of(right));
+    check_invariant(_root);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+bool BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::compact(size_t budget)
+{
+    if (!_root) {
+        _compacting = false;
+        return true;
+    }
+    ++_structure_version;
+    Path path;
+    descend(_compacting ? _compact_next : find_start_leaf()->key[0], path);
+    if (path.depth == 0) {
+        /* a single leaf has no neighbour to merge with and nothing to line up with */
+        _compacting = false;
+        return true;
+    }
+    while (budget > 0) {
+        internal_node_type *parent = path.node[path.depth - 1];
+        budget -= compact_children(path, budget);
+        /* leaves move when the parents are rebalanced, so the sweep goes on by key */
+        size_t i = path.index[path.depth - 1];
+        leaf_node_type *next = i <= parent->size ? reinterpret_cast<leaf_node_type *>(parent->ptr[i])
+                                                 : reinterpret_cast<leaf_node_type *>(parent->ptr[parent->size])->next;
+        _compacting = next != NULL;
+        if (next) {
+            _compact_next = next->key[0];
+        }
+
+        size_t depth = path.depth - 1;
+        while (depth > 0 && underfull(path.node[depth]) && path.node[depth - 1]->size > 0) {
+            internal_node_type *grandparent = path.node[depth - 1];
+            size_t index = path.index[depth - 1];
+            rebalance_children(grandparent, index > 0 ? index - 1 : index);
+            refresh_all(grandparent);
+            --depth;
+        }
+        refresh_path(path, depth);
+        while (!_root->is_leaf && _root->size == 0) {
+            node_type *child = reinterpret_cast<internal_node_type *>(_root)->ptr[0];
+            free_node(_root);
+            _root = child;
+        }
+        if (!_compacting || _root->is_leaf) {
+            _compacting = false;
+            break;
+        }
+        descend(_compact_next, path);
+    }
+    check_invariant(_root);
+    return !_compacting;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+size_t BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::compact_children(Path &path, size_t budget)
+{
+    internal_node_type *parent = path.node[path.depth - 1];
+    size_t &i = path.index[path.depth - 1];
+    size_t visited = 0;
+    for (; i <= parent->size && visited < budget; ++i, ++visited) {
+        while (i < parent->size && parent->ptr[i]->size + parent->ptr[i + 1]->size <= MAX_BPTREE_NODE_SIZE) {
+            rebalance_children(parent, i);
+        }
+        if constexpr (POOLED) {
+            leaf_node_type *leaf = reinterpret_cast<leaf_node_type *>(parent->ptr[i]);
+            /* only a leaf breaking the order moves, and the ones after it follow it to its new place */
+            if (!leaf->prev || leaf->prev + 1 == leaf || _leaf_pool.starts_slab(leaf)) {
+                continue;
+            }
+            leaf_node_type *moved = new (_leaf_pool.alloc_after(leaf->prev)) leaf_node_type(*leaf);
+            if (moved->prev) {
+                moved->prev->next = moved;
+            }
+            if (moved->next) {
+                moved->next->prev = moved;
+            } else {
+                _last = moved;
+            }
+            parent->ptr[i] = moved;
+            free_node(leaf);
+        }
+    }
+    refresh_all(parent);
+    return visited;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::remove(iterator it)
+{
+    leaf_node_type *leaf = reinterpret_cast<leaf_node_type *>(it.node);
+    if (leaf == NULL) {
+        return;
+    }
+    /* the path is only needed when the leaf is about to underflow or annotations are kept */
+    Path path;
+    if (leaf != _root && (augmented || leaf->size <= (MAX_BPTREE_NODE_SIZE + 1) / 2)) {
+        if (!path_to(leaf, path)) {
+            CONTAINER_ASSERT(false);
+            return;
+        }
+    }
+    remove_at(path, leaf, it.index);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+bool BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::remove(const K &x)
+{
+    if (!_root) {
+        return false;
+    }
+    Path path;
+    leaf_node_type *leaf = descend(x, path);
+    size_t i = leaf->item_index_of(x);
+    if (i >= leaf->size || !(x == leaf->key[i])) {
+        return false;
+    }
+    remove_at(path, leaf, i);
+    return true;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::remove_at(Path &path, leaf_node_type *leaf, size_t pos)
+{
+    --_size;
+    --leaf->size;
+    memmove(leaf->key + pos, leaf->key + pos + 1, sizeof(K) * (leaf->size - pos));
+    memmove(leaf->values + pos, leaf->values + pos + 1, sizeof(V) * (leaf->size - pos));
+    if (leaf == _root) {
+        if (leaf->size == 0) {
+            free_node(leaf);
+            _root = NULL;
+            _last = NULL;
+            ++_structure_version;
+        }
+        return;
+    }
+
+    if (leaf->size >= (MAX_BPTREE_NODE_SIZE + 1) / 2) {
+        refresh_path(path, path.depth);
+        return;
+    }
+    /* borrowing moves a separator, merging drops a leaf */
+    ++_structure_version;
+
+    internal_node_type *parent = path.node[path.depth - 1];
+    size_t index = path.index[path.depth - 1];
+    size_t left_sibling = index > 0 ? index - 1 : SIZE_MAX;
+    size_t right_sibling = index + 1;
+    if (left_sibling != SIZE_MAX) {
+        leaf_node_type *left_node = reinterpret_cast<leaf_node_type *>(parent->ptr[left_sibling]);
+        if (left_node->size >= (MAX_BPTREE_NODE_SIZE + 1) / 2 + 1) {
+            memmove(leaf->key + 1, leaf->key, sizeof(K) * leaf->size);
+            leaf->key[0] = left_node->key[left_node->size - 1];
+            memmove(leaf->values + 1, leaf->values, sizeof(V) * leaf->size);
+            leaf->values[0] = left_node->values[left_node->size - 1];
+            ++leaf->size;
+            --left_node->size;
+            parent->key[left_sibling] = leaf->key[0];
+            refresh_entry(parent, left_sibling);
+            refresh_entry(parent, index);
+            refresh_path(path, path.depth - 1);
+            check_invariant(parent);
+            return;
+        }
+    }
+    if (right_sibling <= parent->size) {
+        leaf_node_type *right_node = reinterpret_cast<leaf_node_type *>(parent->ptr[right_sibling]);
+        if (right_node->size >= (MAX_BPTREE_NODE_SIZE + 1) / 2 + 1) {
+            leaf->key[leaf->size] = right_node->key[0];
+            leaf->values[leaf->size] = right_node->values[0];
+            ++leaf->size;
+            --right_node->size;
+            memmove(right_node->key, right_node->key + 1, sizeof(K) * right_node->size);
+            memmove(right_node->values, right_node->values + 1, sizeof(V) * right_node->size);
+            parent->key[right_sibling - 1] = right_node->key[0];
+            refresh_entry(parent, index);
+            refresh_entry(parent, right_sibling);
+            refresh_path(path, path.depth - 1);
+            check_invariant(parent);
+            return;
+        }
+    }
+
+    if (left_sibling != SIZE_MAX) {
+        leaf_node_type *left_node = reinterpret_cast<leaf_node_type *>(parent->ptr[left_sibling]);
+        memcpy(left_node->key + left_node->size, leaf->key, sizeof(K) * leaf->size);
+        memcpy(left_node->values + left_node->size, leaf->values, sizeof(V) * leaf->size);
+        left_node->size += leaf->size;
+        reinterpret_cast<leaf_node_type *>(left_node)->next = leaf->next;
+        if (leaf->next) {
+            leaf->next->prev = left_node;
+        } else {
+            _last = left_node;
+        }
+        remove_internal(path, index);
+    } else if (right_sibling <= parent->size) {
+        leaf_node_type *right_node = reinterpret_cast<leaf_node_type *>(parent->ptr[right_sibling]);
+        memcpy(leaf->key + leaf->size, right_node->key, sizeof(K) * right_node->size);
+        memcpy(leaf->values + leaf->size, right_node->values, sizeof(V) * right_node->size);
+        leaf->size += right_node->size;
+        leaf->next = right_node->next;
+        if (right_node->next) {
+            right_node->next->prev = leaf;
+        } else {
+            _last = leaf;
+        }
+        remove_internal(path, index + 1);
+    }
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::remove_internal(Path &path, size_t pos)
+{
+    internal_node_type *cursor = path.node[--path.depth];
+    node_type *child = cursor->ptr[pos];
+    if (cursor == _root && cursor->size == 1) {
+        free_node(child);
+        _root = cursor->ptr[0];
+        free_node(cursor);
+        return;
+    }
+    memmove(cursor->key + pos - 1, cursor->key + pos, sizeof(K) * (cursor->size - pos));
+    memmove(cursor->ptr + pos, cursor->ptr + pos + 1, sizeof(node_type *) * (cursor->size - pos));
+    move_annotation(cursor, pos, cursor, pos + 1, cursor->size - pos);
+    free_node(child);
+    cursor->size--;
+    /* ptr[pos - 1] took over the entries of the removed child */
+    refresh_entry(cursor, pos - 1);
+    if (cursor->size >= (MAX_BPTREE_INTERNAL_SIZE + 1) / 2 - 1 || cursor == _root) {
+        refresh_path(path, path.depth);
+        return;
+    }
+
+    internal_node_type *parent = path.node[path.depth - 1];
+    pos = path.index[path.depth - 1];
+    size_t left_sibling = pos > 0 ? pos - 1 : SIZE_MAX;
+    size_t right_sibling = pos + 1;
+
+    if (left_sibling != SIZE_MAX) {
+        auto *left_node = reinterpret_cast<internal_node_type *>(parent->ptr[left_sibling]);
+        if (left_node->size >= (MAX_BPTREE_INTERNAL_SIZE + 1) / 2) {
+            memmove(cursor->key + 1, cursor->key, sizeof(K) * cursor->size);
+            cursor->key[0] = parent->key[left_sibling];
+            parent->key[left_sibling] = left_node->key[left_node->size - 1];
+            memmove(cursor->ptr + 1, cursor->ptr, sizeof(node_type *) * (cursor->size + 1));
+            cursor->ptr[0] = left_node->ptr[left_node->size];
+            move_annotation(cursor, 1, cursor, 0, cursor->size + 1);
+            move_annotation(cursor, 0, left_node, left_node->size, 1);
+            ++cursor->size;
+            --left_node->size;
+            refresh_entry(parent, left_sibling);
+            refresh_entry(parent, pos);
+            refresh_path(path, path.depth - 1);
+            check_invariant(parent);
+            return;
+        }
+    }
+    if (right_sibling <= parent->size) {
+        auto *right_node = reinterpret_cast<internal_node_type *>(parent->ptr[right_sibling]);
+        if (right_node->size >= (MAX_BPTREE_INTERNAL_SIZE + 1) / 2) {
+            cursor->key[cursor->size] = parent->key[pos];
+            parent->key[pos] = right_node->key[0];
+            memmove(right_node->key, right_node->key + 1, sizeof(K) * right_node->size);
+            cursor->ptr[cursor->size + 1] = right_node->ptr[0];
+            memmove(right_node->ptr, right_node->ptr + 1, sizeof(node_type *) * (right_node->size));
+            move_annotation(cursor, cursor->size + 1, right_node, 0, 1);
+            move_annotation(right_node, 0, right_node, 1, right_node->size);
+            ++cursor->size;
+            --right_node->size;
+            refresh_entry(parent, pos);
+            refresh_entry(parent, right_sibling);
+            refresh_path(path, path.depth - 1);
+            check_invariant(parent);
+            return;
+        }
+    }
+    if (left_sibling != SIZE_MAX) {
+        auto *left_node = reinterpret_cast<internal_node_type *>(parent->ptr[left_sibling]);
+        left_node->key[left_node->size] = parent->key[left_sibling];
+        memcpy(left_node->key + left_node->size + 1, cursor->key, sizeof(K) * cursor->size);
+        memcpy(left_node->ptr + left_node->size + 1, cursor->ptr, sizeof(node_type *) * (cursor->size + 1));
+        move_annotation(left_node, left_node->size + 1, cursor, 0, cursor->size + 1);
+        memset(cursor->ptr, 0, sizeof(node_type *) * (cursor->size + 1));
+        left_node->size += cursor->size + 1;
+        cursor->size = 0;
+        remove_internal(path, pos);
+    } else if (right_sibling <= parent->size) {
+        auto *right_node = reinterpret_cast<internal_node_type *>(parent->ptr[right_sibling]);
+        cursor->key[cursor->size] = parent->key[right_sibling - 1];
+        memcpy(cursor->key + cursor->size + 1, right_node->key, sizeof(K) * right_node->size);
+        memcpy(cursor->ptr + cursor->size + 1, right_node->ptr, sizeof(node_type *) * (right_node->size + 1));
+        move_annotation(cursor, cursor->size + 1, right_node, 0, right_node->size + 1);
+        memset(right_node->ptr, 0, sizeof(node_type *) * (right_node->size + 1));
+        cursor->size += right_node->size + 1;
+        right_node->size = 0;
+        remove_internal(path, pos + 1);
+    }
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+bool BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::update(const K &x, const V &v)
+{
+    if (!_root) {
+        return false;
+    }
+    Path path;
+    leaf_node_type *leaf = descend(x, path);
+    size_t i = leaf->item_index_of(x);
+    if (i >= leaf->size || !(x == leaf->key[i])) {
+        return false;
+    }
+    leaf->values[i] = v;
+    refresh_path(path, path.depth);
+    return true;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::refresh_entry(internal_node_type *node, size_t i)
+{
+    if constexpr (augmented) {
+        const node_type *child = node->ptr[i];
+        size_t count = 0;
+        summary_type summary = MONOID::identity();
+        if (child->is_leaf) {
+            const leaf_node_type *leaf = reinterpret_cast<const leaf_node_type *>(child);
+            count = leaf->size;
+            for (size_t j = 0; j < leaf->size; ++j) {
+                summary = MONOID::combine(summary, MONOID::lift(leaf->key[j], leaf->values[j]));
+            }
+        } else {
+            const internal_node_type *inner = reinterpret_cast<const internal_node_type *>(child);
+            for (size_t j = 0; j <= inner->size; ++j) {
+                count += inner->annotation.count[j];
+                summary = MONOID::combine(summary, inner->annotation.summary[j]);
+            }
+        }
+        node->annotation.count[i] = count;
+        node->annotation.summary[i] = summary;
+    }
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+size_t BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::rank(const K &x) const
+{
+    static_assert(augmented, "rank needs an augmented bptree");
+    if (!_root) {
+        return 0;
+    }
+    size_t res = 0;
+    const node_type *cursor = _root;
+    while (!cursor->is_leaf) {
+        const internal_node_type *node = reinterpret_cast<const internal_node_type *>(cursor);
+        size_t i = node->child_index_of(x);
+        for (size_t j = 0; j < i; ++j) {
+            res += node->annotation.count[j];
+        }
+        cursor = node->ptr[i];
+    }
+    return res + cursor->item_index_of(x);
+}
+
+/* leaf holding the k-th key, k becomes the index inside it */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+typename BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::leaf_node_type *BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::select_leaf(size_t &k) const
+{
+    static_assert(augmented, "select needs an augmented bptree");
+    if (k >= size()) {
+        k = 0;
+        return NULL;
+    }
+    node_type *cursor = _root;
+    while (!cursor->is_leaf) {
+        internal_node_type *node = reinterpret_cast<internal_node_type *>(cursor);
+        size_t i = 0;
+        while (k >= node->annotation.count[i]) {
+            k -= node->annotation.count[i++];
+        }
+        cursor = node->ptr[i];
+    }
+    return reinterpret_cast<leaf_node_type *>(cursor);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+typename BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::summary_type BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::aggregate(const K &lo, const K &hi) const
+{
+    static_assert(augmented, "aggregate needs an augmented bptree");
+    if (!_root || !(lo < hi)) {
+        return MONOID::identity();
+    }
+    return aggregate_internal(_root, &lo, &hi);
+}
+
+/* same walk as erase_range_internal, children inside the range contribute their stored summary */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+typename BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::summary_type BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::aggregate_internal(const node_type *cursor, const K *lo, const K *hi) const
+{
+    summary_type res = MONOID::identity();
+    if (cursor->is_leaf) {
+        const leaf_node_type *leaf = reinterpret_cast<const leaf_node_type *>(cursor);
+        size_t end = hi ? leaf->item_index_of(*hi) : leaf->size;
+        for (size_t i = lo ? leaf->item_index_of(*lo) : 0; i < end; ++i) {
+            res = MONOID::combine(res, MONOID::lift(leaf->key[i], leaf->values[i]));
+        }
+        return res;
+    }
+    const internal_node_type *node = reinterpret_cast<const internal_node_type *>(cursor);
+    size_t first = lo ? node->child_index_of(*lo) : 0;
+    size_t last = hi ? node->item_index_of(*hi) : node->size;
+    if (lo && hi && first == last) {
+        return aggregate_internal(node->ptr[first], lo, hi);
+    }
+    if (lo) {
+        res = aggregate_internal(node->ptr[first], lo, NULL);
+    }
+    size_t end = hi ? last : node->size + 1;
+    for (size_t i = lo ? first + 1 : 0; i < end; ++i) {
+        res = MONOID::combine(res, node->annotation.summary[i]);
+    }
+    if (hi) {
+        res = MONOID::combine(res, aggregate_internal(node->ptr[last], NULL, hi));
+    }
+    return res;
+}
+
+#ifdef BTREE_DEBUG
+#include <iostream>
+using namespace std;
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::display_internal(const node_type *cursor) const {
+    if (cursor != NULL) {
+        for (size_t i = 0; i < cursor->size; ++i) {
+            cout << cursor->keys()[i] << " ";
+        }
+        cout << endl;
+        if (!cursor->is_leaf) {
+            for (size_t i = 0; i <= cursor->size; ++i) {
+                display_internal(reinterpret_cast<const internal_node_type *>(cursor)->ptr[i]);
+            }
+        }
+    }
+}
+#endif /* BTREE_DEBUG */
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+void BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::clean_up(node_type *cursor)
+{
+    if (cursor) {
+        if (!cursor->is_leaf) {
+            for (size_t i = 0; i < cursor->size + 1; ++i) {
+                clean_up(reinterpret_cast<internal_node_type *>(cursor)->ptr[i]);
+            }
+        }
+        free_node(cursor);
+    }
+}
+
+#ifdef BTREE_VERIFY_DATA
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+K BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID>::check_invariant(const node_type *cursor) const
+{
+    if (!cursor) {
+        return K();
+    }
+    if (cursor == _root) {
+        const node_type *last = cursor;
+        while (!last->is_leaf) {
+            last = reinterpret_cast<const internal_node_type *>(last)->ptr[last->size];
+        }
+        CONTAINER_ASSERT(last == _last);
+    }
+    if (cursor->is_leaf) {
+        return cursor->keys()[cursor->size - 1];
+    }
+
+    if constexpr (augmented) {
+        internal_node_type copy = *reinterpret_cast<const internal_node_type *>(cursor);
+        for (size_t i = 0; i <= cursor->size; ++i) {
+            refresh_entry(&copy, i);
+            CONTAINER_ASSERT(copy.annotation.count[i] == reinterpret_cast<const internal_node_type *>(cursor)->annotation.count[i]);
+        }
+    }
+    for (size_t i = 0; i < cursor->size; ++i) {
+        const node_type *child = reinterpret_cast<const internal_node_type *>(cursor)->ptr[i];
+        K cur_max = check_invariant(child);
+        /* equal keys may run over the separator */
+        CONTAINER_ASSERT(!(cursor->keys()[i] < cur_max));
+    }
+    K cur_max = check_invariant(reinterpret_cast<const internal_node_type *>(cursor)->ptr[cursor->size]);
+    CONTAINER_ASSERT(!(reinterpret_cast<const internal_node_type *>(cursor)->ptr[cursor->size]->keys()[0] < cursor->keys()[cursor->size - 1]));
+    return cur_max;
+}
+#endif /* BTREE_VERIFY_DATA */
+
+#endif /* CONTAINER_BTREE_H */
@@ -0,0 +1,333 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * page cache over a local file for disk based containers, thread unsafe
+ */
+
+#ifndef CONTAINER_BPTREE_BUFFER_POOL_H
+#define CONTAINER_BPTREE_BUFFER_POOL_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../definition.h"
+
+namespace mem_container {
+/*
+ * a fixed number of frames caching pages of one file, a page is addressed by its index in the file.
+ * a pinned page stays in its frame until it is unpinned, unpinned pages are evicted by clock
+ * (second chance) and written back first if dirty.
+ * io failures throw std::system_error, running out of unpinned frames throws std::length_error.
+ * the destructor cannot report a failed final write back, call destroy() first to see it
+ */
+template <size_t PAGE_SIZE = 4096>
+class BufferPool {
+public:
+    using page_id = uint32_t;
+    constexpr static const page_id invalid_page = UINT32_MAX;
+    constexpr static const size_t page_size = PAGE_SIZE;
+    constexpr static const size_t min_frames = 4;
+
+    /* pin held by a scope, unpinned once released or destroyed */
+    class Page {
+    public:
+        Page() = default;
+        Page(BufferPool *pool, page_id id, char *data, bool dirty) : _pool(pool), _id(id), _data(data), _dirty(dirty) {}
+        Page(const Page &) = delete;
+        Page &operator=(const Page &) = delete;
+        Page(Page &&other) : _pool(other._pool), _id(other._id), _data(other._data), _dirty(other._dirty)
+        {
+            other._pool = NULL;
+        }
+        Page &operator=(Page &&other)
+        {
+            if (this != &other) {
+                release();
+                _pool = other._pool;
+                _id = other._id;
+                _data = other._data;
+                _dirty = other._dirty;
+                other._pool = NULL;
+            }
+            return *this;
+        }
+        ~Page() { release(); }
+
+        inline page_id id() const { return _id; }
+        template <typename T>
+        inline T *as() { return reinterpret_cast<T *>(_data); }
+        inline void mark_dirty() { _dirty = true; }
+        inline void release()
+        {
+            if (_pool) {
+                _pool->unpin(_id, _dirty);
+                _pool = NULL;
+            }
+        }
+    private:
+        BufferPool *_pool{NULL};
+        page_id _id{invalid_page};
+        char *_data{NULL};
+        bool _dirty{false};
+    };
+
+    /* truncate drops the content of an existing file, at least min_frames frames are kept */
+    BufferPool(const char *path, size_t nframe, bool truncate);
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+    ~BufferPool()
+    {
+#ifndef NO_DESTROYER
+        try {
+            destroy();
+        } catch (const std::exception &) {
+            /* dirty pages that could not be written are lost, the file is closed anyway */
+        }
+#endif /* NO_DESTROYER */
+    }
+
+    /* page content stays valid until the matching unpin */
+    char *pin(page_id id);
+    /* a zeroed page appended to the file */
+    char *pin_new(page_id &id);
+    void unpin(page_id id, bool dirty);
+    inline Page fetch(page_id id) { return Page(this, id, pin(id), false); }
+    inline Page allocate()
+    {
+        page_id id;
+        char *data = pin_new(id);
+        return Page(this, id, data, true);
+    }
+    /* write back every dirty page */
+    void flush();
+
+    inline size_t page_count() const { return _npage; }
+    inline size_t frames() const { return _nframe; }
+    inline size_t hits() const { return _hits; }
+    inline size_t misses() const { return _misses; }
+    inline size_t writes() const { return _writes; }
+    inline void reset_stats() { _hits = _misses = _writes = 0; }
+    /* flush and close the file, the file is closed even if the flush throws */
+    void destroy();
+    /* close the file without writing dirty pages back */
+    void discard();
+private:
+    struct Frame {
+        page_id id;
+        uint32_t pin;
+        bool dirty;
+        bool referenced;
+    };
+    int _fd{-1};
+    size_t _nframe;
+    size_t _npage{0};
+    char *_data{NULL};
+    Frame *_frames{NULL};
+    /* frame of every page, invalid_page if it is not cached */
+    page_id *_page_table{NULL};
+    size_t _table_capacity{0};
+    size_t _clock{0};
+    size_t _hits{0};
+    size_t _misses{0};
+    size_t _writes{0};
+
+    inline char *frame_data(size_t frame) { return _data + frame * PAGE_SIZE; }
+    size_t victim();
+    void reserve_table(size_t npage);
+    void read_page(page_id id, char *buf);
+    void write_page(page_id id, const char *buf);
+};
+
+template <size_t PAGE_SIZE>
+BufferPool<PAGE_SIZE>::BufferPool(const char *path, size_t nframe, bool truncate)
+    : _nframe(std::max(nframe, min_frames))
+{
+    _fd = open(path, O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+    if (_fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "open buffer pool file");
+    }
+    struct stat st;
+    if (fstat(_fd, &st) != 0) {
+        int err = errno;
+        close(_fd);
+        throw std::system_error(err, std::generic_category(), "stat buffer pool file");
+    }
+    _npage = st.st_size / PAGE_SIZE;
+    _data = (char *)container_helper::aligned_malloc(PAGE_SIZE, _nframe * PAGE_SIZE);
+    _frames = (Frame *)malloc(sizeof(Frame) * _nframe);
+    for (size_t i = 0; i < _nframe; ++i) {
+        _frames[i] = Frame{invalid_page, 0, false, false};
+    }
+    reserve_table(std::max<size_t>(_npage, 64));
+}
+
+template <size_t PAGE_SIZE>
+void BufferPool<PAGE_SIZE>::reserve_table(size_t npage)
+{
+    if (npage <= _table_capacity) {
+        return;
+    }
+    size_t capacity = std::max(npage, _table_capacity * 2);
+    /* repalloc does not take NULL */
+    if (_page_table) {
+        _page_table = (page_id *)realloc(_page_table, sizeof(page_id) * capacity);
+    } else {
+        _page_table = (page_id *)malloc(sizeof(page_id) * capacity);
+    }
+    std::fill(_page_table + _table_capacity, _page_table + capacity, invalid_page);
+    _table_capacity = capacity;
+}
+
+template <size_t PAGE_SIZE>
+void BufferPool<PAGE_SIZE>::read_page(page_id id, char *buf)
+{
+    size_t done = 0;
+    while (done < PAGE_SIZE) {
+        ssize_t n = pread(_fd, buf + done, PAGE_SIZE - done, off_t(id) * PAGE_SIZE + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::system_error(n < 0 ? errno : EIO, std::generic_category(), "read page");
+        }
+        done += n;
+    }
+}
+
+template <size_t PAGE_SIZE>
+void BufferPool<PAGE_SIZE>::write_page(page_id id, const char *buf)
+{
+    size_t done = 0;
+    while (done < PAGE_SIZE) {
+        ssize_t n = pwrite(_fd, buf + done, PAGE_SIZE - done, off_t(id) * PAGE_SIZE + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw std::system_error(errno, std::generic_category(), "write page");
+        }
+        done += n;
+    }
+    ++_writes;
+}
+
+/* clock hand sweeps at most twice, the first round clears reference bits */
+template <size_t PAGE_SIZE>
+size_t BufferPool<PAGE_SIZE>::victim()
+{
+    for (size_t step = 0; step < 2 * _nframe; ++step) {
+        size_t frame = _clock;
+        _clock = _clock + 1 == _nframe ? 0 : _clock + 1;
+        Frame &f = _frames[frame];
+        if (f.pin > 0) {
+            continue;
+        }
+        if (f.referenced) {
+            f.referenced = false;
+            continue;
+        }
+        if (f.id != invalid_page) {
+            if (f.dirty) {
+                write_page(f.id, frame_data(frame));
+            }
+            _page_table[f.id] = invalid_page;
+        }
+        f = Frame{invalid_page, 0, false, false};
+        return frame;
+    }
+    throw std::length_error("every buffer pool frame is pinned");
+}
+
+template <size_t PAGE_SIZE>
+char *BufferPool<PAGE_SIZE>::pin(page_id id)
+{
+    CONTAINER_ASSERT(id < _npage);
+    size_t frame = _page_table[id];
+    if (frame != invalid_page) {
+        ++_hits;
+    } else {
+        ++_misses;
+        frame = victim();
+        read_page(id, frame_data(frame));
+        _frames[frame].id = id;
+        _page_table[id] = page_id(frame);
+    }
+    ++_frames[frame].pin;
+    _frames[frame].referenced = true;
+    return frame_data(frame);
+}
+
+template <size_t PAGE_SIZE>
+char *BufferPool<PAGE_SIZE>::pin_new(page_id &id)
+{
+    CONTAINER_ASSERT(_npage < invalid_page);
+    size_t frame = victim();
+    id = page_id(_npage++);
+    reserve_table(_npage);
+    memset(frame_data(frame), 0, PAGE_SIZE);
+    _frames[frame] = Frame{id, 1, true, true};
+    _page_table[id] = page_id(frame);
+    return frame_data(frame);
+}
+
+template <size_t PAGE_SIZE>
+void BufferPool<PAGE_SIZE>::unpin(page_id id, bool dirty)
+{
+    Frame &f = _frames[_page_table[id]];
+    CONTAINER_ASSERT(f.id == id && f.pin > 0);
+    --f.pin;
+    f.dirty = f.dirty || dirty;
+}
+
+template <size_t PAGE_SIZE>
+void BufferPool<PAGE_SIZE>::flush()
+{
+    for (size_t i = 0; i < _nframe; ++i) {
+        if (_frames[i].id != invalid_page && _frames[i].dirty) {
+            write_page(_frames[i].id, frame_data(i));
+            _frames[i].dirty = false;
+        }
+    }
+}
+
+template <size_t PAGE_SIZE>
+void BufferPool<PAGE_SIZE>::destroy()
+{
+    if (_fd < 0) {
+        return;
+    }
+    try {
+        flush();
+    } catch (...) {
+        discard();
+        throw;
+    }
+    discard();
+}
+
+template <size_t PAGE_SIZE>
+void BufferPool<PAGE_SIZE>::discard()
+{
+    if (_fd < 0) {
+        return;
+    }
+    close(_fd);
+    _fd = -1;
+    container_helper::aligned_free(_data);
+    free(_frames);
+    free(_page_table);
+    _data = NULL;
+    _frames = NULL;
+    _page_table = NULL;
+    _table_capacity = 0;
+}
+} /* namespace mem_container */
+
+#endif /* CONTAINER_BPTREE_BUFFER_POOL_H */
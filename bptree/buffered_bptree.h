@@ -0,0 +1,499 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * write optimized B+ Tree (B-epsilon tree) with message buffers in internal nodes, thread unsafe
+ */
+
+#ifndef CONTAINER_BPTREE_BUFFERED_BPTREE_H
+#define CONTAINER_BPTREE_BUFFERED_BPTREE_H
+
+#include <optional>
+#include <algorithm>
+
+#include "../definition.h"
+#include "../vector/vector.h"
+#include "bptree.h"
+
+namespace mem_container {
+/*
+ * writes are messages (upsert or delete) appended to the buffer of the root. a full buffer is
+ * sorted and pushed one level down in a batch, a child whose buffer cannot take its share is
+ * flushed first, and messages reaching a leaf are merged into it in one pass. so a leaf is
+ * rewritten once per batch rather than once per write.
+ * messages in a node are newer than those below it, and later ones in a buffer are newer than
+ * earlier ones, lookups take the first message for the key met on the way down.
+ * leaves overflowing after a merge are cut into even pieces, empty nodes are dropped and nodes
+ * left underfull by deletes are not merged.
+ * MAX_BPTREE_NODE_SIZE is the fanout of leaves, MAX_BPTREE_INTERNAL_SIZE the one of internal
+ * nodes and BUFFER_SIZE the number of messages an internal node holds
+ */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE = 64, size_t MAX_BPTREE_INTERNAL_SIZE = 16,
+          size_t BUFFER_SIZE = 256, BPTreeSearch SEARCH = BPTreeSearch::Auto>
+class BufferedBPTree {
+public:
+    static_assert(MAX_BPTREE_NODE_SIZE >= 3 && MAX_BPTREE_INTERNAL_SIZE >= 3, "bptree node is too small to split");
+    static_assert(BUFFER_SIZE >= 1, "buffer has to hold a message");
+    constexpr static const BPTreeSearch search_strategy =
+        bptree_helper::resolve_search<SEARCH, K, std::max(MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE)>();
+    struct Message {
+        K key;
+        V value;
+        bool remove;
+    };
+    struct LeafNode;
+    struct InternalNode;
+    struct Node {
+        uint32_t size{0};
+        bool is_leaf;
+        Node(bool leaf) : is_leaf(leaf) {}
+    };
+    struct InternalNode : public Node, public BaseObject {
+        K key[MAX_BPTREE_INTERNAL_SIZE];
+        Node *ptr[MAX_BPTREE_INTERNAL_SIZE + 1];
+        size_t nmessage{0};
+        Message messages[BUFFER_SIZE];
+        InternalNode() : Node(false) {}
+
+        inline size_t child_index_of(const K &x) const
+        {
+            return bptree_helper::count_before<search_strategy, true>(key, this->size, x);
+        }
+    };
+    struct LeafNode : public Node, public BaseObject {
+        K key[MAX_BPTREE_NODE_SIZE];
+        V values[MAX_BPTREE_NODE_SIZE];
+        LeafNode *next{NULL};
+        LeafNode *prev{NULL};
+        LeafNode() : Node(true) {}
+
+        inline size_t item_index_of(const K &x) const
+        {
+            return bptree_helper::count_before<search_strategy, false>(key, this->size, x);
+        }
+    };
+    using node_type = Node;
+    using internal_node_type = InternalNode;
+    using leaf_node_type = LeafNode;
+
+    BufferedBPTree()
+    {
+        static_assert(std::is_standard_layout<K>::value && std::is_standard_layout<V>::value, "bptree only support pod types");
+        CreateMemCxt();
+    }
+    BufferedBPTree(const BufferedBPTree &) = delete;
+    BufferedBPTree &operator=(const BufferedBPTree &) = delete;
+    ~BufferedBPTree()
+    {
+#ifndef NO_DESTROYER
+        destroy();
+#endif /* NO_DESTROYER */
+    }
+
+    std::optional<V> search(const K &x) const;
+    inline bool contains(const K &x) const { return search(x).has_value(); }
+    /* insert or overwrite */
+    inline void insert(const K &x, const V &v) { put(Message{x, v, false}); }
+    /* no-op if x does not exist */
+    inline void remove(const K &x) { put(Message{x, V(), true}); }
+    /* push every pending message down to the leaves */
+    void flush();
+    /* visit keys in [lo, hi) in order as visitor(key, value), pending messages are flushed first */
+    template <typename Func>
+    size_t scan(const K &lo, const K &hi, Func &&visitor);
+    /* number of keys, pending messages are flushed first */
+    size_t size();
+    /* pending messages are flushed first */
+    inline bool empty()
+    {
+        flush();
+        return !_root;
+    }
+    void destroy()
+    {
+        clean_up(_root);
+        _root = NULL;
+        _pending = 0;
+        DestroyMemCxt();
+    }
+private:
+    /* a node of a level under construction and the lower bound of its keys, ignored for the first one */
+    struct Entry {
+        node_type *node;
+        K low;
+    };
+    using entry_list = Vector<Entry, false>;
+
+    MemCxtHolder;
+    node_type *_root{NULL};
+    /* messages not merged into leaves yet */
+    size_t _pending{0};
+
+    void put(const Message &message);
+    void flush_root(bool all);
+    void grow_root(entry_list &out);
+    void flush_node(internal_node_type *, const K &low, bool all, entry_list &out);
+    void push_down(node_type *, const K &low, const Message *messages, size_t n, bool all, entry_list &out);
+    void merge_leaf(leaf_node_type *, const K &low, const Message *messages, size_t n, entry_list &out);
+    void build_parents(entry_list &children, size_t begin, size_t end, internal_node_type *reuse, const K &low, entry_list &out);
+    void clean_up(node_type *);
+    /* a chain of single children without messages down to an empty leaf */
+    static inline bool empty_subtree(const node_type *node)
+    {
+        while (!node->is_leaf) {
+            const internal_node_type *internal = static_cast<const internal_node_type *>(node);
+            if (internal->size > 0 || internal->nmessage > 0) {
+                return false;
+            }
+            node = internal->ptr[0];
+        }
+        return node->size == 0;
+    }
+    void drop_empty(node_type *node)
+    {
+        while (!node->is_leaf) {
+            node_type *child = static_cast<internal_node_type *>(node)->ptr[0];
+            free_node(node);
+            node = child;
+        }
+        leaf_node_type *leaf = static_cast<leaf_node_type *>(node);
+        if (leaf->prev) {
+            leaf->prev->next = leaf->next;
+        }
+        if (leaf->next) {
+            leaf->next->prev = leaf->prev;
+        }
+        free_node(leaf);
+    }
+
+    inline leaf_node_type *new_leaf() { return NEW leaf_node_type(); }
+    inline internal_node_type *new_internal() { return NEW internal_node_type(); }
+    inline void free_node(node_type *node)
+    {
+        if (node->is_leaf) {
+            delete static_cast<leaf_node_type *>(node);
+        } else {
+            delete static_cast<internal_node_type *>(node);
+        }
+    }
+};
+} /* namespace mem_container */
+
+/* place for implementation */
+
+using namespace mem_container;
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+std::optional<V> BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::search(const K &x) const
+{
+    const node_type *cursor = _root;
+    if (!cursor) {
+        return std::nullopt;
+    }
+    while (!cursor->is_leaf) {
+        const internal_node_type *node = static_cast<const internal_node_type *>(cursor);
+        for (size_t i = node->nmessage; i > 0; --i) {
+            const Message &message = node->messages[i - 1];
+            if (message.key == x) {
+                return message.remove ? std::nullopt : std::optional<V>(message.value);
+            }
+        }
+        cursor = node->ptr[node->child_index_of(x)];
+    }
+    const leaf_node_type *leaf = static_cast<const leaf_node_type *>(cursor);
+    size_t i = leaf->item_index_of(x);
+    if (i < leaf->size && leaf->key[i] == x) {
+        return leaf->values[i];
+    }
+    return std::nullopt;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+void BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::put(const Message &message)
+{
+    if (!_root) {
+        if (message.remove) {
+            return;
+        }
+        leaf_node_type *leaf = new_leaf();
+        leaf->key[0] = message.key;
+        leaf->values[0] = message.value;
+        leaf->size = 1;
+        _root = leaf;
+        return;
+    }
+    if (_root->is_leaf) {
+        /* nothing to buffer in, the root leaf takes the write directly */
+        entry_list out;
+        ++_pending;
+        merge_leaf(static_cast<leaf_node_type *>(_root), message.key, &message, 1, out);
+        grow_root(out);
+        return;
+    }
+    internal_node_type *root = static_cast<internal_node_type *>(_root);
+    root->messages[root->nmessage++] = message;
+    ++_pending;
+    if (root->nmessage == BUFFER_SIZE) {
+        flush_root(false);
+    }
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+void BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::flush_root(bool all)
+{
+    if (!_root || _root->is_leaf) {
+        return;
+    }
+    entry_list out;
+    flush_node(static_cast<internal_node_type *>(_root), K(), all, out);
+    grow_root(out);
+}
+
+/* the pieces the root came back as get new parents until a single root is left */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+void BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::grow_root(entry_list &out)
+{
+    entry_list parents;
+    while (out.size() > 1) {
+        build_parents(out, 0, out.size(), NULL, out[0].low, parents);
+        out.swap(parents);
+        parents.clear();
+    }
+    _root = out[0].node;
+    out.destroy();
+    parents.destroy();
+    /* a root with a single child and no pending message is replaced by the child */
+    while (!_root->is_leaf && _root->size == 0 && static_cast<internal_node_type *>(_root)->nmessage == 0) {
+        node_type *child = static_cast<internal_node_type *>(_root)->ptr[0];
+        free_node(_root);
+        _root = child;
+    }
+    if (empty_subtree(_root)) {
+        drop_empty(_root);
+        _root = NULL;
+    }
+}
+
+/* every message of node goes one level down, node comes back as the pieces appended to out */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+void BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::flush_node(internal_node_type *node, const K &low, bool all, entry_list &out)
+{
+    /* sorted by key with the newest message of every key kept */
+    Message *messages = node->messages;
+    std::stable_sort(messages, messages + node->nmessage, [](const Message &a, const Message &b) { return a.key < b.key; });
+    size_t n = 0;
+    for (size_t i = 0; i < node->nmessage; ++i) {
+        if (n > 0 && messages[n - 1].key == messages[i].key) {
+            messages[n - 1] = messages[i];
+        } else {
+            messages[n++] = messages[i];
+        }
+    }
+    _pending -= node->nmessage - n;
+
+    entry_list children;
+    size_t begin = 0;
+    for (size_t i = 0; i <= node->size; ++i) {
+        size_t end = n;
+        if (i < node->size) {
+            end = std::lower_bound(messages + begin, messages + n, node->key[i],
+                                   [](const Message &a, const K &k) { return a.key < k; }) - messages;
+        }
+        const K &child_low = i == 0 ? low : node->key[i - 1];
+        if (begin == end && !(all && !node->ptr[i]->is_leaf)) {
+            children.push_back(Entry{node->ptr[i], child_low});
+        } else {
+            push_down(node->ptr[i], child_low, messages + begin, end - begin, all, children);
+        }
+        begin = end;
+    }
+    node->nmessage = 0;
+    /* empty subtrees are dropped, but one is kept if nothing else is left so that the node stays */
+    size_t nchild = 0;
+    for (size_t i = 0; i < children.size(); ++i) {
+        if (!empty_subtree(children[i].node) || (nchild == 0 && i + 1 == children.size())) {
+            children[nchild++] = children[i];
+        } else {
+            drop_empty(children[i].node);
+        }
+    }
+    build_parents(children, 0, nchild, node, low, out);
+    children.destroy();
+}
+
+/* n sorted messages with distinct keys go into node, which comes back as the pieces appended to out */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+void BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::push_down(node_type *cursor, const K &low, const Message *messages, size_t n, bool all, entry_list &out)
+{
+    if (cursor->is_leaf) {
+        merge_leaf(static_cast<leaf_node_type *>(cursor), low, messages, n, out);
+        return;
+    }
+    internal_node_type *node = static_cast<internal_node_type *>(cursor);
+    if (node->nmessage + n <= BUFFER_SIZE) {
+        memcpy(node->messages + node->nmessage, messages, sizeof(Message) * n);
+        node->nmessage += n;
+        if (all) {
+            flush_node(node, low, all, out);
+        } else {
+            out.push_back(Entry{node, low});
+        }
+        return;
+    }
+    /* no room, the node is emptied first and the messages are spread over its pieces */
+    entry_list pieces;
+    flush_node(node, low, all, pieces);
+    size_t begin = 0;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        size_t end = n;
+        if (i + 1 < pieces.size()) {
+            end = begin;
+            while (end < n && messages[end].key < pieces[i + 1].low) {
+                ++end;
+            }
+        }
+        push_down(pieces[i].node, i == 0 ? low : pieces[i].low, messages + begin, end - begin, all, out);
+        begin = end;
+    }
+    pieces.destroy();
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+void BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::merge_leaf(leaf_node_type *leaf, const K &low, const Message *messages, size_t n, entry_list &out)
+{
+    constexpr size_t capacity = MAX_BPTREE_NODE_SIZE + BUFFER_SIZE;
+    K keys[capacity];
+    V values[capacity];
+    size_t m = 0;
+    size_t i = 0;
+    for (size_t j = 0; j < n; ++j) {
+        while (i < leaf->size && leaf->key[i] < messages[j].key) {
+            keys[m] = leaf->key[i];
+            values[m++] = leaf->values[i++];
+        }
+        if (i < leaf->size && leaf->key[i] == messages[j].key) {
+            ++i;
+        }
+        if (!messages[j].remove) {
+            keys[m] = messages[j].key;
+            values[m++] = messages[j].value;
+        }
+    }
+    memcpy(keys + m, leaf->key + i, sizeof(K) * (leaf->size - i));
+    memcpy(values + m, leaf->values + i, sizeof(V) * (leaf->size - i));
+    m += leaf->size - i;
+
+    _pending -= n;
+
+    /* the leaf keeps the first piece so that its neighbours stay linked, it is left empty if nothing remains */
+    size_t npiece = std::max<size_t>((m + MAX_BPTREE_NODE_SIZE - 1) / MAX_BPTREE_NODE_SIZE, 1);
+    leaf_node_type *piece = leaf;
+    for (size_t p = 0, pos = 0; p < npiece; ++p) {
+        if (p > 0) {
+            leaf_node_type *next = new_leaf();
+            next->next = piece->next;
+            next->prev = piece;
+            if (piece->next) {
+                piece->next->prev = next;
+            }
+            piece->next = next;
+            piece = next;
+        }
+        piece->size = m / npiece + (p < m % npiece);
+        memcpy(piece->key, keys + pos, sizeof(K) * piece->size);
+        memcpy(piece->values, values + pos, sizeof(V) * piece->size);
+        pos += piece->size;
+        out.push_back(Entry{piece, p == 0 ? low : piece->key[0]});
+    }
+}
+
+/* spread children[begin, end) evenly over as few internal nodes as possible, reuse is taken as the first */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+void BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::build_parents(entry_list &children, size_t begin, size_t end, internal_node_type *reuse, const K &low, entry_list &out)
+{
+    size_t nchild = end - begin;
+    size_t nparent = (nchild + MAX_BPTREE_INTERNAL_SIZE) / (MAX_BPTREE_INTERNAL_SIZE + 1);
+    for (size_t p = 0, pos = begin; p < nparent; ++p) {
+        internal_node_type *parent = p == 0 && reuse ? reuse : new_internal();
+        size_t count = nchild / nparent + (p < nchild % nparent);
+        parent->size = count - 1;
+        for (size_t i = 0; i < count; ++i) {
+            parent->ptr[i] = children[pos + i].node;
+            if (i > 0) {
+                parent->key[i - 1] = children[pos + i].low;
+            }
+        }
+        out.push_back(Entry{parent, p == 0 ? low : children[pos].low});
+        pos += count;
+    }
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+void BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::flush()
+{
+    if (_pending > 0) {
+        flush_root(true);
+    }
+    CONTAINER_ASSERT(_pending == 0);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+template <typename Func>
+size_t BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::scan(const K &lo, const K &hi, Func &&visitor)
+{
+    flush();
+    if (!_root || !(lo < hi)) {
+        return 0;
+    }
+    node_type *cursor = _root;
+    while (!cursor->is_leaf) {
+        internal_node_type *node = static_cast<internal_node_type *>(cursor);
+        cursor = node->ptr[node->child_index_of(lo)];
+    }
+    leaf_node_type *leaf = static_cast<leaf_node_type *>(cursor);
+    size_t res = 0;
+    for (size_t i = leaf->item_index_of(lo); leaf; leaf = leaf->next, i = 0) {
+        for (; i < leaf->size; ++i) {
+            if (!(leaf->key[i] < hi)) {
+                return res;
+            }
+            ++res;
+            if (!visitor((const K &)leaf->key[i], leaf->values[i])) {
+                return res;
+            }
+        }
+    }
+    return res;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+size_t BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::size()
+{
+    flush();
+    node_type *cursor = _root;
+    if (!cursor) {
+        return 0;
+    }
+    while (!cursor->is_leaf) {
+        cursor = static_cast<internal_node_type *>(cursor)->ptr[0];
+    }
+    size_t res = 0;
+    for (leaf_node_type *leaf = static_cast<leaf_node_type *>(cursor); leaf; leaf = leaf->next) {
+        res += leaf->size;
+    }
+    return res;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, size_t MAX_BPTREE_INTERNAL_SIZE, size_t BUFFER_SIZE, BPTreeSearch SEARCH>
+void BufferedBPTree<K, V, MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE, BUFFER_SIZE, SEARCH>::clean_up(node_type *cursor)
+{
+    if (!cursor) {
+        return;
+    }
+    if (!cursor->is_leaf) {
+        for (size_t i = 0; i <= cursor->size; ++i) {
+            clean_up(static_cast<internal_node_type *>(cursor)->ptr[i]);
+        }
+    }
+    free_node(cursor);
+}
+
+#endif /* CONTAINER_BPTREE_BUFFERED_BPTREE_H */
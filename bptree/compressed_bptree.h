@@ -0,0 +1,509 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * B+ Tree with compressed leaves, frame of reference for integer keys and prefix truncation for byte keys, thread unsafe
+ */
+
+#ifndef CONTAINER_BPTREE_COMPRESSED_BPTREE_H
+#define CONTAINER_BPTREE_COMPRESSED_BPTREE_H
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include "../definition.h"
+#include "bptree.h"
+
+namespace mem_container {
+/*
+ * key codecs for compressed leaves. a leaf keeps a reference key, its smallest key when the leaf
+ * was encoded, and stores every key in the same number of bytes (width) against it. a codec provides
+ *     constexpr static size_t max_width;
+ *     static size_t width(const K &lo, const K &hi);     bytes per key for keys in [lo, hi], at least 1
+ *     static bool fits(const K &ref, size_t width, const K &x);
+ *     static void encode(const K &ref, size_t width, const K &x, uint8_t *out);
+ *     static K decode(const K &ref, size_t width, const uint8_t *in);
+ *     static size_t count_before(const K &ref, size_t width, const uint8_t *keys, size_t n, const K &x);
+ * count_before is the number of encoded keys less than x and works on the encoded keys only
+ */
+
+/* frame of reference, the distance to the reference key in 1, 2, 4 or 8 bytes */
+template <typename K>
+struct DeltaKeyCodec {
+    static_assert(std::is_integral<K>::value, "frame of reference needs integer keys");
+    using U = std::make_unsigned_t<K>;
+    constexpr static const size_t max_width = sizeof(K);
+
+    static inline size_t width(const K &lo, const K &hi)
+    {
+        uint64_t delta = uint64_t(U(U(hi) - U(lo)));
+        size_t res = delta <= UINT8_MAX ? 1 : delta <= UINT16_MAX ? 2 : delta <= UINT32_MAX ? 4 : 8;
+        return std::min(res, max_width);
+    }
+    static inline bool fits(const K &ref, size_t width, const K &x) { return !(x < ref) && DeltaKeyCodec::width(ref, x) <= width; }
+    static inline void encode(const K &ref, size_t width, const K &x, uint8_t *out)
+    {
+        U delta = U(x) - U(ref);
+        switch (width) {
+        case 1: store<uint8_t>(out, delta); break;
+        case 2: store<uint16_t>(out, delta); break;
+        case 4: store<uint32_t>(out, delta); break;
+        default: store<uint64_t>(out, delta); break;
+        }
+    }
+    static inline K decode(const K &ref, size_t width, const uint8_t *in)
+    {
+        switch (width) {
+        case 1: return K(U(ref) + U(load<uint8_t>(in)));
+        case 2: return K(U(ref) + U(load<uint16_t>(in)));
+        case 4: return K(U(ref) + U(load<uint32_t>(in)));
+        default: return K(U(ref) + U(load<uint64_t>(in)));
+        }
+    }
+    static inline size_t count_before(const K &ref, size_t width, const uint8_t *keys, size_t n, const K &x)
+    {
+        if (!(ref < x)) {
+            return 0;
+        }
+        uint64_t delta = uint64_t(U(U(x) - U(ref)));
+        switch (width) {
+        case 1: return delta > UINT8_MAX ? n : search<uint8_t>(keys, n, delta);
+        case 2: return delta > UINT16_MAX ? n : search<uint16_t>(keys, n, delta);
+        case 4: return delta > UINT32_MAX ? n : search<uint32_t>(keys, n, delta);
+        default: return search<uint64_t>(keys, n, delta);
+        }
+    }
+private:
+    template <typename T>
+    static inline void store(uint8_t *out, U delta) { *reinterpret_cast<T *>(out) = T(delta); }
+    template <typename T>
+    static inline T load(const uint8_t *in) { return *reinterpret_cast<const T *>(in); }
+    /* keys of one width are an aligned array of unsigned integers, so the usual intra-node search applies */
+    template <typename T>
+    static inline size_t search(const uint8_t *keys, size_t n, uint64_t delta)
+    {
+        constexpr BPTreeSearch strategy = bptree_helper::resolve_search<BPTreeSearch::Auto, T, 32>();
+        return bptree_helper::count_before<strategy, false>(reinterpret_cast<const T *>(keys), n, T(delta));
+    }
+};
+
+/* prefix truncation for fixed width byte strings such as FixedBytes, the bytes after the common prefix */
+template <typename K>
+struct PrefixKeyCodec {
+    constexpr static const size_t max_width = K::size();
+
+    static inline size_t width(const K &lo, const K &hi)
+    {
+        size_t prefix = 0;
+        while (prefix + 1 < max_width && lo.data[prefix] == hi.data[prefix]) {
+            ++prefix;
+        }
+        return max_width - prefix;
+    }
+    static inline bool fits(const K &ref, size_t width, const K &x) { return memcmp(ref.data, x.data, max_width - width) == 0; }
+    static inline void encode(const K &, size_t width, const K &x, uint8_t *out) { memcpy(out, x.data + max_width - width, width); }
+    static inline K decode(const K &ref, size_t width, const uint8_t *in)
+    {
+        K res = ref;
+        memcpy(res.data + max_width - width, in, width);
+        return res;
+    }
+    static inline size_t count_before(const K &ref, size_t width, const uint8_t *keys, size_t n, const K &x)
+    {
+        /* the prefix decides for the whole leaf unless x shares it */
+        int cmp = memcmp(x.data, ref.data, max_width - width);
+        if (cmp != 0) {
+            return cmp < 0 ? 0 : n;
+        }
+        const uint8_t *suffix = x.data + max_width - width;
+        size_t lo = 0;
+        while (n > 0) {
+            size_t half = n / 2;
+            if (memcmp(keys + (lo + half) * width, suffix, width) < 0) {
+                lo += half + 1;
+                n -= half + 1;
+            } else {
+                n = half;
+            }
+        }
+        return lo;
+    }
+};
+
+namespace bptree_helper {
+template <typename K, typename = void>
+struct default_key_codec { using type = PrefixKeyCodec<K>; };
+template <typename K>
+struct default_key_codec<K, std::enable_if_t<std::is_integral<K>::value>> { using type = DeltaKeyCodec<K>; };
+} /* namespace bptree_helper */
+
+/*
+ * leaves are LEAF_BYTES long and hold as many keys as fit in the width their key range needs,
+ * so a leaf of close keys takes several times the keys of a plain one. lookups search the
+ * encoded keys directly, only the key found is decoded to check for a match.
+ * a leaf is re-encoded when a key falls out of its width or below its reference, and cut into
+ * as few even pieces as fit when it overflows. leaves left under a quarter full by removes are
+ * merged into a neighbour when the union fits.
+ * the index above the leaves is a BPTree from the smallest key routed to each leaf (its fence)
+ * to the leaf. V has to be trivially copyable
+ */
+template <typename K, typename V, size_t LEAF_BYTES = 256, typename CODEC = typename bptree_helper::default_key_codec<K>::type>
+class CompressedBPTree {
+public:
+    struct LeafHeader {
+        uint16_t size{0};
+        uint16_t width{1};
+        LeafHeader *next{NULL};
+        LeafHeader *prev{NULL};
+        K ref;
+    };
+    constexpr static const size_t header_bytes = (sizeof(LeafHeader) + 7) / 8 * 8;
+    constexpr static const size_t data_bytes = LEAF_BYTES - header_bytes;
+    struct alignas(bptree_helper::cache_line_size) LeafNode : public LeafHeader, public BaseObject {
+        alignas(8) uint8_t data[data_bytes];
+    };
+    using leaf_node_type = LeafNode;
+    using index_type = BPTree<K, leaf_node_type *>;
+
+    /* values of a leaf follow the keys of a full leaf of the same width */
+    constexpr static size_t values_offset(size_t n, size_t width) { return (n * width + alignof(V) - 1) / alignof(V) * alignof(V); }
+    /* keys a leaf holds at a width */
+    constexpr static size_t capacity(size_t width)
+    {
+        size_t n = data_bytes / (width + sizeof(V));
+        while (n > 0 && values_offset(n, width) + n * sizeof(V) > data_bytes) {
+            --n;
+        }
+        return std::min<size_t>(n, UINT16_MAX);
+    }
+    constexpr static const size_t max_leaf_size = capacity(1);
+    static_assert(LEAF_BYTES % bptree_helper::cache_line_size == 0 && LEAF_BYTES > header_bytes, "leaf is not a number of cache lines");
+    static_assert(capacity(CODEC::max_width) >= 2, "leaf is too small to split");
+    static_assert(sizeof(LeafNode) == LEAF_BYTES, "leaf header is padded");
+
+    CompressedBPTree() = default;
+    CompressedBPTree(const CompressedBPTree &) = delete;
+    CompressedBPTree &operator=(const CompressedBPTree &) = delete;
+    ~CompressedBPTree()
+    {
+#ifndef NO_DESTROYER
+        destroy();
+#endif /* NO_DESTROYER */
+    }
+
+    /* false if x exists, its value is kept */
+    bool insert(const K &x, const V &v);
+    bool remove(const K &x);
+    V *search(const K &x);
+    inline const V *search(const K &x) const { return const_cast<CompressedBPTree *>(this)->search(x); }
+    inline bool contains(const K &x) const { return search(x) != NULL; }
+    /* replace the content with n strictly ascending keys, leaves are packed as full as they get */
+    void bulk_load(const K *keys, const V *values, size_t n);
+    /* visit keys in [lo, hi) in order as visitor(key, value), stop once visitor returns false, returns the number visited */
+    template <typename Func>
+    size_t scan(const K &lo, const K &hi, Func &&visitor) const;
+    inline size_t size() const { return _size; }
+    inline bool empty() const { return _size == 0; }
+    inline size_t leaves() const { return _nleaf; }
+    /* bytes of leaves, the index holds one entry per leaf on top */
+    inline size_t memory_usage() const { return _nleaf * sizeof(LeafNode); }
+    void destroy()
+    {
+        for (leaf_node_type *leaf = _first; leaf;) {
+            leaf_node_type *next = next_of(leaf);
+            delete leaf;
+            leaf = next;
+        }
+        _index.destroy();
+        _first = NULL;
+        _size = 0;
+        _nleaf = 0;
+    }
+private:
+    index_type _index;
+    leaf_node_type *_first{NULL};
+    size_t _size{0};
+    size_t _nleaf{0};
+
+    static inline leaf_node_type *next_of(const leaf_node_type *leaf) { return static_cast<leaf_node_type *>(leaf->next); }
+    static inline leaf_node_type *prev_of(const leaf_node_type *leaf) { return static_cast<leaf_node_type *>(leaf->prev); }
+    static inline V *values_of(leaf_node_type *leaf)
+    {
+        return reinterpret_cast<V *>(leaf->data + values_offset(capacity(leaf->width), leaf->width));
+    }
+    static inline const V *values_of(const leaf_node_type *leaf) { return values_of(const_cast<leaf_node_type *>(leaf)); }
+    static inline K key_at(const leaf_node_type *leaf, size_t i) { return CODEC::decode(leaf->ref, leaf->width, leaf->data + i * leaf->width); }
+    /* first key of the leaf not less than x */
+    static inline size_t lower_bound(const leaf_node_type *leaf, const K &x)
+    {
+        return CODEC::count_before(leaf->ref, leaf->width, leaf->data, leaf->size, x);
+    }
+    /* whether n keys starting at keys fit a leaf */
+    static inline bool fit(const K *keys, size_t n) { return n <= capacity(CODEC::width(keys[0], keys[n - 1])); }
+    static void encode(leaf_node_type *leaf, const K *keys, const V *values, size_t n);
+    static size_t decode(const leaf_node_type *leaf, K *keys, V *values);
+    /* leaf that x is routed to, end if x is below every fence */
+    inline typename index_type::iterator locate(const K &x) { return _index.find_left(x); }
+    /* put n sorted keys into leaf and as many leaves after it as needed */
+    void rebuild(leaf_node_type *leaf, const K *keys, const V *values, size_t n);
+    /* left takes every key of right, which is dropped */
+    void merge(leaf_node_type *left, leaf_node_type *right);
+    void unlink(leaf_node_type *leaf);
+};
+} /* namespace mem_container */
+
+/* place for implementation */
+
+using namespace mem_container;
+
+template <typename K, typename V, size_t LEAF_BYTES, typename CODEC>
+void CompressedBPTree<K, V, LEAF_BYTES, CODEC>::encode(leaf_node_type *leaf, const K *keys, const V *values, size_t n)
+{
+    CONTAINER_ASSERT(n > 0 && fit(keys, n));
+    leaf->ref = keys[0];
+    leaf->width = uint16_t(CODEC::width(keys[0], keys[n - 1]));
+    leaf->size = uint16_t(n);
+    for (size_t i = 0; i < n; ++i) {
+        CODEC::encode(leaf->ref, leaf->width, keys[i], leaf->data + i * leaf->width);
+    }
+    memcpy(values_of(leaf), values, sizeof(V) * n);
+}
+
+template <typename K, typename V, size_t LEAF_BYTES, typename CODEC>
+size_t CompressedBPTree<K, V, LEAF_BYTES, CODEC>::decode(const leaf_node_type *leaf, K *keys, V *values)
+{
+    for (size_t i = 0; i < leaf->size; ++i) {
+        keys[i] = key_at(leaf, i);
+    }
+    memcpy(values, values_of(leaf), sizeof(V) * leaf->size);
+    return leaf->size;
+}
+
+template <typename K, typename V, size_t LEAF_BYTES, typename CODEC>
+void CompressedBPTree<K, V, LEAF_BYTES, CODEC>::rebuild(leaf_node_type *leaf, const K *keys, const V *values, size_t n)
+{
+    /* fewest even pieces that fit, a single key always does */
+    auto fit_pieces = [keys, n](size_t pieces) {
+        for (size_t i = 0; i < pieces; ++i) {
+            size_t begin = n * i / pieces;
+            if (!fit(keys + begin, n * (i + 1) / pieces - begin)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    size_t pieces = 1;
+    while (!fit_pieces(pieces)) {
+        ++pieces;
+    }
+    encode(leaf, keys, values, n / pieces);
+    for (size_t i = 1; i < pieces; ++i) {
+        size_t begin = n * i / pieces;
+        leaf_node_type *piece = NEW leaf_node_type();
+        encode(piece, keys + begin, values + begin, n * (i + 1) / pieces - begin);
+        piece->prev = leaf;
+        piece->next = leaf->next;
+        if (leaf->next) {
+            leaf->next->prev = piece;
+        }
+        leaf->next = piece;
+        _index.insert(keys[begin], piece);
+        ++_nleaf;
+        leaf = piece;
+    }
+}
+
+template <typename K, typename V, size_t LEAF_BYTES, typename CODEC>
+void CompressedBPTree<K, V, LEAF_BYTES, CODEC>::unlink(leaf_node_type *leaf)
+{
+    if (leaf->prev) {
+        leaf->prev->next = leaf->next;
+    } else {
+        _first = next_of(leaf);
+    }
+    if (leaf->next) {
+        leaf->next->prev = leaf->prev;
+    }
+    delete leaf;
+    --_nleaf;
+}
+
+template <typename K, typename V, size_t LEAF_BYTES, typename CODEC>
+void CompressedBPTree<K, V, LEAF_BYTES, CODEC>::merge(leaf_node_type *left, leaf_node_type *right)
+{
+    K keys[2 * max_leaf_size];
+    V values[2 * max_leaf_size];
+    size_t n = decode(left, keys, values);
+    n += decode(right, keys + n, values + n);
+    encode(left, keys, values, n);
+    /* the fence of right is the last one not above its first key */
+    auto it = locate(keys[n - right->size]);
+    CONTAINER_ASSERT(*it == right);
+    _index.remove(it);
+    unlink(right);
+}
+
+template <typename K, typename V, size_t LEAF_BYTES, typename CODEC>
+bool CompressedBPTree<K, V, LEAF_BYTES, CODEC>::insert(const K &x, const V &v)
+{
+    if (!_first) {
+        _first = NEW leaf_node_type();
+        encode(_first, &x, &v, 1);
+        _index.insert(x, _first);
+        _size = 1;
+        _nleaf = 1;
+        return true;
+    }
+    auto it = locate(x);
+    leaf_node_type *leaf;
+    if (it == _index.end()) {
+        /* below every key, the fence of the first leaf moves down to x */
+        leaf = _first;
+        _index.remove(_index.begin());
+        _index.insert(x, leaf);
+    } else {
+        leaf = *it;
+    }
+    size_t i = lower_bound(leaf, x);
+    if (i < leaf->size && key_at(leaf, i) == x) {
+        return false;
+    }
+    ++_size;
+    if (leaf->size < capacity(leaf->width) && CODEC::fits(leaf->ref, leaf->width, x)) {
+        size_t width = leaf->width;
+        memmove(leaf->data + (i + 1) * width, leaf->data + i * width, (leaf->size - i) * width);
+        CODEC::encode(leaf->ref, width, x, leaf->data + i * width);
+        V *values = values_of(leaf);
+        memmove(values + i + 1, values + i, sizeof(V) * (leaf->size - i));
+        values[i] = v;
+        ++leaf->size;
+        return true;
+    }
+    K keys[max_leaf_size + 1];
+    V values[max_leaf_size + 1];
+    size_t n = decode(leaf, keys, values);
+    memmove(keys + i + 1, keys + i, sizeof(K) * (n - i));
+    memmove(values + i + 1, values + i, sizeof(V) * (n - i));
+    keys[i] = x;
+    values[i] = v;
+    rebuild(leaf, keys, values, n + 1);
+    return true;
+}
+
+template <typename K, typename V, size_t LEAF_BYTES, typename CODEC>
+bool CompressedBPTree<K, V, LEAF_BYTES, CODEC>::remove(const K &x)
+{
+    auto it = locate(x);
+    if (it == _index.end()) {
+        return false;
+    }
+    leaf_node_type *leaf = *it;
+    size_t i = lower_bound(leaf, x);
+    if (i == leaf->size || !(key_at(leaf, i) == x)) {
+        return false;
+    }
+    /* the keys left still fit the width and lie above the reference key */
+    size_t width = leaf->width;
+    memmove(leaf->data + i * width, leaf->data + (i + 1) * width, (leaf->size - i - 1) * width);
+    V *values = values_of(leaf);
+    memmove(values + i, values + i + 1, sizeof(V) * (leaf->size - i - 1));
+    --leaf->size;
+    --_size;
+    if (leaf->size == 0) {
+        _index.remove(it);
+        unlink(leaf);
+        return true;
+    }
+    if (leaf->size >= capacity(leaf->width) / 4) {
+        return true;
+    }
+    leaf_node_type *next = next_of(leaf);
+    leaf_node_type *prev = prev_of(leaf);
+    if (next && leaf->size + next->size <= max_leaf_size) {
+        K bounds[2] = {key_at(leaf, 0), key_at(next, next->size - 1)};
+        if (leaf->size + next->size <= capacity(CODEC::width(bounds[0], bounds[1]))) {
+            merge(leaf, next);
+            return true;
+        }
+    }
+    if (prev && prev->size + leaf->size <= max_leaf_size) {
+        K bounds[2] = {key_at(prev, 0), key_at(leaf, leaf->size - 1)};
+        if (prev->size + leaf->size <= capacity(CODEC::width(bounds[0], bounds[1]))) {
+            merge(prev, leaf);
+        }
+    }
+    return true;
+}
+
+template <typename K, typename V, size_t LEAF_BYTES, typename CODEC>
+V *CompressedBPTree<K, V, LEAF_BYTES, CODEC>::search(const K &x)
+{
+    auto it = locate(x);
+    if (it == _index.end()) {
+        return NULL;
+    }
+    leaf_node_type *leaf = *it;
+    size_t i = lower_bound(leaf, x);
+    return i < leaf->size && key_at(leaf, i) == x ? &values_of(leaf)[i] : NULL;
+}
+
+template <typename K, typename V, size_t LEAF_BYTES, typename CODEC>
+void CompressedBPTree<K, V, LEAF_BYTES, CODEC>::bulk_load(const K *keys, const V *values, size_t n)
+{
+    destroy();
+    if (n == 0) {
+        return;
+    }
+    _size = n;
+    /* a longer run only widens the keys, so the first key that does not fit ends the leaf */
+    K *fences = (K *)malloc(sizeof(K) * n);
+    leaf_node_type **leaves = (leaf_node_type **)malloc(sizeof(leaf_node_type *) * n);
+    leaf_node_type *prev = NULL;
+    for (size_t begin = 0, end = 1; begin < n; begin = end++) {
+        while (end < n && fit(keys + begin, end - begin + 1)) {
+            ++end;
+        }
+        leaf_node_type *leaf = NEW leaf_node_type();
+        encode(leaf, keys + begin, values + begin, end - begin);
+        leaf->prev = prev;
+        if (prev) {
+            prev->next = leaf;
+        } else {
+            _first = leaf;
+        }
+        prev = leaf;
+        fences[_nleaf] = keys[begin];
+        leaves[_nleaf++] = leaf;
+    }
+    _index.bulk_load(fences, leaves, _nleaf);
+    free(fences);
+    free(leaves);
+}
+
+template <typename K, typename V, size_t LEAF_BYTES, typename CODEC>
+template <typename Func>
+size_t CompressedBPTree<K, V, LEAF_BYTES, CODEC>::scan(const K &lo, const K &hi, Func &&visitor) const
+{
+    if (!_first || !(lo < hi)) {
+        return 0;
+    }
+    auto it = _index.cfind_left(lo);
+    const leaf_node_type *leaf = it == _index.cend() ? _first : *it;
+    size_t res = 0;
+    for (size_t i = lower_bound(leaf, lo); leaf; leaf = next_of(leaf), i = 0) {
+        const V *values = values_of(leaf);
+        for (; i < leaf->size; ++i) {
+            K key = key_at(leaf, i);
+            if (!(key < hi)) {
+                return res;
+            }
+            ++res;
+            if (!visitor((const K &)key, values[i])) {
+                return res;
+            }
+        }
+    }
+    return res;
+}
+
+#endif /* CONTAINER_BPTREE_COMPRESSED_BPTREE_H */
@@ -0,0 +1,601 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * Thread safe B+ Tree with optimistic lock coupling, values are copied out on search
+ */
+
+#ifndef CONTAINER_BPTREE_CONCURRENT_BPTREE_H
+#define CONTAINER_BPTREE_CONCURRENT_BPTREE_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <optional>
+#include <functional>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif /* __SSE2__ */
+
+#include "../definition.h"
+#include "../vector/vector.h"
+#include "bptree.h"
+
+namespace mem_container {
+namespace bptree_helper {
+/* spin a few rounds before giving the cpu away, the lock holder may be preempted */
+inline void backoff(size_t attempt)
+{
+    if (attempt < 16) {
+#if defined(__SSE2__)
+        _mm_pause();
+#endif /* __SSE2__ */
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+/* epoch slot a thread tried last, threads start apart from each other */
+inline size_t &epoch_slot_hint()
+{
+    static thread_local size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return hint;
+}
+} /* namespace bptree_helper */
+
+/*
+ * every node carries a version word. readers descend without writing shared memory and
+ * restart once a version they read has changed, writers upgrade the versions of the nodes
+ * they modify into exclusive locks and never wait while holding one.
+ * full nodes are split on the way down so a split never propagates upward. a leaf is merged
+ * into its sibling when both fit in one node, internal nodes are left to shrink and a root
+ * with a single child is collapsed.
+ * unlinked nodes are marked obsolete and retired, they are freed once every operation that
+ * started before the unlink has finished (epoch based reclamation).
+ * at most max_threads operations run at once, more threads wait for a free epoch slot
+ */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE = 16, BPTreeSearch SEARCH = BPTreeSearch::Auto,
+          size_t MAX_BPTREE_INTERNAL_SIZE = MAX_BPTREE_NODE_SIZE>
+class ConcurrentBPTree : public BaseObject {
+public:
+    static_assert(MAX_BPTREE_NODE_SIZE >= 3 && MAX_BPTREE_INTERNAL_SIZE >= 3, "bptree node is too small to split");
+    constexpr static const BPTreeSearch search_strategy =
+        bptree_helper::resolve_search<SEARCH, K, std::max(MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE)>();
+    constexpr static const size_t max_threads = 64;
+    constexpr static const size_t reclaim_batch = 64;
+    struct LeafNode;
+    struct InternalNode;
+    struct Node {
+        constexpr static const uint64_t obsolete_bit = 1;
+        constexpr static const uint64_t locked_bit = 2;
+        std::atomic<uint64_t> version{0};
+        uint32_t size{0};
+        bool is_leaf;
+        Node(bool leaf) : is_leaf(leaf) {}
+
+        inline K *keys() { return is_leaf ? static_cast<LeafNode *>(this)->key : static_cast<InternalNode *>(this)->key; }
+        inline const K *keys() const
+        {
+            return is_leaf ? static_cast<const LeafNode *>(this)->key : static_cast<const InternalNode *>(this)->key;
+        }
+        /* size clamped to the capacity, optimistic readers may see it torn by a writer */
+        inline size_t count() const
+        {
+            return std::min<size_t>(size, is_leaf ? MAX_BPTREE_NODE_SIZE : MAX_BPTREE_INTERNAL_SIZE);
+        }
+        inline size_t item_index_of(const K &x) const
+        {
+            return bptree_helper::count_before<search_strategy, false>(keys(), count(), x);
+        }
+        inline size_t child_index_of(const K &x) const
+        {
+            return bptree_helper::count_before<search_strategy, true>(keys(), count(), x);
+        }
+
+        /* false if the node is locked or obsolete */
+        inline bool read_lock(uint64_t &v) const
+        {
+            v = version.load(std::memory_order_acquire);
+            return !(v & (locked_bit | obsolete_bit));
+        }
+        /* whether the node is unchanged since read_lock returned v */
+        inline bool validate(uint64_t v) const
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return version.load(std::memory_order_relaxed) == v;
+        }
+        inline bool upgrade(uint64_t v)
+        {
+            if (!version.compare_exchange_strong(v, v + locked_bit, std::memory_order_acquire)) {
+                return false;
+            }
+            std::atomic_thread_fence(std::memory_order_release);
+            return true;
+        }
+        inline void write_unlock() { version.fetch_add(locked_bit, std::memory_order_release); }
+        inline void write_unlock_obsolete() { version.fetch_add(locked_bit | obsolete_bit, std::memory_order_release); }
+    };
+    struct alignas(bptree_helper::cache_line_size) InternalNode : public Node, public BaseObject {
+        K key[MAX_BPTREE_INTERNAL_SIZE];
+        Node *ptr[MAX_BPTREE_INTERNAL_SIZE + 1];
+        InternalNode() : Node(false) {}
+    };
+    struct alignas(bptree_helper::cache_line_size) LeafNode : public Node, public BaseObject {
+        K key[MAX_BPTREE_NODE_SIZE];
+        V values[MAX_BPTREE_NODE_SIZE];
+        LeafNode() : Node(true) {}
+    };
+    using node_type = Node;
+    using internal_node_type = InternalNode;
+    using leaf_node_type = LeafNode;
+
+    ConcurrentBPTree()
+    {
+        static_assert(std::is_standard_layout<K>::value && std::is_standard_layout<V>::value, "bptree only support pod types");
+        CreateSharedMemCxt();
+    }
+    ConcurrentBPTree(const ConcurrentBPTree &) = delete;
+    ConcurrentBPTree &operator=(const ConcurrentBPTree &) = delete;
+    ~ConcurrentBPTree()
+    {
+#ifndef NO_DESTROYER
+        destroy();
+#endif /* NO_DESTROYER */
+    }
+
+    std::optional<V> search(const K &x) const;
+    /* false if x exists already, its value is left untouched */
+    bool insert(const K &x, const V &v);
+    bool remove(const K &x);
+
+    /* thread-unsafe, we don't expect read/write to occur under them */
+    size_t thread_unsafe_size() const { return count_entries(_root.load()); }
+    void destroy();
+private:
+    /* entered by every operation, pins the epoch it started in */
+    class EpochGuard {
+    public:
+        explicit EpochGuard(const ConcurrentBPTree *tree) : _tree(tree), _slot(tree->enter_epoch()) {}
+        ~EpochGuard() { _tree->leave_epoch(_slot); }
+    private:
+        const ConcurrentBPTree *_tree;
+        size_t _slot;
+    };
+    /* 0 is an idle slot, otherwise the epoch the running operation started in */
+    struct alignas(bptree_helper::cache_line_size) EpochSlot {
+        std::atomic<uint64_t> epoch{0};
+    };
+    struct Retired {
+        node_type *node;
+        uint64_t epoch;
+    };
+
+    MemCxtHolder;
+    std::atomic<node_type *> _root{NULL};
+    mutable std::atomic<uint64_t> _epoch{1};
+    mutable EpochSlot _slots[max_threads];
+    std::mutex _retire_lock;
+    Vector<Retired, false> _retired;
+    size_t _reclaim_at{reclaim_batch};
+
+    bool try_insert(node_type *, const K &, const V &, bool &inserted);
+    bool try_remove(node_type *, const K &, bool &removed);
+    void split(internal_node_type *parent, uint64_t parent_version, node_type *, uint64_t version);
+    node_type *split_node(node_type *, K &split_key);
+    size_t enter_epoch() const;
+    inline void leave_epoch(size_t slot) const { _slots[slot].epoch.store(0, std::memory_order_release); }
+    void retire(node_type *);
+    void reclaim();
+    size_t count_entries(const node_type *) const;
+    void clean_up(node_type *);
+
+    inline leaf_node_type *new_leaf() { return NEW leaf_node_type(); }
+    inline internal_node_type *new_internal() { return NEW internal_node_type(); }
+    inline void free_node(node_type *node)
+    {
+        if (node->is_leaf) {
+            delete static_cast<leaf_node_type *>(node);
+        } else {
+            delete static_cast<internal_node_type *>(node);
+        }
+    }
+};
+} /* namespace mem_container */
+
+/* place for implementation */
+
+#include <cstring>
+
+using namespace mem_container;
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+size_t ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::enter_epoch() const
+{
+    size_t slot = bptree_helper::epoch_slot_hint() % max_threads;
+    for (size_t attempt = 0;; ++attempt) {
+        uint64_t idle = 0;
+        if (_slots[slot].epoch.compare_exchange_strong(idle, _epoch.load())) {
+            break;
+        }
+        slot = (slot + 1) % max_threads;
+        if (attempt >= max_threads) {
+            bptree_helper::backoff(attempt);
+        }
+    }
+    bptree_helper::epoch_slot_hint() = slot;
+    return slot;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+void ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::retire(node_type *node)
+{
+    std::lock_guard<std::mutex> guard(_retire_lock);
+    _retired.push_back(Retired{node, _epoch.load()});
+    if (_retired.size() >= _reclaim_at) {
+        reclaim();
+    }
+}
+
+/* a node retired in epoch e is unreachable for operations started after e */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+void ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::reclaim()
+{
+    uint64_t safe_epoch = _epoch.fetch_add(1) + 1;
+    for (size_t i = 0; i < max_threads; ++i) {
+        uint64_t epoch = _slots[i].epoch.load();
+        if (epoch != 0 && epoch < safe_epoch) {
+            safe_epoch = epoch;
+        }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < _retired.size(); ++i) {
+        if (_retired[i].epoch < safe_epoch) {
+            free_node(_retired[i].node);
+        } else {
+            _retired[kept++] = _retired[i];
+        }
+    }
+    _retired.resize(kept);
+    /* long running readers may pin many nodes, do not rescan them on every retire */
+    _reclaim_at = std::max(reclaim_batch, kept * 2);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+std::optional<V> ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::search(const K &x) const
+{
+    EpochGuard guard(this);
+    for (size_t attempt = 0;; bptree_helper::backoff(attempt++)) {
+        node_type *node = _root.load(std::memory_order_acquire);
+        if (!node) {
+            return {};
+        }
+        uint64_t version;
+        if (!node->read_lock(version) || node != _root.load(std::memory_order_acquire)) {
+            continue;
+        }
+        bool restart = false;
+        while (!node->is_leaf) {
+            internal_node_type *inner = static_cast<internal_node_type *>(node);
+            node = inner->ptr[inner->child_index_of(x)];
+            /* the child pointer is only safe to follow once the parent is validated */
+            uint64_t child_version;
+            if (!inner->validate(version) || !node->read_lock(child_version) || !inner->validate(version)) {
+                restart = true;
+                break;
+            }
+            version = child_version;
+        }
+        if (restart) {
+            continue;
+        }
+        const leaf_node_type *leaf = static_cast<const leaf_node_type *>(node);
+        size_t i = leaf->item_index_of(x);
+        std::optional<V> res;
+        if (i < leaf->count() && leaf->key[i] == x) {
+            res = leaf->values[i];
+        }
+        if (leaf->validate(version)) {
+            return res;
+        }
+    }
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+bool ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::insert(const K &x, const V &v)
+{
+    EpochGuard guard(this);
+    bool inserted = false;
+    for (size_t attempt = 0;; bptree_helper::backoff(attempt++)) {
+        node_type *root = _root.load(std::memory_order_acquire);
+        if (!root) {
+            leaf_node_type *leaf = new_leaf();
+            if (!_root.compare_exchange_strong(root, leaf)) {
+                free_node(leaf);
+            }
+            continue;
+        }
+        if (try_insert(root, x, v, inserted)) {
+            return inserted;
+        }
+    }
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+bool ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::try_insert(node_type *node, const K &x, const V &v, bool &inserted)
+{
+    uint64_t version;
+    if (!node->read_lock(version) || node != _root.load(std::memory_order_acquire)) {
+        return false;
+    }
+    internal_node_type *parent = NULL;
+    uint64_t parent_version = 0;
+    while (!node->is_leaf) {
+        internal_node_type *inner = static_cast<internal_node_type *>(node);
+        if (inner->count() == MAX_BPTREE_INTERNAL_SIZE) {
+            split(parent, parent_version, inner, version);
+            return false;
+        }
+        node_type *child = inner->ptr[inner->child_index_of(x)];
+        uint64_t child_version;
+        if (!inner->validate(version) || !child->read_lock(child_version) || !inner->validate(version)) {
+            return false;
+        }
+        parent = inner;
+        parent_version = version;
+        node = child;
+        version = child_version;
+    }
+
+    leaf_node_type *leaf = static_cast<leaf_node_type *>(node);
+    size_t i = leaf->item_index_of(x);
+    if (i < leaf->count() && leaf->key[i] == x) {
+        if (!leaf->validate(version)) {
+            return false;
+        }
+        inserted = false;
+        return true;
+    }
+    if (leaf->count() == MAX_BPTREE_NODE_SIZE) {
+        split(parent, parent_version, leaf, version);
+        return false;
+    }
+    if (!leaf->upgrade(version)) {
+        return false;
+    }
+    memmove(leaf->key + i + 1, leaf->key + i, sizeof(K) * (leaf->size - i));
+    leaf->key[i] = x;
+    memmove(leaf->values + i + 1, leaf->values + i, sizeof(V) * (leaf->size - i));
+    leaf->values[i] = v;
+    ++leaf->size;
+    leaf->write_unlock();
+    inserted = true;
+    return true;
+}
+
+/* split a full node under its parent, the parent is not full as full nodes are split on the way down */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+void ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::split(internal_node_type *parent, uint64_t parent_version, node_type *node, uint64_t version)
+{
+    if (parent && !parent->upgrade(parent_version)) {
+        return;
+    }
+    if (!node->upgrade(version)) {
+        if (parent) {
+            parent->write_unlock();
+        }
+        return;
+    }
+    if (!parent && node != _root.load(std::memory_order_acquire)) {
+        node->write_unlock();
+        return;
+    }
+    K split_key;
+    node_type *sibling = split_node(node, split_key);
+    if (parent) {
+        size_t i = parent->child_index_of(split_key);
+        memmove(parent->key + i + 1, parent->key + i, sizeof(K) * (parent->size - i));
+        parent->key[i] = split_key;
+        memmove(parent->ptr + i + 2, parent->ptr + i + 1, sizeof(node_type *) * (parent->size - i));
+        parent->ptr[i + 1] = sibling;
+        ++parent->size;
+    } else {
+        internal_node_type *root = new_internal();
+        root->key[0] = split_key;
+        root->ptr[0] = node;
+        root->ptr[1] = sibling;
+        root->size = 1;
+        _root.store(root, std::memory_order_release);
+    }
+    node->write_unlock();
+    if (parent) {
+        parent->write_unlock();
+    }
+}
+
+/* move the upper half of a locked node into a new right sibling */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+typename ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::node_type *ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::split_node(node_type *node, K &split_key)
+{
+    if (node->is_leaf) {
+        leaf_node_type *src = static_cast<leaf_node_type *>(node);
+        leaf_node_type *sibling = new_leaf();
+        sibling->size = src->size / 2;
+        src->size -= sibling->size;
+        memcpy(sibling->key, src->key + src->size, sizeof(K) * sibling->size);
+        memcpy(sibling->values, src->values + src->size, sizeof(V) * sibling->size);
+        split_key = sibling->key[0];
+        return sibling;
+    }
+    /* the middle key moves up, keys of the right half start after it */
+    internal_node_type *src = static_cast<internal_node_type *>(node);
+    internal_node_type *sibling = new_internal();
+    size_t mid = src->size / 2;
+    split_key = src->key[mid];
+    sibling->size = src->size - mid - 1;
+    memcpy(sibling->key, src->key + mid + 1, sizeof(K) * sibling->size);
+    memcpy(sibling->ptr, src->ptr + mid + 1, sizeof(node_type *) * (sibling->size + 1));
+    src->size = mid;
+    return sibling;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+bool ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::remove(const K &x)
+{
+    EpochGuard guard(this);
+    bool removed = false;
+    for (size_t attempt = 0;; bptree_helper::backoff(attempt++)) {
+        node_type *root = _root.load(std::memory_order_acquire);
+        if (!root) {
+            return false;
+        }
+        if (try_remove(root, x, removed)) {
+            return removed;
+        }
+    }
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+bool ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::try_remove(node_type *node, const K &x, bool &removed)
+{
+    uint64_t version;
+    if (!node->read_lock(version) || node != _root.load(std::memory_order_acquire)) {
+        return false;
+    }
+    internal_node_type *parent = NULL;
+    uint64_t parent_version = 0;
+    bool parent_is_root = false;
+    size_t pos = 0;
+    while (!node->is_leaf) {
+        internal_node_type *inner = static_cast<internal_node_type *>(node);
+        size_t child_pos = inner->child_index_of(x);
+        node_type *child = inner->ptr[child_pos];
+        uint64_t child_version;
+        if (!inner->validate(version) || !child->read_lock(child_version) || !inner->validate(version)) {
+            return false;
+        }
+        parent_is_root = parent == NULL;
+        parent = inner;
+        parent_version = version;
+        pos = child_pos;
+        node = child;
+        version = child_version;
+    }
+
+    leaf_node_type *leaf = static_cast<leaf_node_type *>(node);
+    size_t i = leaf->item_index_of(x);
+    if (i >= leaf->count() || !(leaf->key[i] == x)) {
+        if (!leaf->validate(version)) {
+            return false;
+        }
+        removed = false;
+        return true;
+    }
+    if (!parent || parent->count() == 0 || leaf->count() > (MAX_BPTREE_NODE_SIZE + 1) / 2) {
+        if (!leaf->upgrade(version)) {
+            return false;
+        }
+        --leaf->size;
+        memmove(leaf->key + i, leaf->key + i + 1, sizeof(K) * (leaf->size - i));
+        memmove(leaf->values + i, leaf->values + i + 1, sizeof(V) * (leaf->size - i));
+        leaf->write_unlock();
+        removed = true;
+        return true;
+    }
+
+    /* the leaf underflows, lock parent, leaf and a sibling top down and left to right */
+    if (!parent->upgrade(parent_version)) {
+        return false;
+    }
+    leaf_node_type *left = pos > 0 ? static_cast<leaf_node_type *>(parent->ptr[pos - 1]) : leaf;
+    leaf_node_type *right = pos > 0 ? leaf : static_cast<leaf_node_type *>(parent->ptr[pos + 1]);
+    leaf_node_type *sibling = pos > 0 ? left : right;
+    uint64_t sibling_version;
+    if (pos > 0 && (!sibling->read_lock(sibling_version) || !sibling->upgrade(sibling_version))) {
+        parent->write_unlock();
+        return false;
+    }
+    if (!leaf->upgrade(version)) {
+        if (pos > 0) {
+            sibling->write_unlock();
+        }
+        parent->write_unlock();
+        return false;
+    }
+    if (pos == 0 && (!sibling->read_lock(sibling_version) || !sibling->upgrade(sibling_version))) {
+        leaf->write_unlock();
+        parent->write_unlock();
+        return false;
+    }
+    --leaf->size;
+    memmove(leaf->key + i, leaf->key + i + 1, sizeof(K) * (leaf->size - i));
+    memmove(leaf->values + i, leaf->values + i + 1, sizeof(V) * (leaf->size - i));
+    removed = true;
+    if (left->size + right->size > MAX_BPTREE_NODE_SIZE) {
+        left->write_unlock();
+        right->write_unlock();
+        parent->write_unlock();
+        return true;
+    }
+
+    memcpy(left->key + left->size, right->key, sizeof(K) * right->size);
+    memcpy(left->values + left->size, right->values, sizeof(V) * right->size);
+    left->size += right->size;
+    size_t right_pos = pos > 0 ? pos : pos + 1;
+    memmove(parent->key + right_pos - 1, parent->key + right_pos, sizeof(K) * (parent->size - right_pos));
+    memmove(parent->ptr + right_pos, parent->ptr + right_pos + 1, sizeof(node_type *) * (parent->size - right_pos));
+    --parent->size;
+    right->write_unlock_obsolete();
+    left->write_unlock();
+    if (parent_is_root && parent->size == 0) {
+        _root.store(left, std::memory_order_release);
+        parent->write_unlock_obsolete();
+        retire(parent);
+    } else {
+        parent->write_unlock();
+    }
+    retire(right);
+    return true;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+size_t ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::count_entries(const node_type *cursor) const
+{
+    if (!cursor) {
+        return 0;
+    }
+    if (cursor->is_leaf) {
+        return cursor->size;
+    }
+    size_t res = 0;
+    for (size_t i = 0; i < cursor->size + 1; ++i) {
+        res += count_entries(static_cast<const internal_node_type *>(cursor)->ptr[i]);
+    }
+    return res;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+void ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::clean_up(node_type *cursor)
+{
+    if (cursor) {
+        if (!cursor->is_leaf) {
+            for (size_t i = 0; i < cursor->size + 1; ++i) {
+                clean_up(static_cast<internal_node_type *>(cursor)->ptr[i]);
+            }
+        }
+        free_node(cursor);
+    }
+}
+
+/* thread-unsafe, we don't expect read/write to occur under destroy() */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+void ConcurrentBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::destroy()
+{
+    clean_up(_root.load());
+    _root.store(NULL);
+    for (size_t i = 0; i < _retired.size(); ++i) {
+        free_node(_retired[i].node);
+    }
+    _retired.destroy();
+    _reclaim_at = reclaim_batch;
+    DestroyMemCxt();
+}
+
+#endif /* CONTAINER_BPTREE_CONCURRENT_BPTREE_H */
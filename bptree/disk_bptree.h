@@ -0,0 +1,466 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * B+ Tree stored in pages of a local file and read through a buffer pool, thread unsafe
+ */
+
+#ifndef CONTAINER_BPTREE_DISK_BPTREE_H
+#define CONTAINER_BPTREE_DISK_BPTREE_H
+
+#include <stdexcept>
+
+#include "../definition.h"
+#include "bptree.h"
+#include "buffer_pool.h"
+
+namespace mem_container {
+/*
+ * nodes are pages addressed by page id, page 0 keeps the root, the key count and the free page list.
+ * only the pages on the current path are pinned, so the resident set is bounded by the pool and
+ * the tree may exceed memory. a split pins the split node, its new sibling and the next leaf.
+ * removal only gives back pages that become empty, pages left half full are not merged.
+ * values are copied out on search, the content is persisted by flush() and destroy().
+ * io errors of the final flush in the destructor are dropped, call destroy() first to see them
+ */
+template <typename K, typename V, size_t PAGE_SIZE = bptree_helper::page_size, BPTreeSearch SEARCH = BPTreeSearch::Auto>
+class DiskBPTree {
+public:
+    using pool_type = BufferPool<PAGE_SIZE>;
+    using page_id = typename pool_type::page_id;
+    constexpr static const page_id invalid_page = pool_type::invalid_page;
+    struct PageHeader {
+        uint32_t size;
+        uint32_t is_leaf;
+    };
+    constexpr static const size_t leaf_size =
+        (PAGE_SIZE - sizeof(PageHeader) - 2 * sizeof(page_id) - alignof(V)) / (sizeof(K) + sizeof(V));
+    constexpr static const size_t internal_size =
+        (PAGE_SIZE - sizeof(PageHeader) - sizeof(page_id) - alignof(K)) / (sizeof(K) + sizeof(page_id));
+    static_assert(leaf_size >= 3 && internal_size >= 3, "page is too small for the key and value");
+    constexpr static const BPTreeSearch search_strategy =
+        bptree_helper::resolve_search<SEARCH, K, std::max(leaf_size, internal_size)>();
+    struct LeafPage : public PageHeader {
+        page_id next;
+        page_id prev;
+        K key[leaf_size];
+        V values[leaf_size];
+    };
+    struct InternalPage : public PageHeader {
+        K key[internal_size];
+        page_id child[internal_size + 1];
+    };
+    static_assert(sizeof(LeafPage) <= PAGE_SIZE && sizeof(InternalPage) <= PAGE_SIZE, "node does not fit in a page");
+
+    /* open the tree stored in path, or start an empty one there when create is set */
+    DiskBPTree(const char *path, size_t nframe, bool create = true);
+    DiskBPTree(const DiskBPTree &) = delete;
+    DiskBPTree &operator=(const DiskBPTree &) = delete;
+    ~DiskBPTree()
+    {
+#ifndef NO_DESTROYER
+        try {
+            destroy();
+        } catch (const std::exception &) {
+        }
+#endif /* NO_DESTROYER */
+    }
+
+    bool search(const K &x, V &v);
+    inline bool contains(const K &x)
+    {
+        V v;
+        return search(x, v);
+    }
+    /* false if the key exists already */
+    bool insert(const K &x, const V &v);
+    bool remove(const K &x);
+    /* visit keys in [lo, hi) in order as visitor(key, value), stop once visitor returns false, returns the number visited */
+    template <typename Func>
+    size_t scan(const K &lo, const K &hi, Func &&visitor);
+
+    inline size_t size() const { return _meta.size; }
+    inline bool empty() const { return _meta.root == invalid_page; }
+    inline pool_type &pool() { return _pool; }
+    /* write the meta page and every dirty page back */
+    void flush();
+    /* flush and close, the file is closed even if the flush throws */
+    void destroy()
+    {
+        if (!_open) {
+            return;
+        }
+        _open = false;
+        try {
+            flush();
+        } catch (...) {
+            _pool.discard();
+            throw;
+        }
+        _pool.destroy();
+    }
+private:
+    constexpr static const uint64_t magic = 0x6270747265650001ull;
+    constexpr static const size_t max_height = 64;
+    struct MetaPage {
+        uint64_t magic;
+        uint64_t size;
+        page_id root;
+        page_id free_list;
+        uint32_t key_size;
+        uint32_t value_size;
+        uint32_t page_size;
+    };
+    /* a page on the free list keeps the id of the next free one in its first bytes */
+    struct FreePage {
+        page_id next;
+    };
+    struct Path {
+        page_id node[max_height];
+        size_t index[max_height];
+        size_t depth{0};
+    };
+    using Page = typename pool_type::Page;
+    pool_type _pool;
+    MetaPage _meta;
+    bool _open{true};
+
+    template <bool upper>
+    static inline size_t count_before(const K *keys, size_t n, const K &x)
+    {
+        return bptree_helper::count_before<search_strategy, upper>(keys, n, x);
+    }
+    /* pinned leaf that may hold x, the internal pages above it are recorded in path */
+    Page descend(const K &x, Path *path);
+    Page new_page();
+    void free_page(page_id id);
+    void insert_internal(K split_key, page_id left, page_id right, Path &path);
+};
+} /* namespace mem_container */
+
+/* place for implementation */
+
+using namespace mem_container;
+
+template <typename K, typename V, size_t PAGE_SIZE, BPTreeSearch SEARCH>
+DiskBPTree<K, V, PAGE_SIZE, SEARCH>::DiskBPTree(const char *path, size_t nframe, bool create)
+    : _pool(path, nframe, create)
+{
+    static_assert(std::is_standard_layout<K>::value && std::is_standard_layout<V>::value, "bptree only support pod types");
+    static_assert(sizeof(MetaPage) <= PAGE_SIZE, "page is too small for the meta page");
+    if (create || _pool.page_count() == 0) {
+        Page meta = _pool.allocate();
+        CONTAINER_ASSERT(meta.id() == 0);
+        _meta = MetaPage{magic, 0, invalid_page, invalid_page, sizeof(K), sizeof(V), PAGE_SIZE};
+        *meta.template as<MetaPage>() = _meta;
+        return;
+    }
+    Page meta = _pool.fetch(0);
+    _meta = *meta.template as<MetaPage>();
+    if (_meta.magic != magic || _meta.key_size != sizeof(K) || _meta.value_size != sizeof(V) || _meta.page_size != PAGE_SIZE) {
+        meta.release();
+        _pool.destroy();
+        _open = false;
+        throw std::runtime_error("file is not a bptree of this layout");
+    }
+}
+
+template <typename K, typename V, size_t PAGE_SIZE, BPTreeSearch SEARCH>
+void DiskBPTree<K, V, PAGE_SIZE, SEARCH>::flush()
+{
+    Page meta = _pool.fetch(0);
+    *meta.template as<MetaPage>() = _meta;
+    meta.mark_dirty();
+    meta.release();
+    _pool.flush();
+}
+
+template <typename K, typename V, size_t PAGE_SIZE, BPTreeSearch SEARCH>
+typename DiskBPTree<K, V, PAGE_SIZE, SEARCH>::Page DiskBPTree<K, V, PAGE_SIZE, SEARCH>::new_page()
+{
+    if (_meta.free_list == invalid_page) {
+        return _pool.allocate();
+    }
+    Page page = _pool.fetch(_meta.free_list);
+    _meta.free_list = page.template as<FreePage>()->next;
+    memset(page.template as<char>(), 0, PAGE_SIZE);
+    page.mark_dirty();
+    return page;
+}
+
+template <typename K, typename V, size_t PAGE_SIZE, BPTreeSearch SEARCH>
+void DiskBPTree<K, V, PAGE_SIZE, SEARCH>::free_page(page_id id)
+{
+    Page page = _pool.fetch(id);
+    page.template as<FreePage>()->next = _meta.free_list;
+    page.mark_dirty();
+    _meta.free_list = id;
+}
+
+template <typename K, typename V, size_t PAGE_SIZE, BPTreeSearch SEARCH>
+typename DiskBPTree<K, V, PAGE_SIZE, SEARCH>::Page DiskBPTree<K, V, PAGE_SIZE, SEARCH>::descend(const K &x, Path *path)
+{
+    Page page = _pool.fetch(_meta.root);
+    if (path) {
+        path->depth = 0;
+    }
+    while (!page.template as<PageHeader>()->is_leaf) {
+        InternalPage *node = page.template as<InternalPage>();
+        size_t i = count_before<true>(node->key, node->size, x);
+        if (path) {
+            CONTAINER_ASSERT(path->depth < max_height);
+            path->node[path->depth] = page.id();
+            path->index[path->depth++] = i;
+        }
+        page_id child = node->child[i];
+        /* the parent is unpinned before the child is read */
+        page.release();
+        page = _pool.fetch(child);
+    }
+    return page;
+}
+
+template <typename K, typename V, size_t PAGE_SIZE, BPTreeSearch SEARCH>
+bool DiskBPTree<K, V, PAGE_SIZE, SEARCH>::search(const K &x, V &v)
+{
+    if (empty()) {
+        return false;
+    }
+    Page page = descend(x, NULL);
+    LeafPage *leaf = page.template as<LeafPage>();
+    size_t i = count_before<false>(leaf->key, leaf->size, x);
+    if (i < leaf->size && x == leaf->key[i]) {
+        v = leaf->values[i];
+        return true;
+    }
+    return false;
+}
+
+template <typename K, typename V, size_t PAGE_SIZE, BPTreeSearch SEARCH>
+bool DiskBPTree<K, V, PAGE_SIZE, SEARCH>::insert(const K &x, const V &v)
+{
+    if (empty()) {
+        Page page = new_page();
+        LeafPage *leaf = page.template as<LeafPage>();
+        leaf->is_leaf = 1;
+        leaf->size = 1;
+        leaf->next = leaf->prev = invalid_page;
+        leaf->key[0] = x;
+        leaf->values[0] = v;
+        _meta.root = page.id();
+        _meta.size = 1;
+        return true;
+    }
+    Path path;
+    Page page = descend(x, &path);
+    LeafPage *leaf = page.template as<LeafPage>();
+    size_t i = count_before<false>(leaf->key, leaf->size, x);
+    if (i < leaf->size && x == leaf->key[i]) {
+        return false;
+    }
+    ++_meta.size;
+    page.mark_dirty();
+    if (leaf->size < leaf_size) {
+        memmove(leaf->key + i + 1, leaf->key + i, sizeof(K) * (leaf->size - i));
+        memmove(leaf->values + i + 1, leaf->values + i, sizeof(V) * (leaf->size - i));
+        leaf->key[i] = x;
+        leaf->values[i] = v;
+        ++leaf->size;
+        return true;
+    }
+
+    /* the full leaf and x are spread over the leaf and a new right sibling */
+    Page right_page = new_page();
+    LeafPage *right = right_page.template as<LeafPage>();
+    right->is_leaf = 1;
+    size_t left_size = (leaf_size + 1) / 2;
+    right->size = leaf_size + 1 - left_size;
+    if (i < left_size) {
+        memcpy(right->key, leaf->key + left_size - 1, sizeof(K) * right->size);
+        memcpy(right->values, leaf->values + left_size - 1, sizeof(V) * right->size);
+        memmove(leaf->key + i + 1, leaf->key + i, sizeof(K) * (left_size - 1 - i));
+        memmove(leaf->values + i + 1, leaf->values + i, sizeof(V) * (left_size - 1 - i));
+        leaf->key[i] = x;
+        leaf->values[i] = v;
+    } else {
+        size_t j = i - left_size;
+        memcpy(right->key, leaf->key + left_size, sizeof(K) * j);
+        memcpy(right->values, leaf->values + left_size, sizeof(V) * j);
+        right->key[j] = x;
+        right->values[j] = v;
+        memcpy(right->key + j + 1, leaf->key + i, sizeof(K) * (leaf_size - i));
+        memcpy(right->values + j + 1, leaf->values + i, sizeof(V) * (leaf_size - i));
+    }
+    leaf->size = left_size;
+    right->next = leaf->next;
+    right->prev = page.id();
+    leaf->next = right_page.id();
+    K split_key = right->key[0];
+    page_id left_id = page.id();
+    page_id right_id = right_page.id();
+    page_id next_id = right->next;
+    page.release();
+    right_page.release();
+    if (next_id != invalid_page) {
+        Page next = _pool.fetch(next_id);
+        next.template as<LeafPage>()->prev = right_id;
+        next.mark_dirty();
+    }
+    insert_internal(split_key, left_id, right_id, path);
+    return true;
+}
+
+/* right was split off left, link it into the parents recorded in path, splitting them upward as needed */
+template <typename K, typename V, size_t PAGE_SIZE, BPTreeSearch SEARCH>
+void DiskBPTree<K, V, PAGE_SIZE, SEARCH>::insert_internal(K split_key, page_id left, page_id right, Path &path)
+{
+    while (path.depth > 0) {
+        Page page = _pool.fetch(path.node[--path.depth]);
+        size_t i = path.index[path.depth];
+        InternalPage *node = page.template as<InternalPage>();
+        page.mark_dirty();
+        if (node->size < internal_size) {
+            memmove(node->key + i + 1, node->key + i, sizeof(K) * (node->size - i));
+            memmove(node->child + i + 2, node->child + i + 1, sizeof(page_id) * (node->size - i));
+            node->key[i] = split_key;
+            node->child[i + 1] = right;
+            ++node->size;
+            return;
+        }
+        /* internal_size + 1 keys, the middle one moves up */
+        K keys[internal_size + 1];
+        page_id children[internal_size + 2];
+        memcpy(keys, node->key, sizeof(K) * i);
+        keys[i] = split_key;
+        memcpy(keys + i + 1, node->key + i, sizeof(K) * (internal_size - i));
+        memcpy(children, node->child, sizeof(page_id) * (i + 1));
+        children[i + 1] = right;
+        memcpy(children + i + 2, node->child + i + 1, sizeof(page_id) * (internal_size - i));
+
+        Page sibling_page = new_page();
+        InternalPage *sibling = sibling_page.template as<InternalPage>();
+        size_t mid = (internal_size + 1) / 2;
+        node->size = mid;
+        sibling->size = internal_size - mid;
+        memcpy(node->key, keys, sizeof(K) * mid);
+        memcpy(node->child, children, sizeof(page_id) * (mid + 1));
+        memcpy(sibling->key, keys + mid + 1, sizeof(K) * sibling->size);
+        memcpy(sibling->child, children + mid + 1, sizeof(page_id) * (sibling->size + 1));
+        split_key = keys[mid];
+        left = page.id();
+        right = sibling_page.id();
+    }
+    Page root_page = new_page();
+    InternalPage *root = root_page.template as<InternalPage>();
+    root->size = 1;
+    root->key[0] = split_key;
+    root->child[0] = left;
+    root->child[1] = right;
+    _meta.root = root_page.id();
+}
+
+template <typename K, typename V, size_t PAGE_SIZE, BPTreeSearch SEARCH>
+bool DiskBPTree<K, V, PAGE_SIZE, SEARCH>::remove(const K &x)
+{
+    if (empty()) {
+        return false;
+    }
+    Path path;
+    Page page = descend(x, &path);
+    LeafPage *leaf = page.template as<LeafPage>();
+    size_t i = count_before<false>(leaf->key, leaf->size, x);
+    if (i >= leaf->size || !(x == leaf->key[i])) {
+        return false;
+    }
+    --_meta.size;
+    page.mark_dirty();
+    --leaf->size;
+    memmove(leaf->key + i, leaf->key + i + 1, sizeof(K) * (leaf->size - i));
+    memmove(leaf->values + i, leaf->values + i + 1, sizeof(V) * (leaf->size - i));
+    if (leaf->size > 0) {
+        return true;
+    }
+
+    /* an empty leaf leaves the sibling chain and its entry in the parent */
+    page_id id = page.id();
+    page_id prev_id = leaf->prev;
+    page_id next_id = leaf->next;
+    page.release();
+    if (prev_id != invalid_page) {
+        Page prev = _pool.fetch(prev_id);
+        prev.template as<LeafPage>()->next = next_id;
+        prev.mark_dirty();
+    }
+    if (next_id != invalid_page) {
+        Page next = _pool.fetch(next_id);
+        next.template as<LeafPage>()->prev = prev_id;
+        next.mark_dirty();
+    }
+    free_page(id);
+    while (true) {
+        if (path.depth == 0) {
+            /* the removed page was the root */
+            _meta.root = invalid_page;
+            return true;
+        }
+        Page parent_page = _pool.fetch(path.node[--path.depth]);
+        InternalPage *parent = parent_page.template as<InternalPage>();
+        if (parent->size > 0) {
+            size_t pos = path.index[path.depth];
+            size_t key_pos = pos > 0 ? pos - 1 : 0;
+            memmove(parent->key + key_pos, parent->key + key_pos + 1, sizeof(K) * (parent->size - key_pos - 1));
+            memmove(parent->child + pos, parent->child + pos + 1, sizeof(page_id) * (parent->size - pos));
+            --parent->size;
+            parent_page.mark_dirty();
+            break;
+        }
+        /* the only child is gone, so is the parent */
+        id = parent_page.id();
+        parent_page.release();
+        free_page(id);
+    }
+
+    /* a root with a single child is replaced by the child */
+    while (true) {
+        Page root_page = _pool.fetch(_meta.root);
+        InternalPage *root = root_page.template as<InternalPage>();
+        if (root->is_leaf || root->size > 0) {
+            break;
+        }
+        id = root_page.id();
+        _meta.root = root->child[0];
+        root_page.release();
+        free_page(id);
+    }
+    return true;
+}
+
+template <typename K, typename V, size_t PAGE_SIZE, BPTreeSearch SEARCH>
+template <typename Func>
+size_t DiskBPTree<K, V, PAGE_SIZE, SEARCH>::scan(const K &lo, const K &hi, Func &&visitor)
+{
+    if (empty() || !(lo < hi)) {
+        return 0;
+    }
+    Page page = descend(lo, NULL);
+    size_t res = 0;
+    for (size_t i = count_before<false>(page.template as<LeafPage>()->key, page.template as<LeafPage>()->size, lo); ; i = 0) {
+        LeafPage *leaf = page.template as<LeafPage>();
+        /* only the leaf holding hi needs a bound check per key */
+        bool last = leaf->size > 0 && !(leaf->key[leaf->size - 1] < hi);
+        size_t end = last ? count_before<false>(leaf->key, leaf->size, hi) : leaf->size;
+        for (; i < end; ++i) {
+            ++res;
+            if (!visitor((const K &)leaf->key[i], (const V &)leaf->values[i])) {
+                return res;
+            }
+        }
+        page_id next = leaf->next;
+        if (last || next == invalid_page) {
+            break;
+        }
+        page.release();
+        page = _pool.fetch(next);
+    }
+    return res;
+}
+
+#endif /* CONTAINER_BPTREE_DISK_BPTREE_H */
@@ -0,0 +1,278 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * read only B+ Tree in an implicit, pointer free layout (CSS tree), built from a BPTree
+ */
+
+#ifndef CONTAINER_BPTREE_FROZEN_BPTREE_H
+#define CONTAINER_BPTREE_FROZEN_BPTREE_H
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "../definition.h"
+#include "bptree.h"
+
+namespace mem_container {
+/*
+ * keys and values sit in two sorted arrays, the keys are cut into blocks of one cache line.
+ * index levels above hold for every block of the level below the first key of its subtree,
+ * B keys per block and B + 1 children per block, children are found by arithmetic rather
+ * than pointers. a lookup reads one aligned block per level with a branchless (or simd)
+ * count and computes the next block from it, there is no pointer to load on the way down.
+ * missing keys of the last blocks repeat the largest key, lookups above it return early.
+ * the tree cannot be modified, rebuild it from a BPTree to change the content
+ */
+template <typename K, typename V, BPTreeSearch SEARCH = BPTreeSearch::Auto>
+class FrozenBPTree {
+public:
+    /* keys per block */
+    constexpr static const size_t block_size = std::max<size_t>(bptree_helper::cache_line_size / sizeof(K), 2);
+    constexpr static const BPTreeSearch search_strategy = bptree_helper::resolve_search<SEARCH, K, block_size>();
+    constexpr static const size_t max_levels = 32;
+    struct const_iterator {
+        const K *k;
+        const V *v;
+        const_iterator(const K *key, const V *value) : k(key), v(value) {}
+        const_iterator &operator++()
+        {
+            ++k;
+            ++v;
+            return *this;
+        }
+        const_iterator &operator--()
+        {
+            --k;
+            --v;
+            return *this;
+        }
+        bool operator==(const const_iterator &other) const { return k == other.k; }
+        bool operator!=(const const_iterator &other) const { return k != other.k; }
+        const V &operator*() const { return *v; }
+        const V &value() const { return *v; }
+        const K &key() const { return *k; }
+    };
+    using iterator = const_iterator;
+
+    FrozenBPTree() = default;
+    /* n keys in ascending order */
+    FrozenBPTree(const K *keys, const V *values, size_t n) { build(keys, values, n); }
+    /* a copy of the content of any tree with ordered const iterators, such as BPTree */
+    template <typename Tree>
+    explicit FrozenBPTree(const Tree &tree)
+    {
+        size_t n = tree.size();
+        K *keys = (K *)malloc(sizeof(K) * std::max<size_t>(n, 1));
+        V *values = (V *)malloc(sizeof(V) * std::max<size_t>(n, 1));
+        size_t i = 0;
+        for (auto it = tree.cbegin(); it != tree.cend(); ++it, ++i) {
+            keys[i] = it.key();
+            values[i] = *it;
+        }
+        build(keys, values, n);
+        free(keys);
+        free(values);
+    }
+    FrozenBPTree(const FrozenBPTree &) = delete;
+    FrozenBPTree &operator=(const FrozenBPTree &) = delete;
+    FrozenBPTree(FrozenBPTree &&other) { steal(other); }
+    FrozenBPTree &operator=(FrozenBPTree &&other)
+    {
+        if (this != &other) {
+            destroy();
+            steal(other);
+        }
+        return *this;
+    }
+    ~FrozenBPTree()
+    {
+#ifndef NO_DESTROYER
+        destroy();
+#endif /* NO_DESTROYER */
+    }
+
+    const_iterator begin() const { return cbegin(); }
+    const_iterator end() const { return cend(); }
+    const_iterator cbegin() const { return const_iterator(_keys, _values); }
+    const_iterator cend() const { return const_iterator(_keys + _size, _values + _size); }
+
+    /* number of keys less than x, or not greater than x if upper */
+    template <bool upper = false>
+    size_t count_before(const K &x) const;
+    const V *search(const K &x) const
+    {
+        size_t i = count_before(x);
+        return i < _size && _keys[i] == x ? &_values[i] : NULL;
+    }
+    inline bool contains(const K &x) const { return search(x) != NULL; }
+    const_iterator find(const K &x) const { return cfind(x); }
+    const_iterator cfind(const K &x) const
+    {
+        size_t i = count_before(x);
+        return i < _size && _keys[i] == x ? at(i) : cend();
+    }
+    /* the last key not greater than x */
+    const_iterator cfind_left(const K &x) const
+    {
+        size_t i = count_before<true>(x);
+        return i > 0 ? at(i - 1) : cend();
+    }
+    /* visit keys in [lo, hi) in order as visitor(key, value), stop once visitor returns false, returns the number visited */
+    template <typename Func>
+    size_t scan(const K &lo, const K &hi, Func &&visitor) const
+    {
+        if (!(lo < hi)) {
+            return 0;
+        }
+        size_t res = 0;
+        for (size_t i = count_before(lo); i < _size && _keys[i] < hi; ++i) {
+            ++res;
+            if (!visitor((const K &)_keys[i], (const V &)_values[i])) {
+                break;
+            }
+        }
+        return res;
+    }
+    inline size_t size() const { return _size; }
+    inline bool empty() const { return _size == 0; }
+    /* bytes of keys, values and index levels */
+    inline size_t memory_usage() const
+    {
+        return sizeof(K) * (_nblock * block_size + _index_size) + sizeof(V) * _size;
+    }
+    void destroy()
+    {
+        /* pfree does not take NULL, an empty tree has nothing allocated */
+        if (_keys) {
+            container_helper::aligned_free(_keys);
+            free(_values);
+        }
+        if (_index) {
+            container_helper::aligned_free(_index);
+        }
+        _keys = NULL;
+        _values = NULL;
+        _index = NULL;
+        _size = 0;
+        _nblock = 0;
+        _index_size = 0;
+        _nlevel = 0;
+    }
+private:
+    K *_keys{NULL};
+    V *_values{NULL};
+    /* index levels from the root down, _level[h] is the offset of level h in _index */
+    K *_index{NULL};
+    size_t _level[max_levels];
+    size_t _nlevel{0};
+    size_t _index_size{0};
+    size_t _size{0};
+    /* blocks of _keys */
+    size_t _nblock{0};
+
+    inline const_iterator at(size_t i) const { return const_iterator(_keys + i, _values + i); }
+    void build(const K *keys, const V *values, size_t n);
+    void steal(FrozenBPTree &other)
+    {
+        _keys = other._keys;
+        _values = other._values;
+        _index = other._index;
+        memcpy(_level, other._level, sizeof(_level));
+        _nlevel = other._nlevel;
+        _index_size = other._index_size;
+        _size = other._size;
+        _nblock = other._nblock;
+        other._keys = NULL;
+        other._values = NULL;
+        other._index = NULL;
+        other._size = 0;
+        other._nblock = 0;
+        other._index_size = 0;
+        other._nlevel = 0;
+    }
+    /* released with container_helper::aligned_free */
+    static inline K *alloc_keys(size_t n)
+    {
+        return (K *)container_helper::aligned_malloc(bptree_helper::cache_line_size, sizeof(K) * std::max<size_t>(n, 1));
+    }
+};
+
+/* replace a BPTree with a frozen copy of it, the tree is left empty */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE, bool POOLED, typename MONOID>
+FrozenBPTree<K, V, SEARCH> freeze(BPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE, POOLED, MONOID> &tree)
+{
+    FrozenBPTree<K, V, SEARCH> res(tree);
+    tree.destroy();
+    return res;
+}
+} /* namespace mem_container */
+
+/* place for implementation */
+
+using namespace mem_container;
+
+template <typename K, typename V, BPTreeSearch SEARCH>
+void FrozenBPTree<K, V, SEARCH>::build(const K *keys, const V *values, size_t n)
+{
+    _size = n;
+    if (n == 0) {
+        return;
+    }
+    _nblock = (n + block_size - 1) / block_size;
+    _keys = alloc_keys(_nblock * block_size);
+    memcpy(_keys, keys, sizeof(K) * n);
+    std::fill(_keys + n, _keys + _nblock * block_size, keys[n - 1]);
+    _values = (V *)malloc(sizeof(V) * n);
+    memcpy(_values, values, sizeof(V) * n);
+
+    /* blocks per level from the bottom up, the top level has one block */
+    size_t nblocks[max_levels];
+    size_t nlevel = 0;
+    for (size_t count = _nblock; count > 1; ++nlevel) {
+        CONTAINER_ASSERT(nlevel < max_levels);
+        count = (count + block_size) / (block_size + 1);
+        nblocks[nlevel] = count;
+    }
+    _nlevel = nlevel;
+    _index_size = 0;
+    for (size_t h = 0; h < nlevel; ++h) {
+        _level[h] = _index_size;
+        _index_size += nblocks[nlevel - 1 - h] * block_size;
+    }
+    if (nlevel == 0) {
+        return;
+    }
+    _index = alloc_keys(_index_size);
+    /* a block of level h (counted from the root) spans span leaf blocks, key i of it starts child i + 1 */
+    size_t span = 1;
+    for (size_t h = nlevel; h > 0; --h) {
+        size_t child_span = span;
+        span *= block_size + 1;
+        K *level = _index + _level[h - 1];
+        for (size_t b = 0; b < nblocks[nlevel - h]; ++b) {
+            for (size_t i = 0; i < block_size; ++i) {
+                size_t first = (b * span + (i + 1) * child_span) * block_size;
+                level[b * block_size + i] = first < n ? _keys[first] : _keys[n - 1];
+            }
+        }
+    }
+}
+
+template <typename K, typename V, BPTreeSearch SEARCH>
+template <bool upper>
+size_t FrozenBPTree<K, V, SEARCH>::count_before(const K &x) const
+{
+    /* the padding repeats the largest key, so it must not sort before x */
+    if (_size == 0 || bptree_helper::before<upper>(_keys[_size - 1], x)) {
+        return _size;
+    }
+    size_t block = 0;
+    for (size_t h = 0; h < _nlevel; ++h) {
+        const K *keys = _index + _level[h] + block * block_size;
+        block = block * (block_size + 1) + bptree_helper::count_before<search_strategy, upper>(keys, block_size, x);
+    }
+    const K *keys = _keys + block * block_size;
+    return block * block_size + bptree_helper::count_before<search_strategy, upper>(keys, block_size, x);
+}
+
+#endif /* CONTAINER_BPTREE_FROZEN_BPTREE_H */
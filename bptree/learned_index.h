@@ -0,0 +1,193 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * learned (piecewise linear) index over the leaves of a BPTree, read mostly, thread unsafe
+ */
+
+#ifndef CONTAINER_BPTREE_LEARNED_INDEX_H
+#define CONTAINER_BPTREE_LEARNED_INDEX_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+
+#include "../definition.h"
+#include "bptree.h"
+
+namespace mem_container {
+/*
+ * leaves are numbered in key order and the lowest key routed to each leaf (its fence) is
+ * kept in an array. a piecewise linear model maps a key to a leaf number, every segment is
+ * built by a shrinking cone so that it is off by at most epsilon on the fences it covers.
+ * a lookup finds the segment by binary search over the few segment keys, predicts a leaf,
+ * searches the fences within epsilon of the prediction and the leaf itself, and never
+ * touches an internal node.
+ * the model only holds while the tree keeps the leaves it was trained on, inserts and
+ * removes inside a leaf are fine. once the structure of the tree changed lookups fall back
+ * to a regular descent until train is called again.
+ * keys have to be arithmetic so that the model can interpolate them
+ */
+template <typename Tree>
+class LearnedIndex {
+public:
+    using key_type = typename Tree::key_type;
+    using value_type = typename Tree::value_type;
+    using leaf_node_type = typename Tree::leaf_node_type;
+    static_assert(std::is_arithmetic<key_type>::value, "learned index interpolates keys");
+    struct Segment {
+        double slope;
+        /* leaf number of the first fence of the segment */
+        size_t first;
+    };
+
+    /* leaves predicted by the model are off by at most epsilon */
+    explicit LearnedIndex(const Tree &tree, size_t epsilon = 4) : _tree(&tree), _epsilon(epsilon) { train(); }
+    LearnedIndex(const LearnedIndex &) = delete;
+    LearnedIndex &operator=(const LearnedIndex &) = delete;
+    ~LearnedIndex()
+    {
+#ifndef NO_DESTROYER
+        destroy();
+#endif /* NO_DESTROYER */
+    }
+
+    /* rebuild the model from the current leaves of the tree, O(number of leaves) */
+    void train();
+    /* whether the tree still has the leaves the model was trained on */
+    inline bool valid() const { return _version == _tree->structure_version(); }
+    const value_type *search(const key_type &x);
+    inline bool contains(const key_type &x) { return search(x) != NULL; }
+    inline size_t segments() const { return _nsegment; }
+    inline size_t leaves() const { return _nleaf; }
+    /* lookups served by a regular descent since the last train */
+    inline size_t fallbacks() const { return _fallbacks; }
+    /* bytes of fences, leaf pointers and segments */
+    inline size_t memory_usage() const
+    {
+        return (sizeof(key_type) + sizeof(leaf_node_type *)) * _nleaf + (sizeof(key_type) + sizeof(Segment)) * _nsegment;
+    }
+    void destroy()
+    {
+        free(_fences);
+        free(_leaves);
+        free(_segment_keys);
+        free(_segments);
+        _fences = NULL;
+        _leaves = NULL;
+        _segment_keys = NULL;
+        _segments = NULL;
+        _nleaf = 0;
+        _nsegment = 0;
+    }
+private:
+    const Tree *_tree;
+    size_t _epsilon;
+    size_t _version{0};
+    size_t _fallbacks{0};
+    size_t _nleaf{0};
+    key_type *_fences{NULL};
+    const leaf_node_type **_leaves{NULL};
+    size_t _nsegment{0};
+    /* first fence of every segment, apart from the segments for a denser binary search */
+    key_type *_segment_keys{NULL};
+    Segment *_segments{NULL};
+
+    /* leaf number of x, the last fence not greater than x */
+    size_t predict(const key_type &x) const;
+};
+} /* namespace mem_container */
+
+/* place for implementation */
+
+using namespace mem_container;
+
+template <typename Tree>
+void LearnedIndex<Tree>::train()
+{
+    destroy();
+    _version = _tree->structure_version();
+    _fallbacks = 0;
+    _tree->visit_leaves([this](const leaf_node_type *, const key_type *) { ++_nleaf; });
+    if (_nleaf == 0) {
+        return;
+    }
+    _fences = (key_type *)malloc(sizeof(key_type) * _nleaf);
+    _leaves = (const leaf_node_type **)malloc(sizeof(leaf_node_type *) * _nleaf);
+    size_t n = 0;
+    /* the first leaf takes every key below its fence, so its first key serves as one */
+    _tree->visit_leaves([this, &n](const leaf_node_type *leaf, const key_type *low) {
+        _fences[n] = low ? *low : leaf->key[0];
+        _leaves[n++] = leaf;
+    });
+
+    /* segments are at most as many as leaves, the arrays are shrunk afterwards */
+    _segment_keys = (key_type *)malloc(sizeof(key_type) * _nleaf);
+    _segments = (Segment *)malloc(sizeof(Segment) * _nleaf);
+    const double epsilon = double(_epsilon);
+    size_t first = 0;
+    double lo = 0;
+    double hi = std::numeric_limits<double>::infinity();
+    for (size_t i = 1; i <= _nleaf; ++i) {
+        if (i < _nleaf) {
+            /* slopes through the first point that keep point i within epsilon */
+            double dx = double(_fences[i]) - double(_fences[first]);
+            double dy = double(i - first);
+            if (dx <= 0 && dy <= epsilon) {
+                continue;
+            }
+            double next_lo = dx > 0 ? std::max(lo, (dy - epsilon) / dx) : hi;
+            double next_hi = dx > 0 ? std::min(hi, (dy + epsilon) / dx) : lo;
+            if (next_lo <= next_hi) {
+                lo = next_lo;
+                hi = next_hi;
+                continue;
+            }
+        }
+        _segment_keys[_nsegment] = _fences[first];
+        _segments[_nsegment++] = Segment{hi == std::numeric_limits<double>::infinity() ? 0 : (lo + hi) / 2, first};
+        first = i;
+        lo = 0;
+        hi = std::numeric_limits<double>::infinity();
+    }
+    _segment_keys = (key_type *)realloc(_segment_keys, sizeof(key_type) * _nsegment);
+    _segments = (Segment *)realloc(_segments, sizeof(Segment) * _nsegment);
+}
+
+template <typename Tree>
+size_t LearnedIndex<Tree>::predict(const key_type &x) const
+{
+    size_t s = bptree_helper::count_before<BPTreeSearch::Binary, true>(_segment_keys, _nsegment, x);
+    s = s > 0 ? s - 1 : 0;
+    const Segment &segment = _segments[s];
+    size_t end = s + 1 < _nsegment ? _segments[s + 1].first : _nleaf;
+    double guess = double(segment.first) + segment.slope * (double(x) - double(_segment_keys[s]));
+    size_t center = size_t(std::min(std::max(guess, double(segment.first)), double(end - 1)));
+    /* a key between two fences is predicted between their predictions, one more on each side */
+    size_t begin = center > segment.first + _epsilon + 1 ? center - _epsilon - 1 : segment.first;
+    size_t stop = std::min(center + _epsilon + 2, end);
+    size_t n = bptree_helper::count_before<BPTreeSearch::Binary, true>(_fences + begin, stop - begin, x);
+    /* rounding on huge keys may push the answer out of the window, the segment bounds it anyway */
+    if ((n == 0 && begin > segment.first) || (n == stop - begin && stop < end)) {
+        begin = segment.first;
+        n = bptree_helper::count_before<BPTreeSearch::Binary, true>(_fences + begin, end - begin, x);
+    }
+    return begin + n > 0 ? begin + n - 1 : 0;
+}
+
+template <typename Tree>
+const typename LearnedIndex<Tree>::value_type *LearnedIndex<Tree>::search(const key_type &x)
+{
+    if (!valid()) {
+        ++_fallbacks;
+        return _tree->search(x);
+    }
+    if (_nleaf == 0) {
+        return NULL;
+    }
+    const leaf_node_type *leaf = _leaves[predict(x)];
+    size_t i = leaf->item_index_of(x);
+    return i < leaf->size && leaf->key[i] == x ? &leaf->values[i] : NULL;
+}
+
+#endif /* CONTAINER_BPTREE_LEARNED_INDEX_H */
@@ -0,0 +1,384 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * fixed size object pool for tree nodes, thread unsafe
+ */
+
+#ifndef CONTAINER_BPTREE_NODE_POOL_H
+#define CONTAINER_BPTREE_NODE_POOL_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif /* __linux__ */
+
+#include "../definition.h"
+
+namespace mem_container {
+/*
+ * objects are carved from slabs with a bump pointer. every slab is aligned to its size, a power
+ * of two, and keeps the objects freed in it in an intrusive free list, reused before the bump
+ * pointer moves on. a slab goes back as soon as all of its objects are released, the rest when
+ * the pool is destroyed.
+ * pools may share their slabs after share or absorb and release objects into each other, the
+ * slabs left go back once every pool sharing them is destroyed. those pools must not allocate
+ * concurrently, and have to agree on huge pages.
+ * huge page slabs are 2MiB aligned and advised for transparent huge pages
+ */
+template <typename T, size_t SLAB_BYTES = 64 * 1024>
+class NodePool {
+public:
+    constexpr static const size_t huge_page_size = 2 * 1024 * 1024;
+
+    explicit NodePool(bool huge_page = false) : _huge_page(huge_page) {}
+    NodePool(const NodePool &) = delete;
+    NodePool &operator=(const NodePool &) = delete;
+    NodePool(NodePool &&other) { swap(other); }
+    NodePool &operator=(NodePool &&other)
+    {
+        if (this != &other) {
+            destroy();
+            swap(other);
+        }
+        return *this;
+    }
+    ~NodePool()
+    {
+#ifndef NO_DESTROYER
+        destroy();
+#endif /* NO_DESTROYER */
+    }
+    void swap(NodePool &other)
+    {
+        std::swap(_arena, other._arena);
+        std::swap(_huge_page, other._huge_page);
+    }
+
+    /* uninitialized storage for one T */
+    inline void *alloc()
+    {
+        Arena *owner = arena();
+        Slab *slab = owner->partial;
+        if (!slab) {
+            return bump(owner);
+        }
+        FreeObject *res = slab->free;
+        slab->free = res->next;
+        ++slab->live;
+        if (!slab->free) {
+            unlink(owner->partial, slab, &Slab::next_partial, &Slab::prev_partial);
+        }
+        return res;
+    }
+    /*
+     * storage skipping the free lists, right after prev when the bump pointer is there and at the
+     * start of a slab otherwise, so that objects placed one after another lie in order
+     */
+    inline void *alloc_after(const void *prev)
+    {
+        Arena *owner = arena();
+        if (owner->cursor != owner->slab_end && owner->cursor != reinterpret_cast<const T *>(prev) + 1 &&
+            owner->cursor != first_object(owner->bump)) {
+            retire_bump(owner);
+        }
+        return bump(owner);
+    }
+    /* T has to be trivially destructible or destroyed already */
+    inline void release(void *obj)
+    {
+        Arena *owner = arena();
+        Slab *slab = slab_of(obj);
+        FreeObject *head = reinterpret_cast<FreeObject *>(obj);
+        head->next = slab->free;
+        if (!slab->free) {
+            link(owner->partial, slab, &Slab::next_partial, &Slab::prev_partial);
+        }
+        slab->free = head;
+        if (--slab->live == 0) {
+            empty(owner, slab);
+        }
+    }
+    /* whether obj is the first object of its slab */
+    inline bool starts_slab(const void *obj) const { return obj == first_object(slab_of(obj)); }
+    inline void set_huge_page(bool huge_page)
+    {
+        CONTAINER_ASSERT(!_arena);
+        _huge_page = huge_page;
+    }
+    /* bytes of the slabs held, together with the pools sharing them */
+    inline size_t bytes() const
+    {
+        const Arena *owner = root();
+        return owner ? owner->bytes : 0;
+    }
+    /* whether other pools hold the slabs too */
+    inline bool shared() const
+    {
+        const Arena *owner = root();
+        return owner && owner->refs > 1;
+    }
+    /* an empty pool carves from the slabs of other from now on */
+    void share(NodePool &other)
+    {
+        CONTAINER_ASSERT(!_arena);
+        _huge_page = other._huge_page;
+        _arena = other.arena();
+        ++_arena->refs;
+    }
+    /*
+     * take over the slabs of other in O(1), objects allocated from them are released here from
+     * now on. other keeps carving from them until it is destroyed
+     */
+    void absorb(NodePool &other)
+    {
+        if (!other._arena) {
+            return;
+        }
+        Arena *mine = arena();
+        Arena *theirs = other.arena();
+        if (mine == theirs) {
+            return;
+        }
+        CONTAINER_ASSERT(_huge_page == other._huge_page);
+        if (theirs->bump) {
+            retire_bump(theirs);
+        }
+        splice(mine->slabs, theirs->slabs, &Slab::next, &Slab::prev);
+        splice(mine->partial, theirs->partial, &Slab::next_partial, &Slab::prev_partial);
+        mine->bytes += theirs->bytes;
+        theirs->slabs = theirs->partial = NULL;
+        theirs->bytes = 0;
+        theirs->parent = mine;
+        mine->refs += theirs->refs;
+        mine->last_record->next_record = theirs;
+        mine->last_record = theirs->last_record;
+    }
+    void destroy();
+private:
+    struct FreeObject { FreeObject *next; };
+    /* slab header, objects follow at the alignment of T */
+    struct Slab {
+        /* every slab of the arena, circular */
+        Slab *next;
+        Slab *prev;
+        /* slabs with free objects, circular */
+        Slab *next_partial;
+        Slab *prev_partial;
+        FreeObject *free;
+        /* objects handed out and not released yet */
+        size_t live;
+    };
+    using Link = Slab *Slab::*;
+    /*
+     * slabs shared by pools, the arenas absorbed into another point to it as parent and are
+     * only kept to be freed with it
+     */
+    struct Arena {
+        Slab *slabs;
+        Slab *partial;
+        /* slab the bump pointer carves from */
+        Slab *bump;
+        T *cursor;
+        T *slab_end;
+        size_t bytes;
+        /* pools holding this arena and every arena absorbed into it */
+        size_t refs;
+        Arena *parent;
+        /* arenas absorbed into this one, freed together */
+        Arena *next_record;
+        Arena *last_record;
+    };
+    constexpr static const size_t header_bytes = (sizeof(Slab) + alignof(T) - 1) / alignof(T) * alignof(T);
+    static constexpr size_t ceil_pow2(size_t n)
+    {
+        size_t res = 1;
+        while (res < n) {
+            res <<= 1;
+        }
+        return res;
+    }
+    constexpr static const size_t small_slab_bytes = ceil_pow2(std::max(SLAB_BYTES, header_bytes + sizeof(T)));
+    static_assert(sizeof(T) >= sizeof(FreeObject), "object too small for the free list");
+
+    Arena *_arena{NULL};
+    bool _huge_page{false};
+
+    inline size_t slab_bytes() const { return _huge_page ? std::max(small_slab_bytes, huge_page_size) : small_slab_bytes; }
+    inline Slab *slab_of(const void *obj) const
+    {
+        return reinterpret_cast<Slab *>(reinterpret_cast<uintptr_t>(obj) & ~uintptr_t(slab_bytes() - 1));
+    }
+    static inline T *first_object(Slab *slab) { return reinterpret_cast<T *>(reinterpret_cast<char *>(slab) + header_bytes); }
+    inline const Arena *root() const
+    {
+        const Arena *owner = _arena;
+        while (owner && owner->parent) {
+            owner = owner->parent;
+        }
+        return owner;
+    }
+    inline void *bump(Arena *owner)
+    {
+        if (owner->cursor == owner->slab_end) {
+            new_slab(owner);
+        }
+        ++owner->bump->live;
+        return owner->cursor++;
+    }
+    static void link(Slab *&head, Slab *slab, Link next, Link prev)
+    {
+        if (head) {
+            slab->*next = head;
+            slab->*prev = head->*prev;
+            (head->*prev)->*next = slab;
+            head->*prev = slab;
+        } else {
+            slab->*next = slab->*prev = slab;
+        }
+        head = slab;
+    }
+    static void unlink(Slab *&head, Slab *slab, Link next, Link prev)
+    {
+        if (slab->*next == slab) {
+            head = NULL;
+            return;
+        }
+        (slab->*prev)->*next = slab->*next;
+        (slab->*next)->*prev = slab->*prev;
+        if (head == slab) {
+            head = slab->*next;
+        }
+    }
+    /* append the circular list other to head */
+    static void splice(Slab *&head, Slab *other, Link next, Link prev)
+    {
+        if (!other) {
+            return;
+        }
+        if (!head) {
+            head = other;
+            return;
+        }
+        Slab *tail = head->*prev;
+        Slab *other_tail = other->*prev;
+        tail->*next = other;
+        other->*prev = tail;
+        other_tail->*next = head;
+        head->*prev = other_tail;
+    }
+    Arena *arena();
+    void new_slab(Arena *owner);
+    void empty(Arena *owner, Slab *slab);
+    void drop(Arena *owner, Slab *slab);
+    void retire_bump(Arena *owner);
+};
+
+template <typename T, size_t SLAB_BYTES>
+typename NodePool<T, SLAB_BYTES>::Arena *NodePool<T, SLAB_BYTES>::arena()
+{
+    if (!_arena) {
+        _arena = (Arena *)malloc(sizeof(Arena));
+        _arena->slabs = _arena->partial = _arena->bump = NULL;
+        _arena->cursor = _arena->slab_end = NULL;
+        _arena->bytes = 0;
+        _arena->refs = 1;
+        _arena->parent = NULL;
+        _arena->next_record = NULL;
+        _arena->last_record = _arena;
+    }
+    while (_arena->parent) {
+        _arena = _arena->parent;
+    }
+    return _arena;
+}
+
+template <typename T, size_t SLAB_BYTES>
+void NodePool<T, SLAB_BYTES>::new_slab(Arena *owner)
+{
+    size_t bytes = slab_bytes();
+    Slab *slab = (Slab *)container_helper::aligned_malloc(bytes, bytes);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (_huge_page) {
+        madvise(slab, bytes, MADV_HUGEPAGE);
+    }
+#endif /* __linux__ && MADV_HUGEPAGE */
+    slab->free = NULL;
+    slab->live = 0;
+    link(owner->slabs, slab, &Slab::next, &Slab::prev);
+    owner->bytes += bytes;
+    owner->bump = slab;
+    owner->cursor = first_object(slab);
+    owner->slab_end = owner->cursor + (bytes - header_bytes) / sizeof(T);
+}
+
+/* the bump slab starts over, any other slab goes back */
+template <typename T, size_t SLAB_BYTES>
+void NodePool<T, SLAB_BYTES>::empty(Arena *owner, Slab *slab)
+{
+    if (slab != owner->bump) {
+        drop(owner, slab);
+        return;
+    }
+    unlink(owner->partial, slab, &Slab::next_partial, &Slab::prev_partial);
+    slab->free = NULL;
+    owner->cursor = first_object(slab);
+}
+
+template <typename T, size_t SLAB_BYTES>
+void NodePool<T, SLAB_BYTES>::drop(Arena *owner, Slab *slab)
+{
+    if (slab->free) {
+        unlink(owner->partial, slab, &Slab::next_partial, &Slab::prev_partial);
+    }
+    unlink(owner->slabs, slab, &Slab::next, &Slab::prev);
+    owner->bytes -= slab_bytes();
+    container_helper::aligned_free(slab);
+}
+
+/* the bump pointer leaves its slab, the objects never carved go to the free list */
+template <typename T, size_t SLAB_BYTES>
+void NodePool<T, SLAB_BYTES>::retire_bump(Arena *owner)
+{
+    Slab *slab = owner->bump;
+    T *cursor = owner->cursor;
+    T *slab_end = owner->slab_end;
+    owner->bump = NULL;
+    owner->cursor = owner->slab_end = NULL;
+    if (slab->live == 0) {
+        drop(owner, slab);
+        return;
+    }
+    for (; cursor != slab_end; ++cursor) {
+        FreeObject *head = reinterpret_cast<FreeObject *>(cursor);
+        head->next = slab->free;
+        if (!slab->free) {
+            link(owner->partial, slab, &Slab::next_partial, &Slab::prev_partial);
+        }
+        slab->free = head;
+    }
+}
+
+template <typename T, size_t SLAB_BYTES>
+void NodePool<T, SLAB_BYTES>::destroy()
+{
+    if (_arena && --arena()->refs == 0) {
+        if (_arena->slabs) {
+            _arena->slabs->prev->next = NULL;
+        }
+        while (_arena->slabs) {
+            Slab *next = _arena->slabs->next;
+            container_helper::aligned_free(_arena->slabs);
+            _arena->slabs = next;
+        }
+        while (_arena) {
+            Arena *next = _arena->next_record;
+            free(_arena);
+            _arena = next;
+        }
+    }
+    _arena = NULL;
+}
+} /* namespace mem_container */
+
+#endif /* CONTAINER_BPTREE_NODE_POOL_H */
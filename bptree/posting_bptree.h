@@ -0,0 +1,579 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * B+ Tree multimap from a key to many row ids, kept as compressed posting lists, thread unsafe
+ */
+
+#ifndef CONTAINER_BPTREE_POSTING_BPTREE_H
+#define CONTAINER_BPTREE_POSTING_BPTREE_H
+
+#include <new>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include "../definition.h"
+#include "bptree.h"
+
+namespace mem_container {
+namespace bptree_helper {
+/* bits needed for x, 0 for 0 */
+inline size_t bit_width(uint64_t x) { return x ? 64 - __builtin_clzll(x) : 0; }
+inline size_t packed_words(size_t n, size_t width) { return (n * width + 63) / 64; }
+/* value i of an array packed with width bits each, values may straddle two words */
+inline uint64_t unpack_bits(const uint64_t *words, size_t i, size_t width)
+{
+    if (width == 0) {
+        return 0;
+    }
+    size_t bit = i * width;
+    size_t off = bit % 64;
+    uint64_t res = words[bit / 64] >> off;
+    if (off + width > 64) {
+        res |= words[bit / 64 + 1] << (64 - off);
+    }
+    return width == 64 ? res : res & ((uint64_t(1) << width) - 1);
+}
+/* words have to be zeroed where value i goes */
+inline void pack_bits(uint64_t *words, size_t i, size_t width, uint64_t x)
+{
+    if (width == 0) {
+        return;
+    }
+    size_t bit = i * width;
+    size_t off = bit % 64;
+    words[bit / 64] |= x << off;
+    if (off + width > 64) {
+        words[bit / 64 + 1] |= x >> (64 - off);
+    }
+}
+} /* namespace bptree_helper */
+
+/*
+ * ascending unique row ids stored as the first id and the gaps to the ids before, minus one, bit
+ * packed with the width of the largest gap. a short list lives inline in the 64 bits of the value
+ * itself. a long one moves out of line into blocks of block_size ids, each with its own width and
+ * with its first and last id kept aside, so a seek skips whole blocks without unpacking them.
+ * the newest ids of a long list wait unpacked in a tail until they fill a block.
+ * appending an id above the last is O(1) amortized, anything else rebuilds the list.
+ * the value is plain data moved around by the tree, destroy() releases an out of line list
+ */
+template <typename ID>
+struct PostingList {
+    static_assert(std::is_unsigned<ID>::value && sizeof(ID) <= sizeof(uint64_t), "row ids are unsigned integers");
+    constexpr static const size_t block_size = 128;
+    /* ids of an inline list, its gaps share 64 bits */
+    constexpr static const size_t max_inline = 64;
+    struct Block {
+        ID first;
+        ID last;
+        /* packed gaps start at this word */
+        uint32_t offset;
+        uint8_t width;
+    };
+    struct Blocks {
+        Block *blocks;
+        uint32_t nblock;
+        uint32_t block_cap;
+        uint64_t *words;
+        uint32_t nword;
+        uint32_t word_cap;
+        ID tail[block_size];
+        uint32_t ntail;
+    };
+    class Cursor;
+
+    uint32_t count;
+    /* bits per gap of an inline list */
+    uint8_t width;
+    bool out_of_line;
+    ID last;
+    union {
+        struct {
+            ID first;
+            uint64_t gaps;
+        } small;
+        Blocks *large;
+    };
+
+    static PostingList make(ID id)
+    {
+        PostingList res;
+        res.count = 1;
+        res.width = 0;
+        res.out_of_line = false;
+        res.last = id;
+        res.small.first = id;
+        res.small.gaps = 0;
+        return res;
+    }
+    /* ids[0, n) ascending and unique, n > 0 */
+    static PostingList build(const ID *ids, size_t n)
+    {
+        PostingList res = make(ids[0]);
+        for (size_t i = 1; i < n; ++i) {
+            res.append(ids[i]);
+        }
+        return res;
+    }
+    void append(ID id);
+    /* visit ids in order as visitor(id), stop once visitor returns false, returns the number visited */
+    template <typename Func>
+    size_t visit(Func &&visitor) const;
+    /* all ids into out, count of them */
+    size_t decode(ID *out) const
+    {
+        size_t n = 0;
+        visit([out, &n](ID id) { out[n++] = id; return true; });
+        return n;
+    }
+    bool contains(ID id) const;
+    /* bytes held out of line */
+    size_t memory_usage() const
+    {
+        return out_of_line ? sizeof(Blocks) + large->block_cap * sizeof(Block) + large->word_cap * sizeof(uint64_t) : 0;
+    }
+    void destroy()
+    {
+        if (out_of_line) {
+            /* both arrays come with the first sealed block */
+            if (large->blocks) {
+                free(large->blocks);
+                free(large->words);
+            }
+            free(large);
+            out_of_line = false;
+        }
+        count = 0;
+    }
+private:
+    void spill();
+    void seal();
+    /* ids of block b of an out of line list into out */
+    static void unpack_block(const Blocks *large, size_t b, ID *out)
+    {
+        const Block &block = large->blocks[b];
+        const uint64_t *words = large->words + block.offset;
+        out[0] = block.first;
+        for (size_t i = 1; i < block_size; ++i) {
+            out[i] = out[i - 1] + ID(bptree_helper::unpack_bits(words, i - 1, block.width)) + 1;
+        }
+    }
+    size_t unpack_inline(ID *out) const
+    {
+        out[0] = small.first;
+        for (size_t i = 1; i < count; ++i) {
+            out[i] = out[i - 1] + ID(bptree_helper::unpack_bits(&small.gaps, i - 1, width)) + 1;
+        }
+        return count;
+    }
+};
+
+/*
+ * walks a posting list in order, one block unpacked at a time. seek skips the blocks that end
+ * below its target by their last id alone
+ */
+template <typename ID>
+class PostingList<ID>::Cursor {
+public:
+    explicit Cursor(const PostingList &list) : _list(&list)
+    {
+        _nsegment = list.out_of_line ? list.large->nblock + (list.large->ntail > 0) : 1;
+        load(0);
+    }
+    inline bool valid() const { return _i < _n; }
+    inline ID value() const { return _ids[_i]; }
+    void next()
+    {
+        if (++_i == _n) {
+            load(_segment + 1);
+        }
+    }
+    /* move to the first id not less than x */
+    void seek(ID x)
+    {
+        if (!valid() || !(_ids[_i] < x)) {
+            return;
+        }
+        if (_ids[_n - 1] < x) {
+            load(find_segment(x));
+            if (!valid()) {
+                return;
+            }
+        }
+        _i = std::lower_bound(_ids + _i, _ids + _n, x) - _ids;
+    }
+private:
+    const PostingList *_list;
+    size_t _nsegment;
+    size_t _segment{0};
+    size_t _n{0};
+    size_t _i{0};
+    ID _ids[block_size];
+
+    /* segments are the blocks and then the tail of an out of line list, or the inline list */
+    void load(size_t segment)
+    {
+        _segment = segment;
+        _i = 0;
+        _n = 0;
+        if (segment >= _nsegment) {
+            return;
+        }
+        if (!_list->out_of_line) {
+            _n = _list->unpack_inline(_ids);
+        } else if (segment < _list->large->nblock) {
+            unpack_block(_list->large, segment, _ids);
+            _n = block_size;
+        } else {
+            _n = _list->large->ntail;
+            memcpy(_ids, _list->large->tail, sizeof(ID) * _n);
+        }
+    }
+    /* first segment after the current one that ends at x or above, _nsegment if none */
+    size_t find_segment(ID x) const
+    {
+        if (!_list->out_of_line) {
+            return _nsegment;
+        }
+        const Blocks *large = _list->large;
+        const Block *begin = large->blocks + std::min<size_t>(_segment + 1, large->nblock);
+        const Block *end = large->blocks + large->nblock;
+        const Block *it = std::lower_bound(begin, end, x, [](const Block &block, ID id) { return block.last < id; });
+        if (it != end) {
+            return it - large->blocks;
+        }
+        return large->ntail > 0 && !(large->tail[large->ntail - 1] < x) ? large->nblock : _nsegment;
+    }
+};
+
+/*
+ * multimap from keys to ascending unique row ids, as a secondary index. every key is stored once
+ * in a BPTree together with its posting list, instead of one composite key per row id
+ */
+template <typename K, typename ID = uint32_t, size_t MAX_BPTREE_NODE_SIZE = 16, BPTreeSearch SEARCH = BPTreeSearch::Auto>
+class PostingBPTree {
+public:
+    using posting_type = PostingList<ID>;
+    using tree_type = BPTree<K, posting_type, MAX_BPTREE_NODE_SIZE, SEARCH>;
+
+    PostingBPTree() = default;
+    PostingBPTree(const PostingBPTree &) = delete;
+    PostingBPTree &operator=(const PostingBPTree &) = delete;
+    ~PostingBPTree()
+    {
+#ifndef NO_DESTROYER
+        destroy();
+#endif /* NO_DESTROYER */
+    }
+
+    /* add id under k, false if it is there already. ids above the last one of k are appended */
+    bool insert(const K &k, ID id);
+    /* drop id from k, a key without ids left is removed */
+    bool remove(const K &k, ID id);
+    inline const posting_type *find(const K &k) const { return _tree.search(k); }
+    inline size_t count(const K &k) const
+    {
+        const posting_type *list = find(k);
+        return list ? list->count : 0;
+    }
+    inline bool contains(const K &k, ID id) const
+    {
+        const posting_type *list = find(k);
+        return list && list->contains(id);
+    }
+    /* ids of k in order as visitor(id), stop once visitor returns false, returns the number visited */
+    template <typename Func>
+    size_t visit(const K &k, Func &&visitor) const
+    {
+        const posting_type *list = find(k);
+        return list ? list->visit(visitor) : 0;
+    }
+    /*
+     * ids under every one of keys[0, n) in order as visitor(id), stop once visitor returns false,
+     * returns the number visited. the cursors leapfrog each other, every seek skips the blocks
+     * below the largest id seen so far
+     */
+    template <typename Func>
+    size_t intersect(const K *keys, size_t n, Func &&visitor) const;
+    /* number of distinct keys */
+    inline size_t keys() const { return _tree.size(); }
+    /* number of (key, id) pairs */
+    inline size_t size() const { return _size; }
+    /* bytes of posting lists held out of line, the tree itself is not counted */
+    size_t posting_bytes() const
+    {
+        size_t res = 0;
+        for (auto it = _tree.cbegin(); it != _tree.cend(); ++it) {
+            res += (*it).memory_usage();
+        }
+        return res;
+    }
+    void destroy()
+    {
+        for (auto it = _tree.begin(); it != _tree.end(); ++it) {
+            (*it).destroy();
+        }
+        _tree.destroy();
+        _size = 0;
+    }
+private:
+    tree_type _tree;
+    size_t _size{0};
+
+    /* replace the ids of list by ids[0, n), or drop k if n is 0 */
+    void rebuild(const K &k, posting_type *list, const ID *ids, size_t n);
+};
+} /* namespace mem_container */
+
+/* place for implementation */
+
+using namespace mem_container;
+
+template <typename ID>
+void PostingList<ID>::append(ID id)
+{
+    CONTAINER_ASSERT(last < id);
+    if (!out_of_line) {
+        uint64_t gap = uint64_t(id - last - 1);
+        size_t new_width = std::max<size_t>(width, bptree_helper::bit_width(gap));
+        if (count < max_inline && count * new_width <= 64) {
+            /* gaps of an inline list never straddle a word, plain shifts place them */
+            if (new_width > width) {
+                /* widen the gaps packed so far */
+                uint64_t gaps = 0;
+                for (size_t i = 0; i + 1 < count; ++i) {
+                    gaps |= bptree_helper::unpack_bits(&small.gaps, i, width) << (i * new_width);
+                }
+                small.gaps = gaps;
+                width = uint8_t(new_width);
+            }
+            if (gap > 0) {
+                small.gaps |= gap << ((count - 1) * width);
+            }
+            ++count;
+            last = id;
+            return;
+        }
+        spill();
+    }
+    large->tail[large->ntail++] = id;
+    ++count;
+    last = id;
+    if (large->ntail == block_size) {
+        seal();
+    }
+}
+
+/* an inline list that is full moves out of line, its ids go to the tail */
+template <typename ID>
+void PostingList<ID>::spill()
+{
+    Blocks *blocks = (Blocks *)malloc(sizeof(Blocks));
+    blocks->blocks = NULL;
+    blocks->nblock = blocks->block_cap = 0;
+    blocks->words = NULL;
+    blocks->nword = blocks->word_cap = 0;
+    blocks->ntail = uint32_t(unpack_inline(blocks->tail));
+    large = blocks;
+    out_of_line = true;
+}
+
+/* a full tail is packed into a new block */
+template <typename ID>
+void PostingList<ID>::seal()
+{
+    const ID *tail = large->tail;
+    uint64_t widest = 0;
+    for (size_t i = 1; i < block_size; ++i) {
+        widest |= uint64_t(tail[i] - tail[i - 1] - 1);
+    }
+    size_t block_width = bptree_helper::bit_width(widest);
+    size_t nword = bptree_helper::packed_words(block_size - 1, block_width);
+    if (large->nblock == large->block_cap) {
+        large->block_cap = std::max<uint32_t>(large->block_cap * 2, 4);
+        /* repalloc does not take NULL */
+        if (large->blocks) {
+            large->blocks = (Block *)realloc(large->blocks, sizeof(Block) * large->block_cap);
+        } else {
+            large->blocks = (Block *)malloc(sizeof(Block) * large->block_cap);
+        }
+    }
+    if (large->nword + nword > large->word_cap) {
+        large->word_cap = std::max<uint32_t>(large->word_cap * 2, large->nword + nword);
+        if (large->words) {
+            large->words = (uint64_t *)realloc(large->words, sizeof(uint64_t) * large->word_cap);
+        } else {
+            large->words = (uint64_t *)malloc(sizeof(uint64_t) * large->word_cap);
+        }
+    }
+    uint64_t *words = large->words + large->nword;
+    memset(words, 0, sizeof(uint64_t) * nword);
+    for (size_t i = 1; i < block_size; ++i) {
+        bptree_helper::pack_bits(words, i - 1, block_width, uint64_t(tail[i] - tail[i - 1] - 1));
+    }
+    large->blocks[large->nblock++] = Block{tail[0], tail[block_size - 1], large->nword, uint8_t(block_width)};
+    large->nword += uint32_t(nword);
+    large->ntail = 0;
+}
+
+template <typename ID>
+template <typename Func>
+size_t PostingList<ID>::visit(Func &&visitor) const
+{
+    ID ids[block_size];
+    size_t res = 0;
+    if (!out_of_line) {
+        size_t n = unpack_inline(ids);
+        for (size_t i = 0; i < n; ++i) {
+            ++res;
+            if (!visitor(ids[i])) {
+                return res;
+            }
+        }
+        return res;
+    }
+    for (size_t b = 0; b <= large->nblock; ++b) {
+        size_t n = large->ntail;
+        const ID *segment = large->tail;
+        if (b < large->nblock) {
+            unpack_block(large, b, ids);
+            n = block_size;
+            segment = ids;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            ++res;
+            if (!visitor(segment[i])) {
+                return res;
+            }
+        }
+    }
+    return res;
+}
+
+template <typename ID>
+bool PostingList<ID>::contains(ID id) const
+{
+    if (last < id) {
+        return false;
+    }
+    Cursor cursor(*this);
+    cursor.seek(id);
+    return cursor.valid() && cursor.value() == id;
+}
+
+template <typename K, typename ID, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH>
+bool PostingBPTree<K, ID, MAX_BPTREE_NODE_SIZE, SEARCH>::insert(const K &k, ID id)
+{
+    posting_type *list = _tree.search(k);
+    if (!list) {
+        _tree.insert(k, posting_type::make(id));
+        ++_size;
+        return true;
+    }
+    if (list->last < id) {
+        list->append(id);
+        ++_size;
+        return true;
+    }
+    if (list->contains(id)) {
+        return false;
+    }
+    ID *ids = (ID *)malloc(sizeof(ID) * (list->count + 1));
+    size_t n = list->decode(ids);
+    size_t pos = std::lower_bound(ids, ids + n, id) - ids;
+    memmove(ids + pos + 1, ids + pos, sizeof(ID) * (n - pos));
+    ids[pos] = id;
+    rebuild(k, list, ids, n + 1);
+    free(ids);
+    ++_size;
+    return true;
+}
+
+template <typename K, typename ID, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH>
+bool PostingBPTree<K, ID, MAX_BPTREE_NODE_SIZE, SEARCH>::remove(const K &k, ID id)
+{
+    posting_type *list = _tree.search(k);
+    if (!list || !list->contains(id)) {
+        return false;
+    }
+    ID *ids = (ID *)malloc(sizeof(ID) * list->count);
+    size_t n = list->decode(ids);
+    size_t pos = std::lower_bound(ids, ids + n, id) - ids;
+    memmove(ids + pos, ids + pos + 1, sizeof(ID) * (n - pos - 1));
+    rebuild(k, list, ids, n - 1);
+    free(ids);
+    --_size;
+    return true;
+}
+
+template <typename K, typename ID, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH>
+void PostingBPTree<K, ID, MAX_BPTREE_NODE_SIZE, SEARCH>::rebuild(const K &k, posting_type *list, const ID *ids, size_t n)
+{
+    list->destroy();
+    if (n == 0) {
+        _tree.remove(k);
+        return;
+    }
+    *list = posting_type::build(ids, n);
+}
+
+template <typename K, typename ID, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH>
+template <typename Func>
+size_t PostingBPTree<K, ID, MAX_BPTREE_NODE_SIZE, SEARCH>::intersect(const K *keys, size_t n, Func &&visitor) const
+{
+    using cursor_type = typename posting_type::Cursor;
+    if (n == 0) {
+        return 0;
+    }
+    const posting_type **lists = (const posting_type **)malloc(sizeof(posting_type *) * n);
+    for (size_t i = 0; i < n; ++i) {
+        lists[i] = find(keys[i]);
+        if (!lists[i]) {
+            free(lists);
+            return 0;
+        }
+    }
+    /* the shortest list leads, its ids are the candidates the others seek to */
+    std::sort(lists, lists + n, [](const posting_type *a, const posting_type *b) { return a->count < b->count; });
+    cursor_type *cursors = (cursor_type *)malloc(sizeof(cursor_type) * n);
+    for (size_t i = 0; i < n; ++i) {
+        new (cursors + i) cursor_type(*lists[i]);
+    }
+    size_t res = 0;
+    ID x = cursors[0].value();
+    /* cursors known to sit on x */
+    size_t agree = 1;
+    for (size_t i = 1 % n;; i = (i + 1) % n) {
+        cursor_type &cursor = cursors[i];
+        if (agree == n) {
+            ++res;
+            if (!visitor(x)) {
+                break;
+            }
+            cursor.next();
+            if (!cursor.valid()) {
+                break;
+            }
+            x = cursor.value();
+            agree = 1;
+            continue;
+        }
+        cursor.seek(x);
+        if (!cursor.valid()) {
+            break;
+        }
+        if (cursor.value() == x) {
+            ++agree;
+        } else {
+            x = cursor.value();
+            agree = 1;
+        }
+    }
+    free(cursors);
+    free(lists);
+    return res;
+}
+
+#endif /* CONTAINER_BPTREE_POSTING_BPTREE_H */
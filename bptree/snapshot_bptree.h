@@ -0,0 +1,488 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * persistent (copy on write) B+ Tree with snapshot readers, writers are serialized
+ */
+
+#ifndef CONTAINER_BPTREE_SNAPSHOT_BPTREE_H
+#define CONTAINER_BPTREE_SNAPSHOT_BPTREE_H
+
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <algorithm>
+
+#include "../definition.h"
+#include "bptree.h"
+
+namespace mem_container {
+/*
+ * published nodes are never modified. a writer copies the nodes on the path to the key it
+ * changes, shares every other subtree with the previous version and publishes the new root
+ * by swapping one pointer, so readers never wait for writers and writers never wait for readers.
+ * a version is the root and the key count of one publication. the tree and every snapshot
+ * hold a reference to their version, and a node is referenced by each parent and version
+ * pointing at it. the last release of a version frees the nodes only it was using, which is
+ * the copied path rather than the whole tree.
+ * leaves have no sibling links as those would have to be copied with every leaf. empty nodes
+ * are dropped, underfull ones are not merged and a root with a single child is collapsed.
+ * a snapshot may outlive later writes but not the tree
+ */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE = 16, BPTreeSearch SEARCH = BPTreeSearch::Auto,
+          size_t MAX_BPTREE_INTERNAL_SIZE = MAX_BPTREE_NODE_SIZE>
+class SnapshotBPTree : public BaseObject {
+public:
+    static_assert(MAX_BPTREE_NODE_SIZE >= 3 && MAX_BPTREE_INTERNAL_SIZE >= 3, "bptree node is too small to split");
+    constexpr static const BPTreeSearch search_strategy =
+        bptree_helper::resolve_search<SEARCH, K, std::max(MAX_BPTREE_NODE_SIZE, MAX_BPTREE_INTERNAL_SIZE)>();
+    /* every split leaves at least two children per internal node and removal never adds a level */
+    constexpr static const size_t max_depth = 64;
+    struct Node {
+        std::atomic<uint32_t> refs{1};
+        uint32_t size{0};
+        bool is_leaf;
+        Node(bool leaf) : is_leaf(leaf) {}
+    };
+    struct InternalNode : public Node, public BaseObject {
+        K key[MAX_BPTREE_INTERNAL_SIZE];
+        Node *ptr[MAX_BPTREE_INTERNAL_SIZE + 1];
+        InternalNode() : Node(false) {}
+
+        inline size_t child_index_of(const K &x) const
+        {
+            return bptree_helper::count_before<search_strategy, true>(key, this->size, x);
+        }
+    };
+    struct LeafNode : public Node, public BaseObject {
+        K key[MAX_BPTREE_NODE_SIZE];
+        V values[MAX_BPTREE_NODE_SIZE];
+        LeafNode() : Node(true) {}
+
+        inline size_t item_index_of(const K &x) const
+        {
+            return bptree_helper::count_before<search_strategy, false>(key, this->size, x);
+        }
+    };
+    using node_type = Node;
+    using internal_node_type = InternalNode;
+    using leaf_node_type = LeafNode;
+    struct Version : public BaseObject {
+        std::atomic<size_t> refs{1};
+        node_type *root;
+        size_t size;
+        Version(node_type *r, size_t n) : root(r), size(n) {}
+    };
+
+    /* a consistent read only view of the tree at the time it is taken, released when destroyed */
+    class Snapshot {
+    public:
+        Snapshot() = default;
+        explicit Snapshot(Version *version) : _version(version) {}
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+        Snapshot(Snapshot &&other) : _version(other._version) { other._version = NULL; }
+        Snapshot &operator=(Snapshot &&other)
+        {
+            if (this != &other) {
+                release();
+                _version = other._version;
+                other._version = NULL;
+            }
+            return *this;
+        }
+        ~Snapshot() { release(); }
+
+        /* the value stays valid as long as the snapshot is held */
+        inline const V *search(const K &x) const { return _version ? search_in(_version->root, x) : NULL; }
+        inline bool contains(const K &x) const { return search(x) != NULL; }
+        inline size_t size() const { return _version ? _version->size : 0; }
+        inline bool empty() const { return size() == 0; }
+        /* visit keys in [lo, hi) in order as visitor(key, value), stop once visitor returns false, returns the number visited */
+        template <typename Func>
+        size_t scan(const K &lo, const K &hi, Func &&visitor) const
+        {
+            size_t res = 0;
+            if (_version && _version->root && lo < hi) {
+                scan_in(_version->root, lo, hi, visitor, res);
+            }
+            return res;
+        }
+        inline void release()
+        {
+            release_version(_version);
+            _version = NULL;
+        }
+    private:
+        Version *_version{NULL};
+    };
+
+    SnapshotBPTree()
+    {
+        static_assert(std::is_standard_layout<K>::value && std::is_standard_layout<V>::value, "bptree only support pod types");
+        CreateSharedMemCxt();
+    }
+    SnapshotBPTree(const SnapshotBPTree &) = delete;
+    SnapshotBPTree &operator=(const SnapshotBPTree &) = delete;
+    ~SnapshotBPTree()
+    {
+#ifndef NO_DESTROYER
+        destroy();
+#endif /* NO_DESTROYER */
+    }
+
+    /* O(1), readers only take a short lock to pin the current version */
+    Snapshot snapshot() const { return Snapshot(pin()); }
+    std::optional<V> search(const K &x) const
+    {
+        Snapshot view = snapshot();
+        const V *v = view.search(x);
+        return v ? std::optional<V>(*v) : std::nullopt;
+    }
+    inline bool contains(const K &x) const { return search(x).has_value(); }
+    /* false if x exists already, its value is left untouched */
+    bool insert(const K &x, const V &v);
+    bool remove(const K &x);
+    inline size_t size() const { return snapshot().size(); }
+    inline bool empty() const { return size() == 0; }
+    /* versions still held by snapshots are freed by their release */
+    void destroy()
+    {
+        publish(NULL);
+        DestroyMemCxt();
+    }
+private:
+    struct Path {
+        internal_node_type *node[max_depth];
+        size_t index[max_depth];
+        size_t depth{0};
+    };
+
+    MemCxtHolder;
+    std::atomic<Version *> _current{NULL};
+    /* covers loading the current version and taking a reference on it against the swap */
+    mutable std::mutex _pin_lock;
+    std::mutex _write_lock;
+
+    Version *pin() const
+    {
+        std::lock_guard<std::mutex> guard(_pin_lock);
+        Version *version = _current.load(std::memory_order_acquire);
+        if (version) {
+            version->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        return version;
+    }
+    /* make version current and drop the reference of the tree on the previous one */
+    void publish(Version *version)
+    {
+        Version *old;
+        {
+            std::lock_guard<std::mutex> guard(_pin_lock);
+            old = _current.exchange(version, std::memory_order_acq_rel);
+        }
+        release_version(old);
+    }
+    leaf_node_type *descend(node_type *root, const K &x, Path &path) const;
+    /* copy of parent with the child at pos replaced, the other children gain a reference */
+    internal_node_type *copy_internal(const internal_node_type *parent, size_t pos, node_type *child);
+    void replace_path(Path &path, node_type *left, const K &split_key, node_type *right, size_t size);
+    void remove_path(Path &path, node_type *replacement, size_t size);
+
+    static const V *search_in(const node_type *cursor, const K &x);
+    template <typename Func>
+    static bool scan_in(const node_type *cursor, const K &lo, const K &hi, Func &visitor, size_t &res);
+    static void release_node(node_type *node);
+    static inline void release_version(Version *version)
+    {
+        if (version && version->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (version->root) {
+                release_node(version->root);
+            }
+            delete version;
+        }
+    }
+
+    inline leaf_node_type *new_leaf() { return NEW leaf_node_type(); }
+    inline internal_node_type *new_internal() { return NEW internal_node_type(); }
+    static inline void free_node(node_type *node)
+    {
+        if (node->is_leaf) {
+            delete static_cast<leaf_node_type *>(node);
+        } else {
+            delete static_cast<internal_node_type *>(node);
+        }
+    }
+};
+} /* namespace mem_container */
+
+/* place for implementation */
+
+using namespace mem_container;
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+const V *SnapshotBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::search_in(const node_type *cursor, const K &x)
+{
+    if (!cursor) {
+        return NULL;
+    }
+    while (!cursor->is_leaf) {
+        const internal_node_type *node = static_cast<const internal_node_type *>(cursor);
+        cursor = node->ptr[node->child_index_of(x)];
+    }
+    const leaf_node_type *leaf = static_cast<const leaf_node_type *>(cursor);
+    size_t i = leaf->item_index_of(x);
+    return i < leaf->size && leaf->key[i] == x ? &leaf->values[i] : NULL;
+}
+
+/* in order walk of the children overlapping [lo, hi), false once the visitor stopped or hi is reached */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+template <typename Func>
+bool SnapshotBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::scan_in(const node_type *cursor, const K &lo, const K &hi, Func &visitor, size_t &res)
+{
+    if (cursor->is_leaf) {
+        const leaf_node_type *leaf = static_cast<const leaf_node_type *>(cursor);
+        for (size_t i = leaf->item_index_of(lo); i < leaf->size; ++i) {
+            if (!(leaf->key[i] < hi)) {
+                return false;
+            }
+            ++res;
+            if (!visitor((const K &)leaf->key[i], (const V &)leaf->values[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    const internal_node_type *node = static_cast<const internal_node_type *>(cursor);
+    for (size_t i = node->child_index_of(lo); i <= node->size; ++i) {
+        if (i > 0 && !(node->key[i - 1] < hi)) {
+            return false;
+        }
+        if (!scan_in(node->ptr[i], lo, hi, visitor, res)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+void SnapshotBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::release_node(node_type *node)
+{
+    if (node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (!node->is_leaf) {
+        internal_node_type *internal = static_cast<internal_node_type *>(node);
+        for (size_t i = 0; i <= internal->size; ++i) {
+            release_node(internal->ptr[i]);
+        }
+    }
+    free_node(node);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+typename SnapshotBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::leaf_node_type *SnapshotBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::descend(node_type *cursor, const K &x, Path &path) const
+{
+    while (!cursor->is_leaf) {
+        CONTAINER_ASSERT(path.depth < max_depth);
+        internal_node_type *node = static_cast<internal_node_type *>(cursor);
+        size_t i = node->child_index_of(x);
+        path.node[path.depth] = node;
+        path.index[path.depth++] = i;
+        cursor = node->ptr[i];
+    }
+    return static_cast<leaf_node_type *>(cursor);
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+typename SnapshotBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::internal_node_type *SnapshotBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::copy_internal(const internal_node_type *parent, size_t pos, node_type *child)
+{
+    internal_node_type *node = new_internal();
+    node->size = parent->size;
+    memcpy(node->key, parent->key, sizeof(K) * parent->size);
+    memcpy(node->ptr, parent->ptr, sizeof(node_type *) * (parent->size + 1));
+    for (size_t i = 0; i <= parent->size; ++i) {
+        if (i != pos) {
+            node->ptr[i]->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    node->ptr[pos] = child;
+    return node;
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+bool SnapshotBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::insert(const K &x, const V &v)
+{
+    std::lock_guard<std::mutex> guard(_write_lock);
+    Version *current = _current.load(std::memory_order_relaxed);
+    if (!current) {
+        leaf_node_type *leaf = new_leaf();
+        leaf->key[0] = x;
+        leaf->values[0] = v;
+        leaf->size = 1;
+        publish(NEW Version(leaf, 1));
+        return true;
+    }
+    Path path;
+    leaf_node_type *leaf = descend(current->root, x, path);
+    size_t i = leaf->item_index_of(x);
+    if (i < leaf->size && leaf->key[i] == x) {
+        return false;
+    }
+    leaf_node_type *left = new_leaf();
+    if (leaf->size < MAX_BPTREE_NODE_SIZE) {
+        memcpy(left->key, leaf->key, sizeof(K) * i);
+        memcpy(left->values, leaf->values, sizeof(V) * i);
+        left->key[i] = x;
+        left->values[i] = v;
+        memcpy(left->key + i + 1, leaf->key + i, sizeof(K) * (leaf->size - i));
+        memcpy(left->values + i + 1, leaf->values + i, sizeof(V) * (leaf->size - i));
+        left->size = leaf->size + 1;
+        replace_path(path, left, x, NULL, current->size + 1);
+        return true;
+    }
+    /* the full leaf and x are laid out once and cut into two copies */
+    K keys[MAX_BPTREE_NODE_SIZE + 1];
+    V values[MAX_BPTREE_NODE_SIZE + 1];
+    memcpy(keys, leaf->key, sizeof(K) * i);
+    memcpy(values, leaf->values, sizeof(V) * i);
+    keys[i] = x;
+    values[i] = v;
+    memcpy(keys + i + 1, leaf->key + i, sizeof(K) * (leaf->size - i));
+    memcpy(values + i + 1, leaf->values + i, sizeof(V) * (leaf->size - i));
+    leaf_node_type *right = new_leaf();
+    right->size = (MAX_BPTREE_NODE_SIZE + 1) / 2;
+    left->size = MAX_BPTREE_NODE_SIZE + 1 - right->size;
+    memcpy(left->key, keys, sizeof(K) * left->size);
+    memcpy(left->values, values, sizeof(V) * left->size);
+    memcpy(right->key, keys + left->size, sizeof(K) * right->size);
+    memcpy(right->values, values + left->size, sizeof(V) * right->size);
+    replace_path(path, left, right->key[0], right, current->size + 1);
+    return true;
+}
+
+/*
+ * copy the path bottom up, left replaces the child the path went through and right (if any)
+ * is inserted after it with split_key, then publish the new root
+ */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+void SnapshotBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::replace_path(Path &path, node_type *left, const K &split_key, node_type *right, size_t size)
+{
+    K key = split_key;
+    while (path.depth > 0) {
+        --path.depth;
+        const internal_node_type *parent = path.node[path.depth];
+        size_t pos = path.index[path.depth];
+        if (!right) {
+            left = copy_internal(parent, pos, left);
+            continue;
+        }
+        if (parent->size < MAX_BPTREE_INTERNAL_SIZE) {
+            internal_node_type *node = copy_internal(parent, pos, left);
+            memmove(node->key + pos + 1, node->key + pos, sizeof(K) * (node->size - pos));
+            node->key[pos] = key;
+            memmove(node->ptr + pos + 2, node->ptr + pos + 1, sizeof(node_type *) * (node->size - pos));
+            node->ptr[pos + 1] = right;
+            ++node->size;
+            left = node;
+            right = NULL;
+            continue;
+        }
+        /* the middle key moves up, keys of the right half start after it */
+        K keys[MAX_BPTREE_INTERNAL_SIZE + 1];
+        node_type *ptrs[MAX_BPTREE_INTERNAL_SIZE + 2];
+        memcpy(keys, parent->key, sizeof(K) * pos);
+        keys[pos] = key;
+        memcpy(keys + pos + 1, parent->key + pos, sizeof(K) * (parent->size - pos));
+        memcpy(ptrs, parent->ptr, sizeof(node_type *) * pos);
+        ptrs[pos] = left;
+        ptrs[pos + 1] = right;
+        memcpy(ptrs + pos + 2, parent->ptr + pos + 1, sizeof(node_type *) * (parent->size - pos));
+        for (size_t i = 0; i <= parent->size; ++i) {
+            if (i != pos) {
+                parent->ptr[i]->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        size_t mid = (MAX_BPTREE_INTERNAL_SIZE + 1) / 2;
+        internal_node_type *lnode = new_internal();
+        internal_node_type *rnode = new_internal();
+        lnode->size = mid;
+        memcpy(lnode->key, keys, sizeof(K) * mid);
+        memcpy(lnode->ptr, ptrs, sizeof(node_type *) * (mid + 1));
+        rnode->size = MAX_BPTREE_INTERNAL_SIZE - mid;
+        memcpy(rnode->key, keys + mid + 1, sizeof(K) * rnode->size);
+        memcpy(rnode->ptr, ptrs + mid + 1, sizeof(node_type *) * (rnode->size + 1));
+        key = keys[mid];
+        left = lnode;
+        right = rnode;
+    }
+    if (right) {
+        internal_node_type *root = new_internal();
+        root->key[0] = key;
+        root->ptr[0] = left;
+        root->ptr[1] = right;
+        root->size = 1;
+        left = root;
+    }
+    publish(NEW Version(left, size));
+}
+
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+bool SnapshotBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::remove(const K &x)
+{
+    std::lock_guard<std::mutex> guard(_write_lock);
+    Version *current = _current.load(std::memory_order_relaxed);
+    if (!current) {
+        return false;
+    }
+    Path path;
+    leaf_node_type *leaf = descend(current->root, x, path);
+    size_t i = leaf->item_index_of(x);
+    if (i == leaf->size || !(leaf->key[i] == x)) {
+        return false;
+    }
+    leaf_node_type *copy = NULL;
+    if (leaf->size > 1) {
+        copy = new_leaf();
+        memcpy(copy->key, leaf->key, sizeof(K) * i);
+        memcpy(copy->values, leaf->values, sizeof(V) * i);
+        memcpy(copy->key + i, leaf->key + i + 1, sizeof(K) * (leaf->size - i - 1));
+        memcpy(copy->values + i, leaf->values + i + 1, sizeof(V) * (leaf->size - i - 1));
+        copy->size = leaf->size - 1;
+    }
+    remove_path(path, copy, current->size - 1);
+    return true;
+}
+
+/* copy the path bottom up with the child the path went through replaced, or dropped if replacement is NULL */
+template <typename K, typename V, size_t MAX_BPTREE_NODE_SIZE, BPTreeSearch SEARCH, size_t MAX_BPTREE_INTERNAL_SIZE>
+void SnapshotBPTree<K, V, MAX_BPTREE_NODE_SIZE, SEARCH, MAX_BPTREE_INTERNAL_SIZE>::remove_path(Path &path, node_type *replacement, size_t size)
+{
+    while (path.depth > 0) {
+        --path.depth;
+        const internal_node_type *parent = path.node[path.depth];
+        size_t pos = path.index[path.depth];
+        if (replacement) {
+            replacement = copy_internal(parent, pos, replacement);
+            continue;
+        }
+        if (parent->size == 0) {
+            continue;
+        }
+        /* the key in front of the dropped child goes with it, the first child takes the first key along */
+        internal_node_type *node = copy_internal(parent, pos, NULL);
+        size_t key_pos = pos > 0 ? pos - 1 : 0;
+        memmove(node->key + key_pos, node->key + key_pos + 1, sizeof(K) * (node->size - key_pos - 1));
+        memmove(node->ptr + pos, node->ptr + pos + 1, sizeof(node_type *) * (node->size - pos));
+        --node->size;
+        replacement = node;
+    }
+    /* collapse a root with a single child, the nodes under the copied root may be shared */
+    while (replacement && !replacement->is_leaf && replacement->size == 0) {
+        node_type *root = replacement;
+        replacement = static_cast<internal_node_type *>(root)->ptr[0];
+        replacement->refs.fetch_add(1, std::memory_order_relaxed);
+        release_node(root);
+    }
+    publish(replacement ? NEW Version(replacement, size) : NULL);
+}
+
+#endif /* CONTAINER_BPTREE_SNAPSHOT_BPTREE_H */
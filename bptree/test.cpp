@@ -1,14 +1,34 @@
 #include "../test/test.h"
 
 #include <map>
+#include <set>
+#include <vector>
+#include <malloc.h>
+#include <mutex>
+#include <numeric>
+#include <cstdio>
+#include <string>
+#include <filesystem>
+#include <chrono>
 #include <random>
+#include <thread>
+#include <unistd.h>
 #include "bptree.h"
+#include "concurrent_bptree.h"
+#include "snapshot_bptree.h"
+#include "buffered_bptree.h"
+#include "frozen_bptree.h"
+#include "learned_index.h"
+#include "compressed_bptree.h"
+#include "posting_bptree.h"
+#include "../hashtable/fixed_bytes.h"
+#include "disk_bptree.h"
 
 using namespace mem_container;
 
-template <typename K, typename V>
-static void check_invariant(const BPTree<K, V> &tree) {
-    V prev;
+template <typename Tree>
+static void check_invariant(const Tree &tree) {
+    std::remove_cvref_t<decltype(*tree.cbegin())> prev;
     bool first = true;
     for (auto it = tree.cbegin(); it != tree.cend(); ++it) {
         if (!first) {
@@ -41,6 +61,38 @@ TEST_F(DefaultTest, Simple) {
     optional_destroy(bptree);
 }
 
+/* a run of equal keys spans several leaves, removing through iterators picks the right leaf */
+TEST_F(DefaultTest, DuplicateKeys) {
+    for (bool last : {true, false}) {
+        BPTree<int, int, 4, BPTreeSearch::Auto, 4, false> bptree;
+        for (int i = 0; i < 20; i++) {
+            bptree.insert(1, 1);
+            bptree.insert(9, 9);
+        }
+        for (int i = 0; i < 20; i++) {
+            bptree.insert(5, 5);
+        }
+        for (size_t n = 20; n > 0; n--) {
+            auto victim = bptree.end();
+            size_t count = 0;
+            for (auto it = bptree.begin(); it != bptree.end(); ++it) {
+                if (it.key() == 5) {
+                    count++;
+                    if (last || victim == bptree.end()) {
+                        victim = it;
+                    }
+                }
+            }
+            EXPECT_EQ(count, n);
+            bptree.remove(victim);
+            check_invariant(bptree);
+        }
+        EXPECT_TRUE((bptree.search(5) == NULL));
+        EXPECT_EQ(bptree.size(), 40);
+        optional_destroy(bptree);
+    }
+}
+
 TEST_F(DefaultTest, Random) {
     constexpr size_t N = 1000000;
     int *data = new int[N];
@@ -90,6 +142,2406 @@ TEST_F(DefaultTest, Random) {
     delete[] data;
 }
 
+template <typename Tree, typename K>
+static void random_test(size_t N) {
+    K *data = new K[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = K(i * 3);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+
+    Tree bptree;
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+    }
+    EXPECT_EQ(bptree.size(), N);
+    check_invariant(bptree);
+    for (size_t i = 0; i < N; i++) {
+        auto *v = bptree.search(data[i]);
+        EXPECT_TRUE(v != NULL);
+        EXPECT_EQ(*v, data[i]);
+        EXPECT_TRUE(bptree.search(K(data[i] + 1)) == NULL);
+        auto it = bptree.cfind_left(K(data[i] + 1));
+        EXPECT_TRUE(it != bptree.cend());
+        EXPECT_EQ(it.key(), data[i]);
+    }
+    for (size_t i = 0; i < N / 2; i++) {
+        bool res = bptree.remove(data[i]);
+        EXPECT_TRUE(res);
+    }
+    EXPECT_EQ(bptree.size(), N - N / 2);
+    check_invariant(bptree);
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_EQ((bptree.search(data[i]) != NULL), (i >= N / 2));
+    }
+    optional_destroy(bptree);
+    delete[] data;
+}
+
+template <typename Tree>
+static void append_test(size_t N) {
+    std::default_random_engine rand(std::time(NULL));
+    Tree bptree;
+    std::map<int, int> m;
+    auto expect_same = [&]() {
+        EXPECT_EQ(bptree.size(), m.size());
+        auto it = m.begin();
+        for (auto cur = bptree.cbegin(); cur != bptree.cend(); ++cur, ++it) {
+            EXPECT_EQ(cur.key(), it->first);
+            EXPECT_EQ(*cur, it->second);
+        }
+        EXPECT_TRUE(it == m.end());
+    };
+    /* ascending keys with gaps, some given end() as hint */
+    for (size_t i = 0; i < N; i++) {
+        int k = int(i * 3);
+        if (i % 5 == 0) {
+            bptree.insert_hint(bptree.end(), k, k);
+        } else {
+            bptree.insert(k, k);
+        }
+        m[k] = k;
+    }
+    expect_same();
+    /* the largest keys go away while their separators stay, appends land below them */
+    int top = int((N - 1) * 3);
+    for (int k = top; k > top - int(N / 4); --k) {
+        EXPECT_EQ(bptree.remove(k), (m.erase(k) == 1));
+    }
+    for (int k = top - int(N / 4) + 1; k <= top; k += 2) {
+        bptree.insert(k, k);
+        m[k] = k;
+    }
+    expect_same();
+    /* gaps filled with the next key as hint, wrong hints fall back to a plain insert */
+    for (size_t i = 0; i < N / 2; i++) {
+        int k = int(rand() % (N / 2)) * 3 + 1 + int(rand() % 2);
+        if (m.count(k)) {
+            continue;
+        }
+        auto hint = i % 7 == 0 ? bptree.begin() : bptree.find_left(k);
+        if (i % 7 != 0 && hint != bptree.end()) {
+            ++hint;
+        }
+        bptree.insert_hint(hint, k, k);
+        m[k] = k;
+        if (i % 3 == 0) {
+            int x = int(rand() % (N * 3));
+            EXPECT_EQ(bptree.remove(x), (m.erase(x) == 1));
+        }
+    }
+    expect_same();
+    check_invariant(bptree);
+    for (auto &pair : m) {
+        EXPECT_EQ(*bptree.search(pair.first), pair.second);
+    }
+    for (auto &pair : m) {
+        EXPECT_TRUE(bptree.remove(pair.first));
+    }
+    EXPECT_TRUE(bptree.empty());
+    bptree.insert_hint(bptree.end(), 1, 1);
+    bptree.insert(2, 2);
+    bptree.insert_hint(bptree.begin(), 0, 0);
+    EXPECT_EQ(bptree.size(), 3);
+    EXPECT_EQ(bptree.cbegin().key(), 0);
+    optional_destroy(bptree);
+}
+
+TEST_F(DefaultTest, Append) {
+    constexpr size_t N = 100000;
+    append_test<BPTree<int, int>>(N);
+    append_test<BPTree<int, int, 4, BPTreeSearch::Linear, 3>>(N);
+    append_test<BPTree<int, int, 32, BPTreeSearch::Auto, 8, true>>(N);
+    append_test<AugmentedBPTree<int, long, SumMonoid<long>>>(N);
+}
+
+/* monotonic keys against a vector push, leaf fill is the number of keys over leaf capacity */
+TEST_F(DefaultTest, BenchmarkAppend) {
+    constexpr size_t N = 10000000;
+    Vector<int, false> vec;
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        vec.push_back(int(i));
+    }
+    std::cout << "Vector push: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    auto leaf_fill = [](auto &tree, size_t capacity) {
+        size_t leaves = 0;
+        const void *prev = NULL;
+        for (auto it = tree.cbegin(); it != tree.cend(); ++it) {
+            leaves += it.node != prev;
+            prev = it.node;
+        }
+        return tree.size() / double(leaves * capacity);
+    };
+    BPTree<int, int> append;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        append.insert(int(i), int(i));
+    }
+    std::cout << "Append insert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s, leaf fill "
+              << leaf_fill(append, 16) << std::endl;
+    BPTree<int, int> hinted;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        hinted.insert_hint(hinted.end(), int(i), int(i));
+    }
+    std::cout << "Hinted insert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    /* the augmented tree takes the regular path with even splits */
+    AugmentedBPTree<int, long, SumMonoid<long>> descend;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        descend.insert(int(i), int(i));
+    }
+    std::cout << "Descending insert (augmented): " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s, leaf fill "
+              << leaf_fill(descend, 16) << std::endl;
+    EXPECT_EQ(append.size(), N);
+    EXPECT_EQ(hinted.size(), N);
+    EXPECT_EQ(*append.search(int(N / 2)), int(N / 2));
+    optional_destroy(append);
+    optional_destroy(hinted);
+    optional_destroy(descend);
+}
+
+TEST_F(DefaultTest, SearchStrategy) {
+    constexpr size_t N = 100000;
+    random_test<BPTree<int, int, 16, BPTreeSearch::Linear>, int>(N);
+    random_test<BPTree<int, int, 16, BPTreeSearch::Binary>, int>(N);
+    random_test<BPTree<int, int, 16, BPTreeSearch::Simd>, int>(N);
+    random_test<BPTree<int, int, 64, BPTreeSearch::Binary>, int>(N);
+    random_test<BPTree<int, int, 64, BPTreeSearch::Simd>, int>(N);
+    random_test<BPTree<int, int, 255, BPTreeSearch::Simd>, int>(N);
+    random_test<BPTree<uint32_t, uint32_t, 64, BPTreeSearch::Simd>, uint32_t>(N);
+    random_test<BPTree<long, long, 64, BPTreeSearch::Simd>, long>(N);
+    random_test<BPTree<uint64_t, uint64_t, 37, BPTreeSearch::Simd>, uint64_t>(N);
+    random_test<BPTree<double, double, 64, BPTreeSearch::Binary>, double>(N);
+}
+
+template <size_t NODE_SIZE, BPTreeSearch SEARCH>
+static void benchmark_search(const char *name, const int *data, size_t N) {
+    BPTree<int, int, NODE_SIZE, SEARCH> bptree;
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+    }
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        auto *v = bptree.search(data[i]);
+        EXPECT_EQ(*v, data[i]);
+    }
+    std::cout << name << " " << NODE_SIZE << ": " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    optional_destroy(bptree);
+}
+
+template <size_t NODE_SIZE>
+static void benchmark_search(const int *data, size_t N) {
+    benchmark_search<NODE_SIZE, BPTreeSearch::Linear>("Linear", data, N);
+    benchmark_search<NODE_SIZE, BPTreeSearch::Binary>("Binary", data, N);
+    benchmark_search<NODE_SIZE, BPTreeSearch::Simd>("Simd", data, N);
+}
+
+TEST_F(DefaultTest, BenchmarkSearch) {
+    constexpr size_t N = 2000000;
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    benchmark_search<16>(data, N);
+    benchmark_search<64>(data, N);
+    benchmark_search<128>(data, N);
+    benchmark_search<256>(data, N);
+
+    std::map<int, int> m;
+    for (size_t i = 0; i < N; i++) {
+        m.insert(std::pair<int, int>(data[i], data[i]));
+    }
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_EQ(m.find(data[i])->second, data[i]);
+    }
+    std::cout << "std::map: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    delete[] data;
+}
+
+template <typename Tree>
+static void interleaved_test(size_t N) {
+    Tree bptree;
+    int *keys = new int[2 * N];
+    for (size_t i = 0; i < 2 * N; i++) {
+        keys[i] = int(i);
+        if (i % 2 == 0) {
+            bptree.insert(int(i), int(i) + 1);
+        }
+    }
+    std::shuffle(keys, keys + 2 * N, std::default_random_engine(std::time(NULL)));
+    const int **results = new const int *[2 * N];
+    for (size_t group : {1, 3, 16, 64, 1000}) {
+        bptree.search_batch(keys, 2 * N, results, group);
+        for (size_t i = 0; i < 2 * N; i++) {
+            EXPECT_TRUE((keys[i] % 2 == 0 ? results[i] && *results[i] == keys[i] + 1 : results[i] == NULL));
+        }
+    }
+    bptree.search_batch(keys, 0, results);
+    optional_destroy(bptree);
+    delete[] results;
+    delete[] keys;
+}
+
+TEST_F(DefaultTest, Interleaved) {
+    for (size_t n : {0, 1, 16, 1000, 100000}) {
+        interleaved_test<BPTree<int, int>>(n);
+        interleaved_test<BPTree<int, int, 4, BPTreeSearch::Auto, 3, false>>(n);
+        interleaved_test<PageAlignedBPTree<int, int>>(n);
+    }
+}
+
+/* random lookups on a tree far larger than cache, one at a time and interleaved by group size */
+TEST_F(DefaultTest, BenchmarkInterleaved) {
+    constexpr size_t N = 32000000;
+    constexpr size_t M = 8000000;
+    int *keys = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        keys[i] = int(i * 2);
+    }
+    BPTree<int, int> bptree;
+    bptree.bulk_load(keys, keys, N, 0.7f);
+    /* half of them hit */
+    std::default_random_engine gen(std::time(NULL));
+    std::uniform_int_distribution<int> dist(0, int(N * 2) - 1);
+    for (size_t i = 0; i < M; i++) {
+        keys[i] = dist(gen);
+    }
+    const int **results = new const int *[M];
+    size_t expect = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < M; i++) {
+        results[i] = bptree.search(keys[i]);
+        expect += results[i] != NULL;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "One at a time: " << M / elapsed.count() / 1e6 << "M lookups/s" << std::endl;
+    for (size_t group : {1, 2, 4, 8, 16, 32, 64}) {
+        start = std::chrono::steady_clock::now();
+        bptree.search_batch(keys, M, results, group);
+        size_t found = 0;
+        for (size_t i = 0; i < M; i++) {
+            found += results[i] != NULL;
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Interleaved, group " << group << ": " << M / elapsed.count() / 1e6 << "M lookups/s" << std::endl;
+        EXPECT_EQ(found, expect);
+    }
+    optional_destroy(bptree);
+    delete[] results;
+    delete[] keys;
+}
+
+TEST_F(DefaultTest, NodeLayout) {
+    using cache_tree = CacheAlignedBPTree<int, int>;
+    static_assert(sizeof(cache_tree::leaf_node_type) == 4 * 64);
+    static_assert(sizeof(cache_tree::internal_node_type) == 4 * 64);
+    using page_tree = PageAlignedBPTree<long, long>;
+    static_assert(sizeof(page_tree::leaf_node_type) == 4096);
+    static_assert(sizeof(page_tree::internal_node_type) == 4096);
+    static_assert(alignof(BPTree<int, int>::leaf_node_type) == 64);
+
+    constexpr size_t N = 100000;
+    random_test<cache_tree, int>(N);
+    random_test<page_tree, long>(N);
+    random_test<BPTree<int, int, 5, BPTreeSearch::Auto, 40>, int>(N);
+    random_test<BPTree<int, int, 64, BPTreeSearch::Auto, 3>, int>(N);
+}
+
+template <typename Tree>
+static void benchmark_layout(const char *name, const int *data, size_t N) {
+    Tree bptree;
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+    }
+    std::cout << name << " insert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        auto *v = bptree.search(data[i]);
+        EXPECT_EQ(*v, data[i]);
+    }
+    std::cout << name << " search: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    optional_destroy(bptree);
+}
+
+TEST_F(DefaultTest, BenchmarkNodeLayout) {
+    constexpr size_t N = 2000000;
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    benchmark_layout<BPTree<int, int>>("BPTree 16", data, N);
+    benchmark_layout<CacheAlignedBPTree<int, int, 256>>("4 cache lines", data, N);
+    benchmark_layout<CacheAlignedBPTree<int, int, 1024>>("16 cache lines", data, N);
+    benchmark_layout<PageAlignedBPTree<int, int>>("Page", data, N);
+    delete[] data;
+}
+
+template <typename Tree>
+static void bulk_load_test(size_t N, float fill_factor) {
+    int *keys = new int[N];
+    int *values = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        keys[i] = int(i * 2);
+        values[i] = int(i);
+    }
+    Tree bptree;
+    bptree.bulk_load(keys, values, N, fill_factor);
+    EXPECT_EQ(bptree.size(), N);
+    check_invariant(bptree);
+    size_t i = 0;
+    for (auto it = bptree.cbegin(); it != bptree.cend(); ++it, ++i) {
+        EXPECT_EQ(it.key(), keys[i]);
+        EXPECT_EQ(*it, values[i]);
+    }
+    EXPECT_EQ(i, N);
+    for (i = 0; i < N; i++) {
+        EXPECT_EQ(*bptree.search(keys[i]), values[i]);
+        bptree.insert(keys[i] + 1, 0);
+    }
+    EXPECT_EQ(bptree.size(), N * 2);
+    for (i = 0; i < N; i++) {
+        EXPECT_TRUE(bptree.remove(keys[i]));
+        EXPECT_TRUE(bptree.remove(keys[i] + 1));
+    }
+    EXPECT_TRUE(bptree.empty());
+    optional_destroy(bptree);
+    delete[] keys;
+    delete[] values;
+}
+
+TEST_F(DefaultTest, BulkLoad) {
+    for (size_t n : {0, 1, 3, 17, 100, 1000, 100000}) {
+        for (float fill_factor : {0.f, 0.5f, 0.7f, 1.f}) {
+            bulk_load_test<BPTree<int, int>>(n, fill_factor);
+            bulk_load_test<BPTree<int, int, 3>>(n, fill_factor);
+            bulk_load_test<BPTree<int, int, 5, BPTreeSearch::Auto, 4>>(n, fill_factor);
+            bulk_load_test<CacheAlignedBPTree<int, int>>(n, fill_factor);
+        }
+    }
+}
+
+TEST_F(DefaultTest, BenchmarkBulkLoad) {
+    constexpr size_t N = 5000000;
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    BPTree<int, int> bptree;
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+    }
+    std::cout << "Insert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    BPTree<int, int> loaded;
+    start = std::clock();
+    loaded.bulk_load(data, data, N);
+    std::cout << "Bulk load: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    EXPECT_EQ(loaded.size(), N);
+    optional_destroy(bptree);
+    optional_destroy(loaded);
+    delete[] data;
+}
+
+template <typename K>
+static void frozen_test(size_t N) {
+    K *data = new K[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = K(i * 3 + 1);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    BPTree<K, K> bptree;
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+    }
+    FrozenBPTree<K, K> frozen(bptree);
+    EXPECT_EQ(frozen.size(), N);
+    check_invariant(frozen);
+    /* every key, the gaps around them and the ends */
+    for (size_t i = 0; i <= N; i++) {
+        for (K x : {K(i * 3), K(i * 3 + 1), K(i * 3 + 2)}) {
+            auto it = bptree.cfind(x);
+            auto res = frozen.cfind(x);
+            EXPECT_EQ((it == bptree.cend()), (res == frozen.cend()));
+            EXPECT_EQ((frozen.search(x) != NULL), (it != bptree.cend()));
+            if (it != bptree.cend()) {
+                EXPECT_EQ(res.key(), x);
+                EXPECT_EQ(*frozen.search(x), x);
+            }
+            auto left = bptree.cfind_left(x);
+            auto frozen_left = frozen.cfind_left(x);
+            EXPECT_EQ((left == bptree.cend()), (frozen_left == frozen.cend()));
+            if (left != bptree.cend()) {
+                EXPECT_EQ(frozen_left.key(), left.key());
+                EXPECT_EQ(*frozen_left, *left);
+            }
+        }
+    }
+    for (size_t round = 0; round < 20 && N > 0; ++round) {
+        K lo = data[round % N];
+        K hi = K(lo + K(N / 4));
+        EXPECT_EQ(frozen.scan(lo, hi, [](const K &, const K &) { return true; }),
+                  bptree.scan(lo, hi, [](const K &, const K &) { return true; }));
+    }
+    FrozenBPTree<K, K> moved = freeze(bptree);
+    EXPECT_TRUE(bptree.empty());
+    EXPECT_EQ(moved.size(), N);
+    if (N > 0) {
+        EXPECT_EQ(*moved.search(K(1)), K(1));
+    }
+    frozen = std::move(moved);
+    EXPECT_EQ(frozen.size(), N);
+    EXPECT_TRUE(moved.empty());
+    optional_destroy(frozen);
+    delete[] data;
+}
+
+TEST_F(DefaultTest, Frozen) {
+    /* sizes around block and level boundaries */
+    for (size_t n : {0, 1, 2, 15, 16, 17, 272, 273, 4913, 100000}) {
+        frozen_test<int>(n);
+        frozen_test<unsigned long>(n);
+    }
+    frozen_test<short>(10000);
+}
+
+/* heap in use, large blocks are mapped separately */
+static size_t allocated_bytes() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+/* lookups of existing keys in random order, memory is what malloc handed out for the structure */
+TEST_F(DefaultTest, BenchmarkFrozen) {
+    constexpr size_t N = 10000000;
+    constexpr size_t M = 10000000;
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i * 2);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    size_t found = 0;
+
+    size_t before = allocated_bytes();
+    auto *bptree = new BPTree<int, int, 16, BPTreeSearch::Auto, 16, false>();
+    for (size_t i = 0; i < N; i++) {
+        bptree->insert(data[i], data[i]);
+    }
+    size_t tree_bytes = allocated_bytes() - before;
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < M; i++) {
+        found += bptree->search(data[i]) != NULL;
+    }
+    std::cout << "BPTree search: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s, "
+              << tree_bytes / (1 << 20) << "MiB" << std::endl;
+
+    before = allocated_bytes();
+    auto *frozen = new FrozenBPTree<int, int>(*bptree);
+    size_t frozen_bytes = allocated_bytes() - before;
+    start = std::clock();
+    for (size_t i = 0; i < M; i++) {
+        found -= frozen->search(data[i]) != NULL;
+    }
+    std::cout << "Frozen search: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s, "
+              << frozen_bytes / (1 << 20) << "MiB" << std::endl;
+    EXPECT_EQ(found, 0);
+    delete bptree;
+    delete frozen;
+
+    before = allocated_bytes();
+    auto *map = new std::map<int, int>();
+    for (size_t i = 0; i < N; i++) {
+        map->emplace(data[i], data[i]);
+    }
+    size_t map_bytes = allocated_bytes() - before;
+    start = std::clock();
+    for (size_t i = 0; i < M; i++) {
+        found += map->find(data[i]) != map->end();
+    }
+    std::cout << "std::map find: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s, "
+              << map_bytes / (1 << 20) << "MiB" << std::endl;
+    EXPECT_EQ(found, M);
+    delete map;
+    delete[] data;
+}
+
+template <typename K>
+static void learned_test(size_t N, size_t epsilon) {
+    K *data = new K[N];
+    for (size_t i = 0; i < N; i++) {
+        /* dense runs and wide gaps, so that there are several segments, data[i] + 2 is never a key */
+        data[i] = K(((i / 100) * 1000 + (i % 100) * ((i / 100) % 3 + 1)) * 4 + 4);
+    }
+    BPTree<K, K> bptree;
+    bptree.bulk_load(data, data, N, 0.5);
+    LearnedIndex<BPTree<K, K>> learned(bptree, epsilon);
+    EXPECT_TRUE(learned.valid());
+    EXPECT_TRUE((learned.segments() <= learned.leaves()));
+    /* every key, the gaps around them and the ends */
+    for (size_t i = 0; i < N; i++) {
+        for (K x : {K(data[i] - 1), data[i], K(data[i] + 1)}) {
+            const K *res = learned.search(x);
+            const K *expected = bptree.search(x);
+            EXPECT_EQ((res == NULL), (expected == NULL));
+            if (expected) {
+                EXPECT_EQ(*res, *expected);
+            }
+        }
+    }
+    EXPECT_FALSE(learned.contains(K(0)));
+    EXPECT_FALSE(learned.contains(std::numeric_limits<K>::max()));
+    EXPECT_EQ(learned.fallbacks(), 0);
+
+    /* leaves were filled half, a few inserts keep them and are seen by the model */
+    size_t fallbacks = 0;
+    if (N > 0) {
+        bptree.insert(K(data[N - 1] + 1), K(data[N - 1] + 1));
+        fallbacks += !learned.valid();
+        EXPECT_EQ(*learned.search(K(data[N - 1] + 1)), K(data[N - 1] + 1));
+    }
+    /* splits outdate the model, lookups fall back to a descent */
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(K(data[i] + 2), K(data[i] + 2));
+    }
+    bool outdated = !learned.valid();
+    EXPECT_TRUE((outdated || N < 1000));
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_EQ(*learned.search(K(data[i] + 2)), *bptree.search(K(data[i] + 2)));
+    }
+    EXPECT_EQ(learned.fallbacks(), (outdated ? N + fallbacks : fallbacks));
+    learned.train();
+    EXPECT_TRUE(learned.valid());
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_EQ(*learned.search(data[i]), data[i]);
+        EXPECT_EQ(*learned.search(K(data[i] + 2)), K(data[i] + 2));
+    }
+    EXPECT_EQ(learned.fallbacks(), 0);
+    for (size_t i = 0; i < N; i++) {
+        bptree.remove(data[i]);
+    }
+    learned.train();
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_TRUE(learned.search(data[i]) == NULL);
+        EXPECT_EQ(*learned.search(K(data[i] + 2)), K(data[i] + 2));
+    }
+    optional_destroy(bptree);
+    learned.train();
+    EXPECT_EQ(learned.leaves(), 0);
+    EXPECT_TRUE(learned.search(K(1)) == NULL);
+    delete[] data;
+}
+
+TEST_F(DefaultTest, Learned) {
+    for (size_t n : {0, 1, 2, 16, 17, 1000, 100000}) {
+        for (size_t epsilon : {0, 1, 4, 64}) {
+            learned_test<int>(n, epsilon);
+            learned_test<unsigned long>(n, epsilon);
+        }
+    }
+    learned_test<double>(100000, 4);
+}
+
+static void benchmark_learned(const char *name, long *data, size_t N) {
+    std::sort(data, data + N);
+    N = std::unique(data, data + N) - data;
+    long *values = new long[N];
+    std::iota(values, values + N, 0);
+    BPTree<long, long> bptree;
+    bptree.bulk_load(data, values, N);
+    LearnedIndex<BPTree<long, long>> learned(bptree);
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    size_t found = 0;
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        found += bptree.search(data[i]) != NULL;
+    }
+    double tree_time = (std::clock() - start) / (double)CLOCKS_PER_SEC;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        found -= learned.search(data[i]) != NULL;
+    }
+    double learned_time = (std::clock() - start) / (double)CLOCKS_PER_SEC;
+    EXPECT_EQ(found, 0);
+    std::cout << name << ": " << N << " keys, BPTree search " << tree_time << "s, learned search " << learned_time
+              << "s, " << learned.segments() << " segments over " << learned.leaves() << " leaves, "
+              << learned.memory_usage() / 1024 << "KiB" << std::endl;
+    optional_destroy(bptree);
+    delete[] values;
+}
+
+/* lookups of existing keys in random order on a bulk loaded tree */
+TEST_F(DefaultTest, BenchmarkLearned) {
+    constexpr size_t N = 5000000;
+    long *data = new long[N];
+    std::default_random_engine engine(std::time(NULL));
+
+    std::uniform_int_distribution<long> uniform(0, 1L << 40);
+    for (size_t i = 0; i < N; i++) {
+        data[i] = uniform(engine);
+    }
+    benchmark_learned("Uniform", data, N);
+
+    std::lognormal_distribution<double> lognormal(0, 2);
+    for (size_t i = 0; i < N; i++) {
+        data[i] = long(lognormal(engine) * 1e9);
+    }
+    benchmark_learned("Lognormal", data, N);
+
+    /* dense clusters at random places */
+    std::uniform_int_distribution<long> center(0, 1L << 40);
+    std::normal_distribution<double> spread(0, 1 << 16);
+    long c = 0;
+    for (size_t i = 0; i < N; i++) {
+        if (i % 10000 == 0) {
+            c = center(engine);
+        }
+        data[i] = c + long(spread(engine));
+    }
+    benchmark_learned("Clustered", data, N);
+    delete[] data;
+}
+
+/* integers as they are, byte strings as a shared prefix followed by the big endian number */
+template <typename K>
+static K compressed_key(uint64_t x) {
+    if constexpr (std::is_integral<K>::value) {
+        return K(x);
+    } else {
+        K res;
+        memset(res.data, 'k', K::size());
+        for (size_t i = 0; i < 8; ++i) {
+            res.data[K::size() - 1 - i] = uint8_t(x >> (i * 8));
+        }
+        return res;
+    }
+}
+
+template <typename Tree, typename K>
+static void compressed_test(size_t N) {
+    std::default_random_engine rand(std::time(NULL));
+    /* runs of close keys with wide jumps in between, so leaves take every width */
+    uint64_t *ids = new uint64_t[N];
+    uint64_t id = 1;
+    for (size_t i = 0; i < N; i++) {
+        id += i % 64 == 0 ? rand() % (1 << 16) + 1 : rand() % 8 + 1;
+        ids[i] = id;
+    }
+    std::shuffle(ids, ids + N, rand);
+    Tree tree;
+    std::map<K, long> m;
+    auto verify = [&]() {
+        EXPECT_EQ(tree.size(), m.size());
+        for (size_t i = 0; i < N; i++) {
+            for (uint64_t x : {ids[i] - 1, ids[i], ids[i] + 1}) {
+                K k = compressed_key<K>(x);
+                auto it = m.find(k);
+                const long *res = tree.search(k);
+                EXPECT_EQ((res != NULL), (it != m.end()));
+                if (res) {
+                    EXPECT_EQ(*res, it->second);
+                }
+            }
+        }
+        auto it = m.begin();
+        EXPECT_EQ(tree.scan(compressed_key<K>(0), compressed_key<K>(id + 2), [&it](const K &k, const long &v) {
+            EXPECT_TRUE((k == it->first));
+            EXPECT_EQ(v, it->second);
+            ++it;
+            return true;
+        }), m.size());
+        if (N > 0) {
+            K lo = compressed_key<K>(ids[0]);
+            K hi = compressed_key<K>(ids[0] + 1000);
+            EXPECT_EQ(tree.scan(lo, hi, [](const K &, const long &) { return true; }),
+                      size_t(std::distance(m.lower_bound(lo), m.lower_bound(hi))));
+        }
+    };
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_TRUE(tree.insert(compressed_key<K>(ids[i]), long(ids[i])));
+        m[compressed_key<K>(ids[i])] = long(ids[i]);
+    }
+    if (N > 0) {
+        EXPECT_FALSE(tree.insert(compressed_key<K>(ids[0]), 0));
+    }
+    verify();
+    for (size_t i = 0; i < N; i += 2) {
+        EXPECT_TRUE(tree.remove(compressed_key<K>(ids[i])));
+        EXPECT_FALSE(tree.remove(compressed_key<K>(ids[i])));
+        m.erase(compressed_key<K>(ids[i]));
+    }
+    verify();
+    /* keys below every fence and inside emptied ranges */
+    for (size_t i = 0; i < N; i += 2) {
+        EXPECT_TRUE(tree.insert(compressed_key<K>(ids[i]), long(ids[i])));
+        m[compressed_key<K>(ids[i])] = long(ids[i]);
+    }
+    EXPECT_TRUE(tree.insert(compressed_key<K>(0), 0));
+    m[compressed_key<K>(0)] = 0;
+    verify();
+    for (auto &entry : m) {
+        EXPECT_TRUE(tree.remove(entry.first));
+    }
+    m.clear();
+    EXPECT_TRUE(tree.empty());
+    EXPECT_EQ(tree.leaves(), 0);
+
+    std::sort(ids, ids + N);
+    K *keys = new K[N];
+    long *values = new long[N];
+    for (size_t i = 0; i < N; i++) {
+        keys[i] = compressed_key<K>(ids[i]);
+        values[i] = long(ids[i]);
+        m[keys[i]] = values[i];
+    }
+    tree.bulk_load(keys, values, N);
+    verify();
+    EXPECT_TRUE((tree.leaves() <= N));
+    optional_destroy(tree);
+    delete[] keys;
+    delete[] values;
+    delete[] ids;
+}
+
+TEST_F(DefaultTest, Compressed) {
+    for (size_t n : {0, 1, 2, 100, 1000, 100000}) {
+        compressed_test<CompressedBPTree<long, long>, long>(n);
+        compressed_test<CompressedBPTree<long, long, 64>, long>(n);
+        compressed_test<CompressedBPTree<unsigned, long>, unsigned>(n);
+        compressed_test<CompressedBPTree<FixedBytes<16>, long>, FixedBytes<16>>(n);
+        compressed_test<CompressedBPTree<FixedBytes<16>, long, 128>, FixedBytes<16>>(n);
+    }
+}
+
+template <typename Compressed, typename Plain, typename K>
+static void benchmark_compressed(const char *name, const K *keys, size_t N) {
+    int *values = new int[N];
+    std::iota(values, values + N, 0);
+    K *lookups = new K[N];
+    memcpy(lookups, keys, sizeof(K) * N);
+    std::shuffle(lookups, lookups + N, std::default_random_engine(std::time(NULL)));
+    size_t found = 0;
+
+    size_t before = allocated_bytes();
+    auto *plain = new Plain();
+    plain->bulk_load(keys, values, N);
+    size_t plain_bytes = allocated_bytes() - before;
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        found += plain->search(lookups[i]) != NULL;
+    }
+    std::cout << name << " BPTree search: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s, "
+              << plain_bytes / (1 << 20) << "MiB" << std::endl;
+    delete plain;
+
+    before = allocated_bytes();
+    auto *compressed = new Compressed();
+    compressed->bulk_load(keys, values, N);
+    size_t compressed_bytes = allocated_bytes() - before;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        found -= compressed->search(lookups[i]) != NULL;
+    }
+    std::cout << name << " compressed search: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s, "
+              << compressed_bytes / (1 << 20) << "MiB, " << N / compressed->leaves() << " keys per leaf" << std::endl;
+    EXPECT_EQ(found, 0);
+    delete compressed;
+    delete[] lookups;
+    delete[] values;
+}
+
+/* ascending ids with small random gaps, bulk loaded, lookups of existing keys in random order */
+TEST_F(DefaultTest, BenchmarkCompressed) {
+    constexpr size_t N = 5000000;
+    std::default_random_engine rand(std::time(NULL));
+    long *ids = new long[N];
+    long id = 1L << 40;
+    for (size_t i = 0; i < N; i++) {
+        id += rand() % 16 + 1;
+        ids[i] = id;
+    }
+    benchmark_compressed<CompressedBPTree<long, int>, BPTree<long, int, 16, BPTreeSearch::Auto, 16, false>>("Delta", ids, N);
+
+    FixedBytes<16> *keys = new FixedBytes<16>[N];
+    for (size_t i = 0; i < N; i++) {
+        keys[i] = compressed_key<FixedBytes<16>>(uint64_t(ids[i]));
+    }
+    benchmark_compressed<CompressedBPTree<FixedBytes<16>, int>, BPTree<FixedBytes<16>, int, 16, BPTreeSearch::Auto, 16, false>>(
+        "Prefix", keys, N);
+    delete[] keys;
+    delete[] ids;
+}
+
+template <typename ID>
+static void posting_test(size_t N, size_t nkey, ID spread) {
+    using Tree = PostingBPTree<int, ID>;
+    std::default_random_engine rand(std::time(NULL));
+    Tree tree;
+    std::map<int, std::set<ID>> m;
+    size_t pairs = 0;
+    auto verify = [&]() {
+        EXPECT_EQ(tree.keys(), m.size());
+        EXPECT_EQ(tree.size(), pairs);
+        for (auto &[k, ids] : m) {
+            EXPECT_EQ(tree.count(k), ids.size());
+            auto it = ids.begin();
+            size_t visited = tree.visit(k, [&](ID id) {
+                EXPECT_TRUE((it != ids.end() && *it == id));
+                ++it;
+                return true;
+            });
+            EXPECT_EQ(visited, ids.size());
+        }
+    };
+
+    /* ids ascending per key are appended, lists spill out of line and fill blocks */
+    ID next = 0;
+    for (size_t i = 0; i < N; i++) {
+        next += ID(rand() % spread + 1);
+        int k = int(rand() % nkey);
+        EXPECT_TRUE(tree.insert(k, next));
+        m[k].insert(next);
+        ++pairs;
+    }
+    verify();
+    /* ids below the last one of a key, some of them present already */
+    for (size_t i = 0; i < N / 4; i++) {
+        int k = int(rand() % nkey);
+        ID id = ID(rand() % (N * spread));
+        bool fresh = m[k].insert(id).second;
+        pairs += fresh;
+        EXPECT_EQ(tree.insert(k, id), fresh);
+        EXPECT_TRUE(tree.contains(k, id));
+    }
+    verify();
+
+    /* every n-way intersection agrees with std::set_intersection */
+    for (size_t n : {1, 2, 3}) {
+        for (size_t round = 0; round < 20; round++) {
+            int keys[3];
+            for (size_t i = 0; i < n; i++) {
+                keys[i] = int(rand() % (nkey + 1));
+            }
+            std::vector<ID> expected;
+            if (m.count(keys[0])) {
+                expected.assign(m[keys[0]].begin(), m[keys[0]].end());
+            }
+            for (size_t i = 1; i < n; i++) {
+                std::vector<ID> both;
+                if (m.count(keys[i])) {
+                    std::set_intersection(expected.begin(), expected.end(), m[keys[i]].begin(), m[keys[i]].end(),
+                                          std::back_inserter(both));
+                }
+                expected.swap(both);
+            }
+            std::vector<ID> got;
+            size_t count = tree.intersect(keys, n, [&](ID id) {
+                got.push_back(id);
+                return true;
+            });
+            EXPECT_EQ(count, expected.size());
+            EXPECT_TRUE((got == expected));
+        }
+    }
+
+    /* removes of present and missing ids, emptied keys disappear */
+    for (size_t i = 0; i < N; i++) {
+        int k = int(rand() % nkey);
+        ID id = m[k].empty() || rand() % 4 == 0 ? ID(rand()) : *m[k].begin();
+        bool present = m[k].erase(id) > 0;
+        pairs -= present;
+        if (m[k].empty()) {
+            m.erase(k);
+        }
+        EXPECT_EQ(tree.remove(k, id), present);
+        EXPECT_FALSE(tree.contains(k, id));
+    }
+    verify();
+    optional_destroy(tree);
+}
+
+TEST_F(DefaultTest, Postings) {
+    for (size_t n : {0, 1, 100, 1000, 20000}) {
+        posting_test<uint32_t>(n, 1, 3);
+        posting_test<uint32_t>(n, 50, 1000);
+        posting_test<uint64_t>(n, 20, 1UL << 40);
+    }
+    /* gaps of every width up to the full id */
+    std::vector<uint64_t> ids{0};
+    PostingList<uint64_t> list = PostingList<uint64_t>::make(0);
+    for (size_t w = 0; w < 64; w++) {
+        ids.push_back(ids.back() + (uint64_t(1) << w));
+        list.append(ids.back());
+        EXPECT_TRUE(list.contains(ids.back()));
+        EXPECT_FALSE((w > 0 && list.contains(ids.back() - 1)));
+    }
+    std::vector<uint64_t> decoded(list.count);
+    EXPECT_EQ(list.decode(decoded.data()), ids.size());
+    EXPECT_TRUE((decoded == ids));
+    list.destroy();
+}
+
+/* secondary index of rows over few keys, row ids ascending as they are added */
+TEST_F(DefaultTest, BenchmarkPostings) {
+    constexpr size_t N = 10000000;
+    constexpr size_t K = 1000;
+    constexpr size_t M = 1000;
+    std::default_random_engine rand(std::time(NULL));
+    uint32_t *keys = new uint32_t[N];
+    for (size_t i = 0; i < N; i++) {
+        keys[i] = uint32_t(rand() % K);
+    }
+    uint32_t *pairs = new uint32_t[M * 2];
+    for (size_t i = 0; i < M * 2; i++) {
+        pairs[i] = uint32_t(rand() % K);
+    }
+    size_t found = 0;
+
+    /* one composite key of key and row per row */
+    size_t before = allocated_bytes();
+    auto *composite = new BPTree<uint64_t, EmptyObject, 16, BPTreeSearch::Auto, 16, false>();
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        composite->insert(uint64_t(keys[i]) << 32 | i, EmptyObject());
+    }
+    double insert_time = (std::clock() - start) / (double)CLOCKS_PER_SEC;
+    size_t composite_bytes = allocated_bytes() - before;
+    start = std::clock();
+    std::vector<uint32_t> a, b;
+    for (size_t i = 0; i < M; i++) {
+        a.clear();
+        b.clear();
+        uint64_t lo = uint64_t(pairs[i * 2]) << 32;
+        composite->scan(lo, lo + (1UL << 32), [&](uint64_t x, const EmptyObject &) {
+            a.push_back(uint32_t(x));
+            return true;
+        });
+        lo = uint64_t(pairs[i * 2 + 1]) << 32;
+        composite->scan(lo, lo + (1UL << 32), [&](uint64_t x, const EmptyObject &) {
+            b.push_back(uint32_t(x));
+            return true;
+        });
+        size_t ai = 0, bi = 0;
+        while (ai < a.size() && bi < b.size()) {
+            if (a[ai] == b[bi]) {
+                ++found;
+                ++ai;
+                ++bi;
+            } else if (a[ai] < b[bi]) {
+                ++ai;
+            } else {
+                ++bi;
+            }
+        }
+    }
+    std::cout << "Composite keys insert: " << insert_time << "s, intersect: " << (std::clock() - start) / (double)CLOCKS_PER_SEC
+              << "s, " << composite_bytes / (1 << 20) << "MiB" << std::endl;
+    delete composite;
+
+    before = allocated_bytes();
+    auto *postings = new PostingBPTree<uint32_t, uint32_t>();
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        postings->insert(keys[i], uint32_t(i));
+    }
+    insert_time = (std::clock() - start) / (double)CLOCKS_PER_SEC;
+    size_t posting_bytes = allocated_bytes() - before;
+    start = std::clock();
+    for (size_t i = 0; i < M; i++) {
+        found -= postings->intersect(pairs + i * 2, 2, [](uint32_t) { return true; });
+    }
+    std::cout << "Posting lists insert: " << insert_time << "s, intersect: " << (std::clock() - start) / (double)CLOCKS_PER_SEC
+              << "s, " << posting_bytes / (1 << 20) << "MiB" << std::endl;
+    EXPECT_EQ(found, 0);
+    delete postings;
+    delete[] pairs;
+    delete[] keys;
+}
+
+TEST_F(DefaultTest, NodePool) {
+    constexpr size_t N = 100000;
+    random_test<BPTree<int, int, 16, BPTreeSearch::Auto, 16, false>, int>(N);
+    random_test<BPTree<int, int, 16, BPTreeSearch::Auto, 16, true>, int>(N);
+    random_test<PageAlignedBPTree<int, int>, int>(N);
+
+    BPTree<int, int> bptree(true);
+    for (int i = 0; i < int(N); i++) {
+        bptree.insert(i, i);
+    }
+    BPTree<int, int> moved(std::move(bptree));
+    EXPECT_TRUE(bptree.empty());
+    for (int i = 0; i < int(N); i++) {
+        EXPECT_EQ(*moved.search(i), i);
+        EXPECT_TRUE(moved.remove(i));
+    }
+    optional_destroy(bptree);
+    optional_destroy(moved);
+}
+
+template <bool POOLED>
+static void benchmark_pool(const char *name, const int *data, size_t N) {
+    BPTree<int, int, 16, BPTreeSearch::Auto, 16, POOLED> bptree;
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+    }
+    std::cout << name << " insert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    for (size_t i = 0; i < N / 2; i++) {
+        bptree.remove(data[i]);
+    }
+    for (size_t i = 0; i < N / 2; i++) {
+        bptree.insert(data[i], data[i]);
+    }
+    std::cout << name << " remove+reinsert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    optional_destroy(bptree);
+    std::cout << name << " destroy: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+}
+
+TEST_F(DefaultTest, BenchmarkNodePool) {
+    constexpr size_t N = 2000000;
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    benchmark_pool<false>("Heap", data, N);
+    benchmark_pool<true>("Pool", data, N);
+    delete[] data;
+}
+
+template <typename Tree>
+static void concurrent_test(size_t N, size_t M) {
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    Tree tree;
+    std::thread *threads = new std::thread[M];
+
+    /* thread t owns data[i] with i % M == t */
+    auto run = [&](auto &&func) {
+        for (size_t t = 0; t < M; ++t) {
+            threads[t] = std::thread([&func, t, M, N]() {
+                for (size_t i = t; i < N; i += M) {
+                    func(i);
+                }
+            });
+        }
+        for (size_t t = 0; t < M; ++t) {
+            threads[t].join();
+        }
+    };
+    run([&](size_t i) {
+        EXPECT_TRUE(tree.insert(data[i], data[i]));
+        EXPECT_FALSE(tree.insert(data[i], -1));
+    });
+    EXPECT_EQ(tree.thread_unsafe_size(), N);
+    /* odd keys stay visible while even keys are removed around them */
+    run([&](size_t i) {
+        if (data[i] % 2 == 0) {
+            EXPECT_TRUE(tree.remove(data[i]));
+            EXPECT_FALSE(tree.search(data[i]).has_value());
+        } else {
+            EXPECT_EQ(tree.search(data[i]).value(), data[i]);
+        }
+    });
+    EXPECT_EQ(tree.thread_unsafe_size(), N - (N + 1) / 2);
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_EQ(tree.search(data[i]).has_value(), (data[i] % 2 == 1));
+    }
+    run([&](size_t i) {
+        EXPECT_EQ(tree.remove(data[i]), (data[i] % 2 == 1));
+    });
+    EXPECT_EQ(tree.thread_unsafe_size(), 0);
+    EXPECT_TRUE(tree.insert(1, 1));
+    optional_destroy(tree);
+    delete[] threads;
+    delete[] data;
+}
+
+template <typename Tree>
+static void range_test(size_t N) {
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i * 2);
+    }
+    std::default_random_engine rand(std::time(NULL));
+    std::shuffle(data, data + N, rand);
+    Tree bptree;
+    std::map<int, int> m;
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+        m[data[i]] = data[i];
+    }
+
+    for (size_t round = 0; round < 200; ++round) {
+        int lo = int(rand() % (2 * N + 10)) - 5;
+        size_t span = round % 3 == 0 ? 10 : round % 3 == 1 ? 1000 : N / 2;
+        int hi = lo + int(rand() % span);
+        auto first = m.lower_bound(lo);
+        auto last = lo < hi ? m.lower_bound(hi) : first;
+        size_t expect = std::distance(first, last);
+
+        auto it = first;
+        EXPECT_EQ(bptree.scan(lo, hi, [&it](const int &k, int &v) {
+            EXPECT_EQ(k, it->first);
+            EXPECT_EQ(v, it->second);
+            ++it;
+            return true;
+        }), expect);
+        size_t count = 0;
+        EXPECT_EQ(bptree.scan(lo, hi, [&count](const int &, const int &) { return ++count < 3; }), std::min<size_t>(expect, 3));
+        it = first;
+        EXPECT_EQ(bptree.scan_spans(lo, hi, [&it](const int *keys, int *values, size_t n) {
+            EXPECT_TRUE((n > 0));
+            for (size_t j = 0; j < n; ++j, ++it) {
+                EXPECT_EQ(keys[j], it->first);
+                EXPECT_EQ(values[j], it->second);
+            }
+            return true;
+        }), expect);
+        size_t spans = 0;
+        count = bptree.scan_spans(lo, hi, [&spans](const int *, const int *, size_t) { return ++spans < 2; });
+        EXPECT_TRUE((count <= expect && spans <= 2));
+
+        if (round % 2 == 1) {
+            EXPECT_EQ(bptree.erase_range(lo, hi), expect);
+            m.erase(first, last);
+            EXPECT_EQ(bptree.size(), m.size());
+            check_invariant(bptree);
+        }
+    }
+    /* leaf links in both directions survive the dropped leaves */
+    size_t count = 0;
+    for (auto it = bptree.find_left(INT32_MAX); it != bptree.end(); --it) {
+        ++count;
+        if (it.node->prev == NULL && it.index == 0) {
+            break;
+        }
+    }
+    EXPECT_EQ(count, m.size());
+    EXPECT_EQ(bptree.erase_range(INT32_MIN, INT32_MAX), m.size());
+    EXPECT_TRUE(bptree.empty());
+    bptree.insert(1, 1);
+    EXPECT_EQ(bptree.size(), 1);
+    optional_destroy(bptree);
+    delete[] data;
+}
+
+TEST_F(DefaultTest, Range) {
+    constexpr size_t N = 100000;
+    range_test<BPTree<int, int>>(N);
+    range_test<BPTree<int, int, 4, BPTreeSearch::Auto, 3, false>>(N);
+    range_test<PageAlignedBPTree<int, int>>(N);
+}
+
+TEST_F(DefaultTest, BenchmarkRange) {
+    constexpr size_t N = 5000000;
+    constexpr int M = 1000000;
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    BPTree<int, int> bptree;
+    BPTree<int, int> ranged;
+    bptree.bulk_load(data, data, N);
+    ranged.bulk_load(data, data, N);
+
+    size_t sum = 0;
+    std::clock_t start = std::clock();
+    for (auto it = bptree.find(M); it != bptree.end() && it.key() < 2 * M; ++it) {
+        sum += *it;
+    }
+    std::cout << "Iterator scan: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    ranged.scan(M, 2 * M, [&sum](const int &, int &v) { sum -= v; return true; });
+    std::cout << "Scan: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    EXPECT_EQ(sum, 0);
+
+    start = std::clock();
+    for (int i = M; i < 2 * M; i++) {
+        bptree.remove(i);
+    }
+    std::cout << "Remove one by one: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    EXPECT_EQ(ranged.erase_range(M, 2 * M), size_t(M));
+    std::cout << "Erase range: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    EXPECT_EQ(bptree.size(), ranged.size());
+    optional_destroy(bptree);
+    optional_destroy(ranged);
+    delete[] data;
+}
+
+template <typename Tree>
+static void partition_test(size_t N) {
+    Tree bptree;
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(int(i * 2), int(i * 2));
+    }
+    typename Tree::Partition parts[64];
+    for (size_t n : {1, 2, 3, 7, 64}) {
+        size_t count = bptree.partition(n, parts);
+        EXPECT_TRUE((count <= n && (count > 0 || N == 0)));
+        /* runs follow each other and cover every key once */
+        int expect = 0;
+        size_t largest = 0;
+        for (size_t i = 0; i < count; ++i) {
+            EXPECT_TRUE((parts[i].first != parts[i].stop));
+            EXPECT_TRUE((i + 1 < count ? parts[i].stop == parts[i + 1].first : parts[i].stop == NULL));
+            size_t keys = 0;
+            for (auto it = parts[i].begin(); it != parts[i].end(); ++it, ++keys) {
+                EXPECT_EQ(it.key(), expect);
+                expect += 2;
+            }
+            EXPECT_EQ(parts[i].scan_spans([](const int *, int *, size_t) { return true; }), keys);
+            largest = std::max(largest, keys);
+        }
+        EXPECT_EQ(size_t(expect), 2 * N);
+        if (N >= 100000) {
+            /* no run takes more than a few times its share */
+            EXPECT_TRUE((count == n && largest < 4 * N / n + 64));
+        }
+    }
+    optional_destroy(bptree);
+}
+
+TEST_F(DefaultTest, Partition) {
+    for (size_t n : {0, 1, 16, 17, 1000, 100000}) {
+        partition_test<BPTree<int, int>>(n);
+        partition_test<BPTree<int, int, 4, BPTreeSearch::Auto, 3, false>>(n);
+        partition_test<PageAlignedBPTree<int, int>>(n);
+    }
+}
+
+/* sums one key at a time, a leaf at a time and split across threads, random inserts scatter the leaves */
+TEST_F(DefaultTest, BenchmarkSpan) {
+    constexpr size_t N = 5000000;
+    constexpr size_t R = 10;
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    BPTree<int, int> bptree;
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+    }
+    long expect = long(N) * (N - 1) / 2 * R;
+
+    long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < R; ++r) {
+        for (auto it = bptree.begin(); it != bptree.end(); ++it) {
+            sum += *it;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Iterator sum: " << elapsed.count() << "s" << std::endl;
+    EXPECT_EQ(sum, expect);
+
+    sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < R; ++r) {
+        bptree.scan(0, int(N), [&sum](const int &, int &v) { sum += v; return true; });
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Scan sum: " << elapsed.count() << "s" << std::endl;
+    EXPECT_EQ(sum, expect);
+
+    sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < R; ++r) {
+        bptree.scan_spans(0, int(N), [&sum](const int *, int *values, size_t n) {
+            long local = 0;
+            for (size_t i = 0; i < n; ++i) {
+                local += values[i];
+            }
+            sum += local;
+            return true;
+        });
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Span sum: " << elapsed.count() << "s" << std::endl;
+    EXPECT_EQ(sum, expect);
+
+    for (size_t nthread : {1, 2, 4}) {
+        BPTree<int, int>::Partition parts[4];
+        size_t count = bptree.partition(nthread, parts);
+        long sums[4] = {0, 0, 0, 0};
+        start = std::chrono::steady_clock::now();
+        std::thread threads[4];
+        for (size_t t = 0; t < count; ++t) {
+            threads[t] = std::thread([&parts, &sums, t]() {
+                for (size_t r = 0; r < R; ++r) {
+                    parts[t].scan_spans([&sums, t](const int *, int *values, size_t n) {
+                        long local = 0;
+                        for (size_t i = 0; i < n; ++i) {
+                            local += values[i];
+                        }
+                        sums[t] += local;
+                        return true;
+                    });
+                }
+            });
+        }
+        for (size_t t = 0; t < count; ++t) {
+            threads[t].join();
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Partitioned span sum, " << count << " threads: " << elapsed.count() << "s" << std::endl;
+        EXPECT_EQ(std::accumulate(sums, sums + count, 0L), expect);
+    }
+    optional_destroy(bptree);
+    delete[] data;
+}
+
+/* tree holds exactly the keys of expect, in both directions */
+template <typename Tree>
+static void expect_content(const Tree &tree, const std::map<int, int> &expect) {
+    EXPECT_EQ(tree.size(), expect.size());
+    tree.check_invariant();
+    auto it = tree.cbegin();
+    for (auto &kv : expect) {
+        EXPECT_TRUE((it != tree.cend()));
+        EXPECT_EQ(it.key(), kv.first);
+        EXPECT_EQ(*it, kv.second);
+        ++it;
+    }
+    EXPECT_TRUE((it == tree.cend()));
+    if (!expect.empty()) {
+        auto back = tree.cfind_left(expect.rbegin()->first);
+        for (auto rit = expect.rbegin(); rit != expect.rend(); ++rit) {
+            EXPECT_EQ(back.key(), rit->first);
+            if (std::next(rit) != expect.rend()) {
+                --back;
+            }
+        }
+    }
+}
+
+template <typename Tree>
+static void split_join_test(size_t N) {
+    Tree bptree;
+    std::map<int, int> expect;
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(int(i * 2), int(i * 2));
+        expect[int(i * 2)] = int(i * 2);
+    }
+    std::default_random_engine gen(std::time(NULL));
+    std::uniform_int_distribution<int> dist(-2, int(N * 2) + 2);
+    const int edges[] = {-1, 0, int(N * 2) - 2, int(N * 2)};
+    /* above every key inserted below a split point */
+    const int top = int(N * 2) + 5;
+    for (size_t round = 0; round < 20; ++round) {
+        int x = round < 4 ? edges[round] : dist(gen);
+        Tree right = bptree.split(x);
+        std::map<int, int> expect_right(expect.lower_bound(x), expect.end());
+        std::map<int, int> expect_left(expect.begin(), expect.lower_bound(x));
+        expect_content(bptree, expect_left);
+        expect_content(right, expect_right);
+        /* both halves keep working as trees, the appends go through the new rightmost leaves */
+        int below = x - 1;
+        if (expect_left.empty() || expect_left.rbegin()->first < below) {
+            bptree.insert(below, below);
+            expect_left[below] = below;
+        }
+        right.insert(top, 1);
+        expect_right[top] = 1;
+        if (!expect_right.empty() && expect_right.begin()->first < top) {
+            int first = expect_right.begin()->first;
+            EXPECT_TRUE(right.remove(first));
+            expect_right.erase(first);
+        }
+        expect_content(bptree, expect_left);
+        expect_content(right, expect_right);
+        bptree.join(right);
+        EXPECT_TRUE(right.empty());
+        expect = expect_left;
+        expect.insert(expect_right.begin(), expect_right.end());
+        expect_content(bptree, expect);
+        /* drop the appended key again, so that the next split can append it */
+        EXPECT_TRUE(bptree.remove(top));
+        expect.erase(top);
+    }
+
+    /* cut into pieces and glue them back, each join grafts a shorter or taller tree */
+    std::vector<Tree> pieces;
+    std::vector<int> cuts;
+    for (size_t i = 0; i < 8; ++i) {
+        cuts.push_back(dist(gen));
+    }
+    std::sort(cuts.begin(), cuts.end(), std::greater<int>());
+    for (int x : cuts) {
+        pieces.push_back(bptree.split(x));
+    }
+    for (auto it = pieces.rbegin(); it != pieces.rend(); ++it) {
+        bptree.join(*it);
+    }
+    expect_content(bptree, expect);
+
+    /* pieces of very different heights */
+    Tree small;
+    small.insert(-10, -10);
+    small.join(bptree);
+    expect[-10] = -10;
+    expect_content(small, expect);
+    EXPECT_TRUE(bptree.empty());
+    Tree tail;
+    tail.insert(int(N * 2) + 10, 1);
+    small.join(tail);
+    expect[int(N * 2) + 10] = 1;
+    expect_content(small, expect);
+    optional_destroy(small);
+}
+
+template <typename Tree>
+static void pooled_join_test(size_t N) {
+    Tree low;
+    Tree high;
+    std::map<int, int> expect;
+    for (size_t i = 0; i < N; i++) {
+        low.insert(int(i), int(i));
+        high.insert(int(N + i * 3), int(i));
+        expect[int(i)] = int(i);
+        expect[int(N + i * 3)] = int(i);
+    }
+    low.join(high);
+    expect_content(low, expect);
+    /* the slabs of high belong to low now */
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_TRUE(low.remove(int(N + i * 3)));
+        expect.erase(int(N + i * 3));
+        low.insert(int(N + i * 3 + 1), 0);
+        expect[int(N + i * 3 + 1)] = 0;
+    }
+    expect_content(low, expect);
+
+    /* the halves of a split share their slabs, the one split off outlives the other */
+    Tree right = low.split(int(N));
+    optional_destroy(low);
+    std::map<int, int> expect_right(expect.lower_bound(int(N)), expect.end());
+    expect_content(right, expect_right);
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_TRUE(right.remove(int(N + i * 3 + 1)));
+        right.insert(int(N + i * 3 + 2), 0);
+    }
+    EXPECT_EQ(right.size(), N);
+    optional_destroy(right);
+}
+
+/* the oldest and newest keys are split off and dropped over and over, the rest reuses their nodes */
+template <typename Tree>
+static void pooled_split_drop_test(size_t N, size_t R) {
+    Tree bptree;
+    int low = 0;
+    int high = 0;
+    for (; high < int(N); ++high) {
+        bptree.insert(high, high);
+    }
+    size_t bound = 0;
+    for (size_t r = 0; r < R; ++r) {
+        for (size_t i = 0; i < N / 10; ++i, ++high) {
+            bptree.insert(high, high);
+        }
+        low += int(N / 20);
+        Tree rest = bptree.split(low);
+        optional_destroy(bptree);
+        bptree = std::move(rest);
+        high -= int(N / 20);
+        Tree top = bptree.split(high);
+        optional_destroy(top);
+        EXPECT_EQ(bptree.size(), N);
+        if (r == 0) {
+            bound = bptree.pool_bytes() * 2;
+        }
+        EXPECT_TRUE((bptree.pool_bytes() <= bound));
+    }
+    int expect = low;
+    for (auto it = bptree.cbegin(); it != bptree.cend(); ++it, ++expect) {
+        EXPECT_EQ(it.key(), expect);
+    }
+    EXPECT_EQ(expect, high);
+    optional_destroy(bptree);
+}
+
+TEST_F(DefaultTest, SplitJoin) {
+    for (size_t n : {0, 1, 2, 16, 17, 1000, 20000}) {
+        split_join_test<BPTree<int, int, 16, BPTreeSearch::Auto, 16, false>>(n);
+        split_join_test<BPTree<int, int, 4, BPTreeSearch::Auto, 3, false>>(n);
+        split_join_test<BPTree<int, int, 5, BPTreeSearch::Auto, 3, false, SumMonoid<long>>>(n);
+        split_join_test<BPTree<int, int, 16, BPTreeSearch::Auto, 16, true>>(n);
+        pooled_join_test<BPTree<int, int, 16, BPTreeSearch::Auto, 16, true>>(n);
+    }
+    pooled_split_drop_test<BPTree<int, int>>(100000, 20);
+    pooled_split_drop_test<BPTree<int, int, 4, BPTreeSearch::Auto, 3, true>>(20000, 20);
+}
+
+/* split and join against moving the keys by hand, both end with the same trees */
+TEST_F(DefaultTest, BenchmarkSplitJoin) {
+    constexpr size_t N = 5000000;
+    constexpr size_t R = 1000;
+    using Tree = BPTree<int, int>;
+    Tree bptree;
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(int(i), int(i));
+    }
+    std::default_random_engine gen(std::time(NULL));
+    std::uniform_int_distribution<int> dist(0, int(N) - 1);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < R; ++r) {
+        Tree right = bptree.split(dist(gen));
+        bptree.join(right);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Split and join, " << R << " times: " << elapsed.count() << "s" << std::endl;
+    EXPECT_EQ(bptree.size(), N);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < 3; ++r) {
+        int x = dist(gen);
+        Tree right;
+        bptree.scan(x, int(N), [&right](const int &k, int &v) { right.insert(k, v); return true; });
+        bptree.erase_range(x, int(N));
+        right.scan(x, int(N), [&bptree](const int &k, int &v) { bptree.insert(k, v); return true; });
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Copy, erase and reinsert, 3 times: " << elapsed.count() << "s" << std::endl;
+    EXPECT_EQ(bptree.size(), N);
+    optional_destroy(bptree);
+}
+
+template <typename Tree>
+static void compact_test(size_t N) {
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i * 2);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    Tree bptree;
+    std::map<int, int> expect;
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+        expect[data[i]] = data[i];
+    }
+    /* sparse leaves scattered over the heap */
+    for (size_t i = 0; i < N * 4 / 5; i++) {
+        EXPECT_TRUE(bptree.remove(data[i]));
+        expect.erase(data[i]);
+    }
+    auto before = bptree.leaf_stats();
+    EXPECT_EQ(before.keys, expect.size());
+
+    /* a few leaves at a time, with updates in between */
+    size_t steps = 0;
+    size_t next = N * 4 / 5;
+    while (!bptree.compact(3)) {
+        ++steps;
+        int k = int(steps * 2 + 1);
+        if (steps % 2 == 0 && next < N) {
+            EXPECT_TRUE(bptree.remove(data[next]));
+            expect.erase(data[next++]);
+        } else if (k < int(N * 2)) {
+            bptree.insert(k, k);
+            expect[k] = k;
+        }
+    }
+    expect_content(bptree, expect);
+    EXPECT_TRUE((N < 1000 || steps > 1));
+    /* a sweep without interruptions lines every leaf up after its predecessor */
+    auto interrupted = bptree.leaf_stats();
+    while (!bptree.compact(64)) {}
+    expect_content(bptree, expect);
+    auto after = bptree.leaf_stats();
+    EXPECT_EQ(after.keys, expect.size());
+    EXPECT_TRUE((after.leaves <= interrupted.leaves));
+    if (N >= 1000) {
+        /* small fanouts stay full after removals, the splits in between may cost them a little */
+        EXPECT_TRUE((before.fill() > 0.6 || interrupted.fill() > before.fill()));
+        EXPECT_TRUE((after.fill() > 0.6));
+        if constexpr (Tree::pooled) {
+            /* besides the first leaf, only a leaf opening a slab of 64KiB does not follow another */
+            EXPECT_TRUE((after.sequential + bptree.pool_bytes() / (64 * 1024) + 1 >= after.leaves));
+        }
+    }
+    if constexpr (Tree::pooled) {
+        /* a sweep may still merge leaves that the last one brought under one parent, settle those */
+        for (size_t leaves = 0; leaves != bptree.leaf_stats().leaves;) {
+            leaves = bptree.leaf_stats().leaves;
+            while (!bptree.compact(64)) {}
+        }
+        /* more sweeps over the compacted tree leave every leaf where it is */
+        std::vector<const void *> placed;
+        bptree.visit_leaves([&placed](const auto *leaf, const int *) { placed.push_back(leaf); });
+        size_t bytes = bptree.pool_bytes();
+        for (size_t r = 0; r < 3; ++r) {
+            while (!bptree.compact(64)) {}
+        }
+        size_t i = 0;
+        bptree.visit_leaves([&placed, &i](const auto *leaf, const int *) { EXPECT_EQ(placed[i++], leaf); });
+        EXPECT_EQ(i, placed.size());
+        EXPECT_EQ(bptree.pool_bytes(), bytes);
+    }
+    for (size_t i = 0; i < N; i++) {
+        int k = int(i * 2);
+        if (!expect.count(k)) {
+            bptree.insert(k, k);
+            expect[k] = k;
+        }
+    }
+    expect_content(bptree, expect);
+    optional_destroy(bptree);
+    delete[] data;
+}
+
+TEST_F(DefaultTest, Compact) {
+    for (size_t n : {0, 1, 16, 17, 1000, 100000}) {
+        compact_test<BPTree<int, int>>(n);
+        compact_test<BPTree<int, int, 16, BPTreeSearch::Auto, 16, false>>(n);
+        compact_test<BPTree<int, int, 4, BPTreeSearch::Auto, 3, true>>(n);
+        compact_test<BPTree<int, int, 5, BPTreeSearch::Auto, 3, false, SumMonoid<long>>>(n);
+    }
+}
+
+/* scans over leaves left behind by removals, before and after compaction */
+TEST_F(DefaultTest, BenchmarkCompact) {
+    constexpr size_t N = 5000000;
+    constexpr size_t R = 10;
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    BPTree<int, int> bptree;
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+    }
+    for (size_t i = 0; i < N * 3 / 4; i++) {
+        bptree.remove(data[i]);
+    }
+    auto scan = [&bptree](const char *name) {
+        auto stats = bptree.leaf_stats();
+        long sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < R; ++r) {
+            bptree.scan_spans(0, int(N), [&sum](const int *, int *values, size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    sum += values[i];
+                }
+                return true;
+            });
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << name << ": " << stats.leaves << " leaves, fill " << stats.fill() << ", in memory order "
+                  << double(stats.sequential) / double(std::max<size_t>(stats.leaves, 1)) << ", scan " << elapsed.count() << "s" << std::endl;
+        return sum;
+    };
+    long expect = scan("Before compaction");
+
+    size_t steps = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (!bptree.compact(1024)) {
+        ++steps;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Compaction, " << steps + 1 << " steps of 1024 leaves: " << elapsed.count() << "s" << std::endl;
+    EXPECT_EQ(scan("After compaction"), expect);
+    optional_destroy(bptree);
+    delete[] data;
+}
+
+template <typename Tree>
+static void augmented_test(size_t N) {
+    using monoid = typename Tree::monoid_type;
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i * 2);
+    }
+    std::default_random_engine rand(std::time(NULL));
+    std::shuffle(data, data + N, rand);
+    Tree bptree;
+    std::map<int, long> m;
+    auto verify = [&]() {
+        EXPECT_EQ(bptree.size(), m.size());
+        for (size_t round = 0; round < 50; ++round) {
+            int x = int(rand() % (2 * N + 10)) - 5;
+            auto it = m.lower_bound(x);
+            size_t rank = std::distance(m.begin(), it);
+            EXPECT_EQ(bptree.rank(x), rank);
+            if (it != m.end()) {
+                EXPECT_EQ(bptree.select(rank).key(), it->first);
+                EXPECT_EQ(bptree.cselect(rank).value(), it->second);
+            } else {
+                EXPECT_TRUE(bptree.select(rank) == bptree.end());
+            }
+            int hi = x + int(rand() % (round % 2 == 0 ? 100 : 2 * N));
+            auto expect = monoid::identity();
+            for (auto j = it; j != m.end() && j->first < hi; ++j) {
+                expect = monoid::combine(expect, monoid::lift(j->first, j->second));
+            }
+            EXPECT_EQ(bptree.aggregate(x, hi), expect);
+        }
+    };
+
+    for (size_t i = 0; i < N; i++) {
+        long v = long(rand() % 1000) - 500;
+        bptree.insert(data[i], v);
+        m[data[i]] = v;
+        if (i % (N / 8) == 0) {
+            verify();
+        }
+    }
+    verify();
+    for (size_t i = 0; i < N / 2; i++) {
+        if (i % 3 == 0) {
+            long v = long(rand() % 1000);
+            EXPECT_TRUE(bptree.update(data[i], v));
+            m[data[i]] = v;
+        } else if (i % 3 == 1) {
+            bptree.remove(bptree.find(data[i]));
+            m.erase(data[i]);
+        } else {
+            EXPECT_TRUE(bptree.remove(data[i]));
+            m.erase(data[i]);
+        }
+        if (i % (N / 8) == 0) {
+            verify();
+        }
+    }
+    verify();
+    for (size_t round = 0; round < 20; ++round) {
+        int lo = int(rand() % (2 * N));
+        int hi = lo + int(rand() % (round % 2 == 0 ? 50 : N / 4));
+        EXPECT_EQ(bptree.erase_range(lo, hi), size_t(std::distance(m.lower_bound(lo), m.lower_bound(hi))));
+        m.erase(m.lower_bound(lo), m.lower_bound(hi));
+        verify();
+    }
+
+    /* bulk loaded annotations match the inserted ones */
+    int *keys = new int[N];
+    long *values = new long[N];
+    m.clear();
+    for (size_t i = 0; i < N; i++) {
+        keys[i] = int(i * 2);
+        values[i] = long(i % 7);
+        m[keys[i]] = values[i];
+    }
+    bptree.bulk_load(keys, values, N, 0.7f);
+    verify();
+    optional_destroy(bptree);
+    delete[] keys;
+    delete[] values;
+    delete[] data;
+}
+
+TEST_F(DefaultTest, Augmented) {
+    constexpr size_t N = 20000;
+    augmented_test<AugmentedBPTree<int, long, SumMonoid<long>, 4>>(N);
+    augmented_test<BPTree<int, long, 5, BPTreeSearch::Auto, 3, false, SumMonoid<long>>>(N);
+    augmented_test<AugmentedBPTree<int, long, MinMonoid<long>>>(N);
+    augmented_test<AugmentedBPTree<int, long, MaxMonoid<long>, 64>>(N);
+    /* plain trees keep an O(1) size as well */
+    BPTree<int, int> plain;
+    for (int i = 0; i < 1000; i++) {
+        plain.insert(i, i);
+    }
+    EXPECT_EQ(plain.size(), 1000);
+    EXPECT_EQ(plain.erase_range(100, 200), 100);
+    EXPECT_EQ(plain.size(), 900);
+    plain.remove(plain.begin());
+    EXPECT_EQ(plain.size(), 899);
+    optional_destroy(plain);
+}
+
+TEST_F(DefaultTest, BenchmarkAugmented) {
+    constexpr size_t N = 5000000;
+    constexpr size_t M = 1000;
+    int *data = new int[N];
+    long *values = new long[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+        values[i] = long(i % 100);
+    }
+    BPTree<int, long> bptree;
+    AugmentedBPTree<int, long, SumMonoid<long>> augmented;
+    bptree.bulk_load(data, values, N);
+    augmented.bulk_load(data, values, N);
+    std::default_random_engine rand(std::time(NULL));
+    int *lo = new int[M];
+    int *hi = new int[M];
+    for (size_t i = 0; i < M; i++) {
+        lo[i] = int(rand() % N);
+        hi[i] = lo[i] + int(rand() % (N / 10));
+    }
+
+    long sum = 0;
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < M; i++) {
+        bptree.scan(lo[i], hi[i], [&sum](const int &, long &v) { sum += v; return true; });
+    }
+    std::cout << "Scan sum: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    for (size_t i = 0; i < M; i++) {
+        sum -= augmented.aggregate(lo[i], hi[i]);
+    }
+    std::cout << "Aggregate sum: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    EXPECT_EQ(sum, 0);
+
+    size_t rank = 0;
+    start = std::clock();
+    for (size_t i = 0; i < M; i++) {
+        rank += bptree.scan(INT32_MIN, lo[i], [](const int &, long &) { return true; });
+    }
+    std::cout << "Scan rank: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    for (size_t i = 0; i < M; i++) {
+        rank -= augmented.rank(lo[i]);
+        EXPECT_EQ(augmented.select(lo[i]).key(), lo[i]);
+    }
+    std::cout << "Rank and select: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    EXPECT_EQ(rank, 0);
+
+    std::shuffle(data, data + N, rand);
+    BPTree<int, long> plain_insert;
+    AugmentedBPTree<int, long, SumMonoid<long>> augmented_insert;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        plain_insert.insert(data[i], 1);
+    }
+    std::cout << "Plain insert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        augmented_insert.insert(data[i], 1);
+    }
+    std::cout << "Augmented insert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    EXPECT_EQ(augmented_insert.aggregate(INT32_MIN, INT32_MAX), long(N));
+    optional_destroy(bptree);
+    optional_destroy(augmented);
+    optional_destroy(plain_insert);
+    optional_destroy(augmented_insert);
+    delete[] lo;
+    delete[] hi;
+    delete[] data;
+    delete[] values;
+}
+
+/* small nodes make deep trees where every write may restructure several levels */
+TEST_F(DefaultTest, BenchmarkDeepTree) {
+    constexpr size_t N = 1000000;
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    BPTree<int, int, 4, BPTreeSearch::Auto, 3> bptree;
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+    }
+    std::cout << "Insert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_TRUE(bptree.remove(data[i]));
+    }
+    std::cout << "Remove: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    EXPECT_TRUE(bptree.empty());
+    optional_destroy(bptree);
+    delete[] data;
+}
+
+TEST_F(DefaultTest, Concurrent) {
+    concurrent_test<ConcurrentBPTree<int, int>>(200000, 4);
+    concurrent_test<ConcurrentBPTree<int, int, 4>>(200000, 8);
+}
+
+/* the same operations on a plain tree serialized by one mutex */
+struct LockedBPTree {
+    BPTree<int, int> tree;
+    std::mutex lock;
+
+    bool insert(int k, int v)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (tree.search(k)) {
+            return false;
+        }
+        tree.insert(k, v);
+        return true;
+    }
+    bool remove(int k)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return tree.remove(k);
+    }
+    std::optional<int> search(int k)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        int *v = tree.search(k);
+        return v ? std::make_optional(*v) : std::nullopt;
+    }
+    template <typename Func>
+    size_t scan(int lo, int hi, Func &&visitor)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return tree.scan(lo, hi, visitor);
+    }
+};
+
+/* M threads on N prefilled keys out of 2N, read_percent of the operations are searches */
+template <typename Tree>
+static void benchmark_concurrent(const char *name, size_t read_percent, size_t N, size_t M, size_t ops) {
+    Tree tree;
+    for (size_t i = 0; i < N; i++) {
+        tree.insert(int(i * 2), int(i * 2));
+    }
+    std::thread *threads = new std::thread[M];
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < M; ++t) {
+        threads[t] = std::thread([&tree, t, N, ops, read_percent]() {
+            std::minstd_rand rand(t + 1);
+            size_t found = 0;
+            for (size_t i = 0; i < ops; ++i) {
+                int k = int(rand() % (2 * N));
+                size_t op = rand() % 100;
+                if (op < read_percent) {
+                    found += tree.search(k).has_value();
+                } else if (op % 2 == 0) {
+                    tree.insert(k, k);
+                } else {
+                    tree.remove(k);
+                }
+            }
+            EXPECT_TRUE(found <= ops);
+        });
+    }
+    for (size_t t = 0; t < M; ++t) {
+        threads[t].join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << name << ": " << elapsed.count() << "s" << std::endl;
+    delete[] threads;
+}
+
+TEST_F(DefaultTest, BenchmarkConcurrent) {
+    constexpr size_t N = 1000000;
+    constexpr size_t M = 8;
+    constexpr size_t OPS = 500000;
+    benchmark_concurrent<LockedBPTree>("Mutex read heavy", 95, N, M, OPS);
+    benchmark_concurrent<ConcurrentBPTree<int, int>>("OLC read heavy", 95, N, M, OPS);
+    benchmark_concurrent<LockedBPTree>("Mutex write heavy", 10, N, M, OPS);
+    benchmark_concurrent<ConcurrentBPTree<int, int>>("OLC write heavy", 10, N, M, OPS);
+}
+
+template <typename Tree>
+static void snapshot_test(size_t N, size_t M) {
+    std::default_random_engine rand(std::time(NULL));
+    Tree tree;
+    std::map<int, int> m;
+    /* every snapshot keeps seeing the content of the time it was taken */
+    std::vector<std::pair<typename Tree::Snapshot, std::map<int, int>>> views;
+    for (size_t i = 0; i < N; i++) {
+        int k = int(rand() % (N / 2));
+        if (rand() % 3 == 0) {
+            EXPECT_EQ(tree.remove(k), (m.erase(k) == 1));
+        } else {
+            EXPECT_EQ(tree.insert(k, int(i)), m.emplace(k, int(i)).second);
+        }
+        if (i % (N / 8) == 0) {
+            views.emplace_back(tree.snapshot(), m);
+        }
+    }
+    views.emplace_back(tree.snapshot(), m);
+    for (auto &[view, expect] : views) {
+        EXPECT_EQ(view.size(), expect.size());
+        auto it = expect.begin();
+        EXPECT_EQ(view.scan(INT_MIN, INT_MAX, [&it](const int &k, const int &v) {
+            EXPECT_EQ(k, it->first);
+            EXPECT_EQ(v, it->second);
+            ++it;
+            return true;
+        }), expect.size());
+        int lo = int(rand() % (N / 2));
+        int hi = lo + int(rand() % (N / 8));
+        EXPECT_EQ(view.scan(lo, hi, [](const int &, const int &) { return true; }),
+                  size_t(std::distance(expect.lower_bound(lo), expect.lower_bound(hi))));
+        for (int k = 0; k < int(N / 2); k += 7) {
+            EXPECT_EQ(view.contains(k), (expect.count(k) == 1));
+        }
+    }
+    views.clear();
+    for (auto &pair : m) {
+        EXPECT_EQ(tree.search(pair.first).value(), pair.second);
+        EXPECT_TRUE(tree.remove(pair.first));
+    }
+    EXPECT_TRUE(tree.empty());
+    EXPECT_FALSE(tree.remove(1));
+
+    /* readers check that every snapshot is a prefix of the inserts, then a suffix of them under removal */
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    std::shuffle(data, data + N, rand);
+    size_t *order = new size_t[N];
+    for (size_t i = 0; i < N; i++) {
+        order[data[i]] = i;
+    }
+    std::atomic<bool> removing{false};
+    std::atomic<bool> done{false};
+    std::thread *threads = new std::thread[M];
+    for (size_t t = 0; t < M; ++t) {
+        threads[t] = std::thread([&]() {
+            while (!done.load()) {
+                bool remove_phase = removing.load();
+                auto view = tree.snapshot();
+                size_t n = view.size();
+                int prev = -1;
+                EXPECT_EQ(view.scan(0, int(N), [&](const int &k, const int &v) {
+                    EXPECT_EQ(k, v);
+                    EXPECT_TRUE(prev < k);
+                    EXPECT_TRUE(remove_phase ? order[k] + n >= N : order[k] < n);
+                    prev = k;
+                    return true;
+                }), n);
+            }
+        });
+    }
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_TRUE(tree.insert(data[i], data[i]));
+    }
+    removing.store(true);
+    for (size_t i = 0; i < N; i++) {
+        EXPECT_TRUE(tree.remove(data[i]));
+    }
+    done.store(true);
+    for (size_t t = 0; t < M; ++t) {
+        threads[t].join();
+    }
+    EXPECT_EQ(tree.size(), 0);
+    EXPECT_TRUE(tree.insert(1, 1));
+    optional_destroy(tree);
+    delete[] threads;
+    delete[] order;
+    delete[] data;
+}
+
+TEST_F(DefaultTest, Snapshot) {
+    snapshot_test<SnapshotBPTree<int, int>>(100000, 2);
+    snapshot_test<SnapshotBPTree<int, int, 3>>(50000, 3);
+    snapshot_test<SnapshotBPTree<int, int, 5, BPTreeSearch::Linear, 4>>(50000, 2);
+}
+
+static size_t full_scan(LockedBPTree &tree) {
+    return tree.scan(INT_MIN, INT_MAX, [](const int &, const int &) { return true; });
+}
+
+static size_t full_scan(SnapshotBPTree<int, int> &tree) {
+    return tree.snapshot().scan(INT_MIN, INT_MAX, [](const int &, const int &) { return true; });
+}
+
+/* one writer on N prefilled keys out of 2N while M threads keep scanning the whole tree */
+template <typename Tree>
+static void benchmark_snapshot(const char *name, size_t N, size_t M, size_t ops) {
+    Tree tree;
+    for (size_t i = 0; i < N; i++) {
+        tree.insert(int(i * 2), int(i * 2));
+    }
+    std::atomic<bool> done{false};
+    std::atomic<size_t> scans{0};
+    std::thread *threads = new std::thread[M];
+    for (size_t t = 0; t < M; ++t) {
+        threads[t] = std::thread([&]() {
+            while (!done.load()) {
+                EXPECT_TRUE(full_scan(tree) >= N / 2);
+                ++scans;
+            }
+        });
+    }
+    std::minstd_rand rand(1);
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> worst(0);
+    for (size_t i = 0; i < ops; ++i) {
+        int k = int(rand() % (2 * N));
+        auto op_start = std::chrono::steady_clock::now();
+        if (rand() % 2 == 0) {
+            tree.insert(k, k);
+        } else {
+            tree.remove(k);
+        }
+        worst = std::max<std::chrono::duration<double>>(worst, std::chrono::steady_clock::now() - op_start);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    done.store(true);
+    for (size_t t = 0; t < M; ++t) {
+        threads[t].join();
+    }
+    std::cout << name << ": " << elapsed.count() << "s for writes (worst " << worst.count() * 1000 << "ms), "
+              << scans.load() << " scans" << std::endl;
+    delete[] threads;
+}
+
+TEST_F(DefaultTest, BenchmarkSnapshot) {
+    constexpr size_t N = 1000000;
+    constexpr size_t OPS = 1000000;
+    benchmark_snapshot<LockedBPTree>("Mutex no scan", N, 0, OPS);
+    benchmark_snapshot<SnapshotBPTree<int, int>>("Snapshot no scan", N, 0, OPS);
+    benchmark_snapshot<LockedBPTree>("Mutex 2 scanners", N, 2, OPS);
+    benchmark_snapshot<SnapshotBPTree<int, int>>("Snapshot 2 scanners", N, 2, OPS);
+}
+
+template <typename Tree>
+static void buffered_test(size_t N) {
+    std::default_random_engine rand(std::time(NULL));
+    Tree bptree;
+    std::map<int, int> m;
+    for (size_t i = 0; i < N; i++) {
+        int k = int(rand() % (N / 2));
+        int v = int(rand());
+        /* deletes come in bursts so that whole leaves are emptied */
+        if ((i / 1000) % 4 == 3 ? rand() % 4 != 0 : rand() % 4 == 0) {
+            bptree.remove(k);
+            m.erase(k);
+        } else {
+            bptree.insert(k, v);
+            m[k] = v;
+        }
+        if (i % 97 == 0) {
+            int x = int(rand() % (N / 2));
+            auto it = m.find(x);
+            auto res = bptree.search(x);
+            EXPECT_EQ(res.has_value(), (it != m.end()));
+            if (res) {
+                EXPECT_EQ(*res, it->second);
+            }
+        }
+    }
+    for (int k = 0; k < int(N / 2); k++) {
+        auto it = m.find(k);
+        auto res = bptree.search(k);
+        EXPECT_EQ(res.has_value(), (it != m.end()));
+        if (res) {
+            EXPECT_EQ(*res, it->second);
+        }
+    }
+    for (size_t round = 0; round < 20; ++round) {
+        int lo = int(rand() % (N / 2));
+        int hi = lo + int(rand() % (N / 4));
+        auto it = m.lower_bound(lo);
+        size_t expect = std::distance(it, m.lower_bound(hi));
+        EXPECT_EQ(bptree.scan(lo, hi, [&it](const int &k, int &v) {
+            EXPECT_EQ(k, it->first);
+            EXPECT_EQ(v, it->second);
+            ++it;
+            return true;
+        }), expect);
+        bptree.insert(lo, lo);
+        m[lo] = lo;
+    }
+    EXPECT_EQ(bptree.size(), m.size());
+    for (auto &pair : m) {
+        bptree.remove(pair.first);
+    }
+    EXPECT_FALSE(bptree.contains(m.begin()->first));
+    EXPECT_EQ(bptree.size(), 0);
+    EXPECT_TRUE(bptree.empty());
+    bptree.insert(1, 1);
+    EXPECT_EQ(*bptree.search(1), 1);
+    optional_destroy(bptree);
+}
+
+TEST_F(DefaultTest, Buffered) {
+    constexpr size_t N = 200000;
+    buffered_test<BufferedBPTree<int, int, 4, 3, 8>>(N);
+    buffered_test<BufferedBPTree<int, int, 5, 4, 1>>(N);
+    buffered_test<BufferedBPTree<int, int>>(N);
+}
+
+/* random inserts into a tree well beyond the cache, then point lookups */
+TEST_F(DefaultTest, BenchmarkBuffered) {
+    constexpr size_t N = 10000000;
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    std::shuffle(data, data + N, std::default_random_engine(std::time(NULL)));
+    BPTree<int, int> bptree;
+    BufferedBPTree<int, int> buffered;
+    std::clock_t start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        bptree.insert(data[i], data[i]);
+    }
+    std::cout << "BPTree insert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        buffered.insert(data[i], data[i]);
+    }
+    buffered.flush();
+    std::cout << "Buffered insert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+
+    size_t found = 0;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        found += bptree.search(data[i]) != NULL;
+    }
+    std::cout << "BPTree search: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    for (size_t i = 0; i < N; i++) {
+        found -= buffered.contains(data[i]);
+    }
+    std::cout << "Buffered search: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    EXPECT_EQ(found, 0);
+    EXPECT_EQ(buffered.size(), N);
+    optional_destroy(bptree);
+    optional_destroy(buffered);
+    delete[] data;
+}
+
+/* a fresh file per call, parallel runs do not share it */
+static std::string temp_file(const char *name) {
+    std::string path = (std::filesystem::temp_directory_path() / name).string() + ".XXXXXX";
+    int fd = mkstemp(&path[0]);
+    EXPECT_TRUE(fd >= 0);
+    close(fd);
+    return path;
+}
+
+template <typename Tree>
+static void disk_test(size_t N, size_t nframe) {
+    std::string path = temp_file("bptree_disk_test");
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i * 2);
+    }
+    std::default_random_engine rand(std::time(NULL));
+    std::shuffle(data, data + N, rand);
+    std::map<int, int> m;
+    {
+        Tree bptree(path.c_str(), nframe);
+        for (size_t i = 0; i < N; i++) {
+            EXPECT_TRUE(bptree.insert(data[i], -data[i]));
+            m[data[i]] = -data[i];
+        }
+        EXPECT_FALSE(bptree.insert(data[0], 0));
+        EXPECT_EQ(bptree.size(), N);
+        for (size_t i = 0; i < N; i++) {
+            int v = 0;
+            EXPECT_TRUE(bptree.search(data[i], v));
+            EXPECT_EQ(v, -data[i]);
+            EXPECT_FALSE(bptree.contains(data[i] + 1));
+        }
+        for (size_t i = 0; i < N; i += 3) {
+            EXPECT_TRUE(bptree.remove(data[i]));
+            EXPECT_FALSE(bptree.remove(data[i]));
+            m.erase(data[i]);
+        }
+        /* whole leaves are emptied and given back */
+        for (int k = int(N / 2); k < int(N); k++) {
+            EXPECT_EQ(bptree.remove(k), (m.erase(k) == 1));
+        }
+        EXPECT_EQ(bptree.size(), m.size());
+        for (size_t round = 0; round < 100; ++round) {
+            int lo = int(rand() % (2 * N));
+            int hi = lo + int(rand() % (round % 2 == 0 ? 100 : N));
+            auto it = m.lower_bound(lo);
+            size_t expect = std::distance(it, m.lower_bound(hi));
+            EXPECT_EQ(bptree.scan(lo, hi, [&it](const int &k, const int &v) {
+                EXPECT_EQ(k, it->first);
+                EXPECT_EQ(v, it->second);
+                ++it;
+                return true;
+            }), expect);
+        }
+        EXPECT_TRUE(bptree.pool().misses() > 0);
+        bptree.destroy();
+    }
+    {
+        /* the content survives reopening */
+        Tree bptree(path.c_str(), nframe, false);
+        EXPECT_EQ(bptree.size(), m.size());
+        for (auto &pair : m) {
+            int v = 0;
+            EXPECT_TRUE(bptree.search(pair.first, v));
+            EXPECT_EQ(v, pair.second);
+        }
+        size_t npage = bptree.pool().page_count();
+        for (auto &pair : m) {
+            EXPECT_TRUE(bptree.remove(pair.first));
+        }
+        EXPECT_TRUE(bptree.empty());
+        /* freed pages are reused before the file grows */
+        for (size_t i = 0; i < N; i++) {
+            EXPECT_TRUE(bptree.insert(data[i], data[i]));
+        }
+        EXPECT_EQ(bptree.pool().page_count(), npage);
+    }
+    std::remove(path.c_str());
+    delete[] data;
+}
+
+TEST_F(DefaultTest, DiskBPTree) {
+    disk_test<DiskBPTree<int, int>>(100000, 8);
+    disk_test<DiskBPTree<int, int, 256>>(50000, 4);
+    disk_test<DiskBPTree<int, int, 512, BPTreeSearch::Linear>>(50000, 64);
+}
+
+/* point and range lookups with the buffer pool holding a part of the pages */
+TEST_F(DefaultTest, BenchmarkDiskBPTree) {
+    constexpr size_t N = 2000000;
+    constexpr size_t M = 1000000;
+    constexpr size_t R = 10000;
+    std::string path = temp_file("bptree_disk_benchmark");
+    int *data = new int[N];
+    for (size_t i = 0; i < N; i++) {
+        data[i] = int(i);
+    }
+    std::default_random_engine rand(std::time(NULL));
+    std::shuffle(data, data + N, rand);
+    size_t npage = 0;
+    {
+        /* large enough to keep every page */
+        DiskBPTree<int, int> bptree(path.c_str(), N / 64);
+        std::clock_t start = std::clock();
+        for (size_t i = 0; i < N; i++) {
+            bptree.insert(data[i], data[i]);
+        }
+        std::cout << "Insert: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+        npage = bptree.pool().page_count();
+    }
+    for (double ratio : {1.0, 0.5, 0.1, 0.01}) {
+        DiskBPTree<int, int> bptree(path.c_str(), size_t(npage * ratio), false);
+        int sum = 0;
+        std::clock_t start = std::clock();
+        for (size_t i = 0; i < M; i++) {
+            int v = 0;
+            bptree.search(data[i], v);
+            sum += v - data[i];
+        }
+        double point = (std::clock() - start) / (double)CLOCKS_PER_SEC;
+        double point_hit = bptree.pool().hits() / (double)(bptree.pool().hits() + bptree.pool().misses());
+        bptree.pool().reset_stats();
+        size_t count = 0;
+        start = std::clock();
+        for (size_t i = 0; i < R; i++) {
+            count += bptree.scan(data[i], data[i] + 1000, [](const int &, const int &) { return true; });
+        }
+        double range = (std::clock() - start) / (double)CLOCKS_PER_SEC;
+        double range_hit = bptree.pool().hits() / (double)(bptree.pool().hits() + bptree.pool().misses());
+        std::cout << "Pool " << ratio * 100 << "% of " << npage << " pages: point " << point << "s (hit " << point_hit
+                  << "), range " << range << "s (hit " << range_hit << ")" << std::endl;
+        EXPECT_EQ(sum, 0);
+        EXPECT_TRUE(count > 0);
+    }
+    std::remove(path.c_str());
+    delete[] data;
+}
+
 TEST_F(DefaultTest, Benchmark1) {
     constexpr size_t N = 5000000;
     int *data = new int[N];
@@ -159,7 +2611,47 @@ TEST_F(DefaultTest, Reference1) {
 
 int main() {
     RUN_TEST(DefaultTest, Simple);
+    RUN_TEST(DefaultTest, DuplicateKeys);
     RUN_TEST(DefaultTest, Random);
+    RUN_TEST(DefaultTest, Append);
+    RUN_TEST(DefaultTest, BenchmarkAppend);
+    RUN_TEST(DefaultTest, SearchStrategy);
+    RUN_TEST(DefaultTest, BenchmarkSearch);
+    RUN_TEST(DefaultTest, Interleaved);
+    RUN_TEST(DefaultTest, BenchmarkInterleaved);
+    RUN_TEST(DefaultTest, NodeLayout);
+    RUN_TEST(DefaultTest, BenchmarkNodeLayout);
+    RUN_TEST(DefaultTest, BulkLoad);
+    RUN_TEST(DefaultTest, BenchmarkBulkLoad);
+    RUN_TEST(DefaultTest, Frozen);
+    RUN_TEST(DefaultTest, BenchmarkFrozen);
+    RUN_TEST(DefaultTest, Learned);
+    RUN_TEST(DefaultTest, BenchmarkLearned);
+    RUN_TEST(DefaultTest, Compressed);
+    RUN_TEST(DefaultTest, BenchmarkCompressed);
+    RUN_TEST(DefaultTest, Postings);
+    RUN_TEST(DefaultTest, BenchmarkPostings);
+    RUN_TEST(DefaultTest, NodePool);
+    RUN_TEST(DefaultTest, BenchmarkNodePool);
+    RUN_TEST(DefaultTest, Range);
+    RUN_TEST(DefaultTest, BenchmarkRange);
+    RUN_TEST(DefaultTest, Partition);
+    RUN_TEST(DefaultTest, BenchmarkSpan);
+    RUN_TEST(DefaultTest, SplitJoin);
+    RUN_TEST(DefaultTest, BenchmarkSplitJoin);
+    RUN_TEST(DefaultTest, Compact);
+    RUN_TEST(DefaultTest, BenchmarkCompact);
+    RUN_TEST(DefaultTest, BenchmarkDeepTree);
+    RUN_TEST(DefaultTest, Augmented);
+    RUN_TEST(DefaultTest, BenchmarkAugmented);
+    RUN_TEST(DefaultTest, Concurrent);
+    RUN_TEST(DefaultTest, BenchmarkConcurrent);
+    RUN_TEST(DefaultTest, Snapshot);
+    RUN_TEST(DefaultTest, BenchmarkSnapshot);
+    RUN_TEST(DefaultTest, Buffered);
+    RUN_TEST(DefaultTest, BenchmarkBuffered);
+    RUN_TEST(DefaultTest, DiskBPTree);
+    RUN_TEST(DefaultTest, BenchmarkDiskBPTree);
     RUN_TEST(DefaultTest, Benchmark1);
     RUN_TEST(DefaultTest, Reference1);
     return 0;
@@ -11,6 +11,8 @@
 #define CONTAINER_USE_POSTGRES_MMGR false
 #define CONTAINER_DEBUG_LEVEL 0
 
+#include <cstdlib>
+
 #if CONTAINER_USE_POSTGRES_MMGR
 #include "utils/palloc.h"
 #define MemCxtHolder MemoryContext _cxt{NULL};
@@ -73,6 +75,21 @@ template <typename T>
 void optional_destroy(T &obj, std::true_type const &) { obj.destroy(); }
 template <typename T>
 void optional_destroy(T &, std::false_type const &) {}
+
+/*
+ * bytes aligned to align, a power of two, for slabs and pages. postgres memory contexts hand
+ * them out with palloc_aligned, release them with aligned_free in either case
+ */
+inline void *aligned_malloc(size_t align, size_t bytes)
+{
+#if CONTAINER_USE_POSTGRES_MMGR
+    return palloc_aligned(bytes, align, 0);
+#else
+    /* aligned_alloc wants a multiple of the alignment */
+    return aligned_alloc(align, (bytes + align - 1) / align * align);
+#endif /* CONTAINER_USE_POSTGRES_MMGR */
+}
+inline void aligned_free(void *ptr) { free(ptr); }
 } /* namespace container_helper */
 
 /* call destroy if the object has a destroy() function */
@@ -0,0 +1,106 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * fixed width byte string key with vectorized compare and hash
+ */
+
+#ifndef CONTAINER_HASHTABLE_FIXED_BYTES_H
+#define CONTAINER_HASHTABLE_FIXED_BYTES_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif /* __SSE2__ */
+
+#include "../definition.h"
+
+namespace mem_container {
+/* plain N bytes, ordered lexicographically like memcmp */
+template <size_t N>
+struct alignas(N % 16 == 0 ? 16 : 1) FixedBytes {
+    static_assert(N > 0, "empty byte string is not a key");
+    uint8_t data[N];
+
+    FixedBytes() = default;
+    explicit FixedBytes(const void *src) { memcpy(data, src, N); }
+
+    constexpr static size_t size() { return N; }
+    inline uint8_t &operator[](size_t idx) { CONTAINER_ASSERT(idx < N); return data[idx]; }
+    inline const uint8_t &operator[](size_t idx) const { CONTAINER_ASSERT(idx < N); return data[idx]; }
+
+    bool operator==(const FixedBytes &other) const;
+    inline bool operator!=(const FixedBytes &other) const { return !(*this == other); }
+    inline bool operator<(const FixedBytes &other) const { return memcmp(data, other.data, N) < 0; }
+    inline bool operator<=(const FixedBytes &other) const { return memcmp(data, other.data, N) <= 0; }
+    inline bool operator>(const FixedBytes &other) const { return other < *this; }
+    inline bool operator>=(const FixedBytes &other) const { return other <= *this; }
+
+    uint64_t hash() const;
+};
+
+template <size_t N>
+bool FixedBytes<N>::operator==(const FixedBytes &other) const
+{
+#if defined(__AVX2__)
+    if constexpr (N % 32 == 0) {
+        __m256i diff = _mm256_setzero_si256();
+        for (size_t i = 0; i < N; i += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(data + i));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(other.data + i));
+            diff = _mm256_or_si256(diff, _mm256_xor_si256(a, b));
+        }
+        return _mm256_testz_si256(diff, diff);
+    }
+#endif /* __AVX2__ */
+#if defined(__SSE2__)
+    if constexpr (N % 16 == 0) {
+        __m128i diff = _mm_setzero_si128();
+        for (size_t i = 0; i < N; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(data + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(other.data + i));
+            diff = _mm_or_si128(diff, _mm_xor_si128(a, b));
+        }
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xFFFF;
+    }
+#endif /* __SSE2__ */
+    return memcmp(data, other.data, N) == 0;
+}
+
+/*
+ * hash 8 bytes per step on independent lanes so the multiplications pipeline,
+ * crc32 instruction is used instead when sse4.2 is available
+ */
+template <size_t N>
+uint64_t FixedBytes<N>::hash() const
+{
+    constexpr size_t nword = N / 8;
+    constexpr size_t nlane = 4;
+    uint64_t lane[nlane] = {0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0x27D4EB2F165667C5ull};
+    for (size_t i = 0; i < nword; ++i) {
+        uint64_t word;
+        memcpy(&word, data + i * 8, 8);
+#if defined(__SSE4_2__)
+        lane[i % nlane] = _mm_crc32_u64(lane[i % nlane], word);
+#else
+        lane[i % nlane] = (lane[i % nlane] ^ word) * 0xFF51AFD7ED558CCDull;
+        lane[i % nlane] ^= lane[i % nlane] >> 32;
+#endif /* __SSE4_2__ */
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + nword * 8, N % 8);
+    uint64_t h = lane[0] ^ (lane[1] << 1 | lane[1] >> 63) ^ (lane[2] << 2 | lane[2] >> 62) ^ (lane[3] << 3 | lane[3] >> 61);
+    h ^= tail + N;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return h;
+}
+} /* namespace mem_container */
+
+template <size_t N>
+struct std::hash<mem_container::FixedBytes<N>> {
+    inline size_t operator()(const mem_container::FixedBytes<N> &key) const { return key.hash(); }
+};
+
+#endif /* CONTAINER_HASHTABLE_FIXED_BYTES_H */
@@ -0,0 +1,193 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * parallel hash aggregation (group by) on top of HashTable
+ */
+
+#ifndef CONTAINER_HASHTABLE_HASH_AGGREGATE_H
+#define CONTAINER_HASHTABLE_HASH_AGGREGATE_H
+
+#include <atomic>
+
+#include "../definition.h"
+#include "../vector/vector.h"
+#include "hashtable.h"
+#include "parallel.h"
+
+namespace mem_container {
+/*
+ * Aggregate is a functor over a pod state_type:
+ *     void operator()(state_type &state, const Input &input) const;
+ *     void merge(state_type &into, const state_type &from) const;
+ * a state starts value initialized.
+ * every worker pre-aggregates its share of rows into a thread local table, once the table
+ * holds local_budget groups it is spilled into hash partitioned buffers and reset in O(1).
+ * partitions are merged in parallel at the end, one result table per partition.
+ */
+template <typename Key, typename Input, typename Aggregate>
+class HashAggregate {
+public:
+    using state_type = typename Aggregate::state_type;
+    using local_table_type = GenerationalHashTable<Key, state_type>;
+    using table_type = HashTable<Key, state_type>;
+    constexpr static const size_t default_local_budget = 16384;
+    constexpr static const size_t default_radix_bits = 6;
+
+    explicit HashAggregate(size_t nthread = 1, size_t local_budget = default_local_budget,
+                           size_t radix_bits = default_radix_bits, Aggregate aggregate = Aggregate())
+        : _nthread(std::max<size_t>(nthread, 1)), _local_budget(local_budget), _radix_bits(radix_bits), _aggregate(aggregate)
+    {
+        static_assert(std::is_standard_layout<Key>::value && std::is_standard_layout<state_type>::value,
+                      "only pod type allowed for hash aggregate");
+    }
+    HashAggregate(const HashAggregate &) = delete;
+    HashAggregate &operator=(const HashAggregate &) = delete;
+    ~HashAggregate()
+    {
+#ifndef NO_DESTROYER
+        destroy();
+#endif /* NO_DESTROYER */
+    }
+
+    /* aggregate inputs[i] into group keys[i], results of former calls are dropped */
+    void aggregate(const Key *keys, const Input *inputs, size_t n);
+    /* visit every group as func(key, state), not thread safe against aggregate */
+    template <typename Func>
+    void for_each(Func &&func);
+    /* state of a group, NULL if absent */
+    const state_type *search(const Key &k);
+
+    inline size_t size() const { return _ngroup; }
+    inline size_t partitions() const { return size_t(1) << _radix_bits; }
+    void destroy();
+private:
+    struct SpillTuple { Key key; state_type state; };
+    using spill_type = Vector<SpillTuple, false>;
+    size_t _nthread;
+    size_t _local_budget;
+    size_t _radix_bits;
+    Aggregate _aggregate;
+    size_t _ngroup{0};
+    table_type *_results{NULL};
+
+    inline size_t partition_of(uint32 hash_value) const
+    {
+        return _radix_bits == 0 ? 0 : (hash_value * 0x9E3779B1u) >> (32 - _radix_bits);
+    }
+};
+
+template <typename Key, typename Input, typename Aggregate>
+void HashAggregate<Key, Input, Aggregate>::aggregate(const Key *keys, const Input *inputs, size_t n)
+{
+    destroy();
+    size_t npartition = partitions();
+    /* spill buffer of thread t for partition p is spills[t * npartition + p] */
+    spill_type *spills = (spill_type *)malloc(sizeof(spill_type) * _nthread * npartition);
+    for (size_t i = 0; i < _nthread * npartition; ++i) {
+        new (spills + i) spill_type();
+    }
+
+    hashtable_helper::run_parallel(_nthread, [&](size_t t) {
+        local_table_type local(_local_budget);
+        spill_type *spill = spills + t * npartition;
+        auto flush = [&]() {
+            for (auto it = local.begin(); it != local.end(); ++it) {
+                if (local.valid(it)) {
+                    spill[partition_of(it->hash_value)].push_back(SpillTuple{it->key, it->value});
+                }
+            }
+            local.clear();
+        };
+        for (size_t i = n * t / _nthread; i < n * (t + 1) / _nthread; ++i) {
+            uint32 hash_value = local_table_type::hash(keys[i]);
+            auto it = local.find(keys[i], hash_value);
+            if (it != local.end()) {
+                _aggregate(it->value, inputs[i]);
+                continue;
+            }
+            if (local.size() >= _local_budget) {
+                flush();
+            }
+            state_type state{};
+            _aggregate(state, inputs[i]);
+            local.insert(keys[i], state);
+        }
+        flush();
+        local.destroy();
+    });
+
+    _results = (table_type *)malloc(sizeof(table_type) * npartition);
+    std::atomic<size_t> next_partition{0};
+    std::atomic<size_t> ngroup{0};
+    hashtable_helper::run_parallel(_nthread, [&](size_t) {
+        for (size_t p = next_partition++; p < npartition; p = next_partition++) {
+            size_t expect_size = 1;
+            for (size_t t = 0; t < _nthread; ++t) {
+                expect_size = std::max(expect_size, spills[t * npartition + p].size());
+            }
+            table_type *table = new (_results + p) table_type(expect_size);
+            for (size_t t = 0; t < _nthread; ++t) {
+                spill_type &spill = spills[t * npartition + p];
+                for (auto tuple = spill.begin(); tuple != spill.end(); ++tuple) {
+                    auto it = table->find(tuple->key);
+                    if (it == table->end()) {
+                        table->insert(tuple->key, tuple->state);
+                    } else {
+                        _aggregate.merge(it->value, tuple->state);
+                    }
+                }
+                spill.destroy();
+            }
+            ngroup += table->size();
+        }
+    });
+    _ngroup = ngroup;
+    for (size_t i = 0; i < _nthread * npartition; ++i) {
+        spills[i].~spill_type();
+    }
+    free(spills);
+}
+
+template <typename Key, typename Input, typename Aggregate>
+template <typename Func>
+void HashAggregate<Key, Input, Aggregate>::for_each(Func &&func)
+{
+    if (!_results) {
+        return;
+    }
+    for (size_t p = 0; p < partitions(); ++p) {
+        for (auto it = _results[p].begin(); it != _results[p].end(); ++it) {
+            if (_results[p].valid(it)) {
+                func(it->key, it->value);
+            }
+        }
+    }
+}
+
+template <typename Key, typename Input, typename Aggregate>
+const typename HashAggregate<Key, Input, Aggregate>::state_type *HashAggregate<Key, Input, Aggregate>::search(const Key &k)
+{
+    if (!_results) {
+        return NULL;
+    }
+    uint32 hash_value = table_type::hash(k);
+    table_type &table = _results[partition_of(hash_value)];
+    auto it = table.find(k, hash_value);
+    return it == table.end() ? NULL : &it->value;
+}
+
+template <typename Key, typename Input, typename Aggregate>
+void HashAggregate<Key, Input, Aggregate>::destroy()
+{
+    if (_results) {
+        for (size_t p = 0; p < partitions(); ++p) {
+            _results[p].destroy();
+            _results[p].~table_type();
+        }
+        free(_results);
+        _results = NULL;
+    }
+    _ngroup = 0;
+}
+} /* namespace mem_container */
+
+#endif /* CONTAINER_HASHTABLE_HASH_AGGREGATE_H */
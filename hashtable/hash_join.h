@@ -0,0 +1,205 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * radix partitioned hash join on top of HashTable
+ */
+
+#ifndef CONTAINER_HASHTABLE_HASH_JOIN_H
+#define CONTAINER_HASHTABLE_HASH_JOIN_H
+
+#include <atomic>
+
+#include "../definition.h"
+#include "hashtable.h"
+#include "parallel.h"
+
+namespace mem_container {
+/*
+ * both sides are scattered into 2^radix_bits partitions by hash so that every partition
+ * table fits in cache, partitions are then built and probed one at a time per worker.
+ * build side may hold duplicate keys, the partition table maps a key to its latest build
+ * row and older rows are chained through _next.
+ * emit(thread id, probe row, build value) is called from worker threads concurrently
+ * when nthread > 1
+ */
+template <typename Key, typename Value>
+class HashJoin {
+public:
+    using table_type = HashTable<Key, uint32>;
+    constexpr static const size_t default_partition_bytes = 256 * 1024;
+    constexpr static const size_t max_radix_bits = 12;
+    constexpr static const size_t batch_size = 16;
+    constexpr static const uint32 end_of_chain = UINT32_MAX;
+
+    explicit HashJoin(size_t nthread = 1, size_t partition_bytes = default_partition_bytes)
+        : _nthread(std::max<size_t>(nthread, 1)), _partition_bytes(partition_bytes) {}
+    HashJoin(const HashJoin &) = delete;
+    HashJoin &operator=(const HashJoin &) = delete;
+    ~HashJoin()
+    {
+#ifndef NO_DESTROYER
+        destroy();
+#endif /* NO_DESTROYER */
+    }
+
+    void build(const Key *keys, const Value *values, size_t n);
+    template <typename Func>
+    size_t probe(const Key *keys, size_t n, Func &&emit);
+
+    inline size_t partitions() const { return size_t(1) << _radix_bits; }
+    inline size_t radix_bits() const { return _radix_bits; }
+    void destroy();
+private:
+    struct BuildTuple { Key key; Value value; };
+    struct ProbeTuple { Key key; size_t row; };
+    size_t _nthread;
+    size_t _partition_bytes;
+    size_t _radix_bits{0};
+    BuildTuple *_build{NULL};
+    uint32 *_next{NULL};
+    /* partition p owns [_offsets[p], _offsets[p + 1]) of the build tuples */
+    size_t *_offsets{NULL};
+    table_type *_tables{NULL};
+
+    /* high bits of a multiplicative hash, low bits are left for the partition table */
+    inline size_t partition_of(const Key &k) const
+    {
+        return _radix_bits == 0 ? 0 : (table_type::hash(k) * 0x9E3779B1u) >> (32 - _radix_bits);
+    }
+    template <typename Tuple, typename Make>
+    void scatter(size_t n, Tuple *out, size_t *offsets, Make &&make);
+};
+
+/* two pass radix scatter, per thread histograms give every thread its own output ranges */
+template <typename Key, typename Value>
+template <typename Tuple, typename Make>
+void HashJoin<Key, Value>::scatter(size_t n, Tuple *out, size_t *offsets, Make &&make)
+{
+    size_t npartition = partitions();
+    size_t *cursor = (size_t *)calloc(_nthread * npartition, sizeof(size_t));
+    hashtable_helper::run_parallel(_nthread, [&](size_t t) {
+        size_t *hist = cursor + t * npartition;
+        for (size_t i = n * t / _nthread; i < n * (t + 1) / _nthread; ++i) {
+            ++hist[partition_of(make(i).key)];
+        }
+    });
+    size_t pos = 0;
+    for (size_t p = 0; p < npartition; ++p) {
+        offsets[p] = pos;
+        for (size_t t = 0; t < _nthread; ++t) {
+            size_t count = cursor[t * npartition + p];
+            cursor[t * npartition + p] = pos;
+            pos += count;
+        }
+    }
+    offsets[npartition] = pos;
+    hashtable_helper::run_parallel(_nthread, [&](size_t t) {
+        size_t *hist = cursor + t * npartition;
+        for (size_t i = n * t / _nthread; i < n * (t + 1) / _nthread; ++i) {
+            Tuple tuple = make(i);
+            out[hist[partition_of(tuple.key)]++] = tuple;
+        }
+    });
+    free(cursor);
+}
+
+template <typename Key, typename Value>
+void HashJoin<Key, Value>::build(const Key *keys, const Value *values, size_t n)
+{
+    CONTAINER_ASSERT(n < end_of_chain);
+    destroy();
+    /* every partition table is twice its row count */
+    size_t row_bytes = sizeof(typename table_type::Entry) * 2;
+    _radix_bits = 0;
+    while (_radix_bits < max_radix_bits && (n >> _radix_bits) * row_bytes > _partition_bytes) {
+        ++_radix_bits;
+    }
+    size_t npartition = partitions();
+    _build = (BuildTuple *)malloc(sizeof(BuildTuple) * std::max<size_t>(n, 1));
+    _next = (uint32 *)malloc(sizeof(uint32) * std::max<size_t>(n, 1));
+    _offsets = (size_t *)malloc(sizeof(size_t) * (npartition + 1));
+    _tables = (table_type *)malloc(sizeof(table_type) * npartition);
+    scatter(n, _build, _offsets, [&](size_t i) { return BuildTuple{keys[i], values[i]}; });
+
+    std::atomic<size_t> next_partition{0};
+    hashtable_helper::run_parallel(_nthread, [&](size_t) {
+        for (size_t p = next_partition++; p < npartition; p = next_partition++) {
+            table_type *table = new (_tables + p) table_type(std::max<size_t>(_offsets[p + 1] - _offsets[p], 1));
+            for (size_t i = _offsets[p]; i < _offsets[p + 1]; ++i) {
+                _next[i] = end_of_chain;
+                if (!table->insert(_build[i].key, uint32(i))) {
+                    auto it = table->find(_build[i].key);
+                    _next[i] = it->value;
+                    it->value = uint32(i);
+                }
+            }
+        }
+    });
+}
+
+template <typename Key, typename Value>
+template <typename Func>
+size_t HashJoin<Key, Value>::probe(const Key *keys, size_t n, Func &&emit)
+{
+    if (!_tables) {
+        return 0;
+    }
+    size_t npartition = partitions();
+    ProbeTuple *tuples = (ProbeTuple *)malloc(sizeof(ProbeTuple) * std::max<size_t>(n, 1));
+    size_t *offsets = (size_t *)malloc(sizeof(size_t) * (npartition + 1));
+    scatter(n, tuples, offsets, [&](size_t i) { return ProbeTuple{keys[i], i}; });
+
+    std::atomic<size_t> next_partition{0};
+    std::atomic<size_t> nmatch{0};
+    hashtable_helper::run_parallel(_nthread, [&](size_t t) {
+        size_t local_match = 0;
+        uint32 hash_value[batch_size];
+        for (size_t p = next_partition++; p < npartition; p = next_partition++) {
+            table_type &table = _tables[p];
+            /* hash and prefetch a whole batch before touching any slot */
+            for (size_t start = offsets[p]; start < offsets[p + 1]; start += batch_size) {
+                size_t count = std::min(batch_size, offsets[p + 1] - start);
+                for (size_t i = 0; i < count; ++i) {
+                    hash_value[i] = table_type::hash(tuples[start + i].key);
+                    table.prefetch(hash_value[i]);
+                }
+                for (size_t i = 0; i < count; ++i) {
+                    const ProbeTuple &tuple = tuples[start + i];
+                    auto it = table.find(tuple.key, hash_value[i]);
+                    if (it == table.end()) {
+                        continue;
+                    }
+                    for (uint32 row = it->value; row != end_of_chain; row = _next[row]) {
+                        emit(t, tuple.row, _build[row].value);
+                        ++local_match;
+                    }
+                }
+            }
+        }
+        nmatch += local_match;
+    });
+    free(tuples);
+    free(offsets);
+    return nmatch;
+}
+
+template <typename Key, typename Value>
+void HashJoin<Key, Value>::destroy()
+{
+    if (_tables) {
+        for (size_t p = 0; p < partitions(); ++p) {
+            _tables[p].destroy();
+            _tables[p].~table_type();
+        }
+        free(_tables);
+        free(_offsets);
+        free(_next);
+        free(_build);
+        _tables = NULL;
+        _offsets = NULL;
+        _next = NULL;
+        _build = NULL;
+    }
+}
+} /* namespace mem_container */
+
+#endif /* CONTAINER_HASHTABLE_HASH_JOIN_H */
@@ -6,22 +6,92 @@
 #ifndef CONTAINER_HASHTABLE_H
 #define CONTAINER_HASHTABLE_H
 
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif /* __SSE2__ */
+
 #include "../definition.h"
+#include "../interleave.h"
 #include "../vector/vector.h"
 
 namespace mem_container {
 typedef uint32_t uint32;
 
+namespace hashtable_helper {
+/* keys are padded to this many bytes so that vector compare never reads out of bound */
+constexpr static const size_t simd_width = 32;
+
+template <typename Key>
+constexpr size_t padded_slots(size_t n)
+{
+    return simd_width % sizeof(Key) == 0 ? (n * sizeof(Key) + simd_width - 1) / simd_width * (simd_width / sizeof(Key)) : n;
+}
+
+/* position of k in keys[0, n) or n if absent, integer keys are compared in vector registers */
+template <typename Key>
+inline size_t linear_find(const Key *keys, size_t n, const Key &k)
+{
+#if defined(__SSE2__)
+    if constexpr (std::is_integral<Key>::value && (sizeof(Key) == 4 || sizeof(Key) == 8)) {
+#if defined(__AVX2__)
+        const __m256i needle = sizeof(Key) == 4 ? _mm256_set1_epi32((int)k) : _mm256_set1_epi64x((long long)k);
+        for (size_t i = 0; i < n; i += 32 / sizeof(Key)) {
+            __m256i block = _mm256_loadu_si256((const __m256i *)(keys + i));
+            __m256i eq = sizeof(Key) == 4 ? _mm256_cmpeq_epi32(block, needle) : _mm256_cmpeq_epi64(block, needle);
+            uint32 mask = (uint32)_mm256_movemask_epi8(eq);
+            if (mask) {
+                return std::min(i + __builtin_ctz(mask) / sizeof(Key), n);
+            }
+        }
+#else
+        const __m128i needle = sizeof(Key) == 4 ? _mm_set1_epi32((int)k) : _mm_set1_epi64x((long long)k);
+        for (size_t i = 0; i < n; i += 16 / sizeof(Key)) {
+            __m128i block = _mm_loadu_si128((const __m128i *)(keys + i));
+            __m128i eq = _mm_cmpeq_epi32(block, needle);
+            if (sizeof(Key) == 8) {
+                /* both 32-bit halves have to match */
+                eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, 0xB1));
+            }
+            uint32 mask = (uint32)_mm_movemask_epi8(eq);
+            if (mask) {
+                return std::min(i + __builtin_ctz(mask) / sizeof(Key), n);
+            }
+        }
+#endif /* __AVX2__ */
+        return n;
+    }
+#endif /* __SSE2__ */
+    for (size_t i = 0; i < n; ++i) {
+        if (keys[i] == k) {
+            return i;
+        }
+    }
+    return n;
+}
+} /* namespace hashtable_helper */
+
 template <typename T>
 using HashTableVector = Vector<T, false, false>;
-/* key comparison depends on equal operator */
-template <typename Key, typename Value, template<typename> class VectorType = HashTableVector>
+/*
+ * key comparison depends on equal operator
+ * generational table tags every entry with the generation it was inserted in, clear() only
+ * bumps the current generation so that stale entries are treated as empty slots
+ * table with inline_size > 0 keeps its first inline_size entries in an inline array scanned
+ * linearly, and only allocates the hashed layout once it grows past that
+ */
+template <typename Key, typename Value, template<typename> class VectorType = HashTableVector,
+          bool generational = false, size_t inline_size = 0>
 class HashTable {
 public:
+    using tag_type = std::conditional_t<generational, uint32, bool>;
 #if __cplusplus >= 202002L
-    struct Entry { uint32 hash_value; Key key; [[no_unique_address]] Value value; bool valid; };
+    struct Entry { uint32 hash_value; Key key; [[no_unique_address]] Value value; tag_type valid; };
 #else
-    struct Entry { uint32 hash_value; Key key; Value value; bool valid; };
+    struct Entry { uint32 hash_value; Key key; Value value; tag_type valid; };
 #endif /* __cplusplus c++20 or greater */
     using vector_type = VectorType<Entry>;
     /* note that iterators here are not responsible for validation */
@@ -32,7 +102,9 @@ public:
     HashTable(size_t capacity);
     HashTable(const HashTable &) = delete;
     HashTable &operator=(const HashTable &) = delete;
-    HashTable(HashTable &&other) : _table(std::move(other._table)), _size(other._size), _capacity(other._capacity)
+    HashTable(HashTable &&other)
+        : _table(std::move(other._table)), _size(other._size), _capacity(other._capacity),
+          _generation(other._generation), _inline(other._inline)
     {
         other._size = other._capacity = 0;
     }
@@ -48,6 +120,8 @@ public:
         _table.swap(other._table);
         std::swap(_size, other._size);
         std::swap(_capacity, other._capacity);
+        std::swap(_generation, other._generation);
+        std::swap(_inline, other._inline);
     }
     ~HashTable() {}
 
@@ -57,21 +131,46 @@ public:
     inline bool insert(Key &&k, Value &&v) { return insert(k, v); }
     void extend();
 
-    iterator find(const Key &k);
+    iterator find(const Key &k) { return find(k, is_inline() ? 0 : _hash(k)); }
     inline iterator find(Key &&k) { return find(k); }
+    /* lookup with hash value computed ahead of time, e.g. by batched probes */
+    iterator find(const Key &k, uint32 hash_value);
+    /* pull the home slot of a hash value into cache ahead of find */
+    inline void prefetch(uint32 hash_value) const
+    {
+        if (!is_inline()) {
+            __builtin_prefetch(&_table[hash_value % _capacity]);
+        }
+    }
+    static inline uint32 hash(const Key &k) { return _hash(k); }
+#ifdef CONTAINER_HAS_INTERLEAVE
+    /* results[i] = find(keys[i]) with group lookups interleaved, each prefetches its home slot and yields */
+    void find_batch(const Key *keys, size_t n, iterator *results, size_t group = 16)
+    {
+        interleave(n, group, [this, keys](size_t i) { return find_interleaved(keys[i]); },
+                   [results](size_t i, const iterator &res) { results[i] = res; });
+    }
+    /* one lookup of find_batch, for pipelines of their own on interleave() */
+    Interleaved<iterator> find_interleaved(Key k);
+#endif /* CONTAINER_HAS_INTERLEAVE */
     inline const_iterator cfind(const Key &k) { return const_iterator(find(k)); }
     inline const_iterator cfind(Key &&k) { return const_iterator(find(k)); }
 
     inline bool contains(const Key &k) { return cfind(k) != cend(); }
     inline bool contains(Key &&k) { return cfind(k) != cend(); }
 
-    iterator begin() { return _table.begin(); }
-    iterator end() { return _table.end(); }
-    const_iterator cbegin() { return _table.cbegin(); }
-    const_iterator cend() { return _table.cend(); }
+    iterator begin() { return is_inline() ? inline_entries() : _table.begin(); }
+    iterator end() { return is_inline() ? inline_entries() + _size : _table.end(); }
+    const_iterator cbegin() { return is_inline() ? inline_entries() : _table.cbegin(); }
+    const_iterator cend() { return is_inline() ? inline_entries() + _size : _table.cend(); }
+    /* whether the entry under a raw iterator holds a key of current generation */
+    inline bool valid(const_iterator it) const { return it->valid == _generation; }
 
+    inline size_t size() const { return _size; }
+    /* whether entries still live in the inline array rather than the hashed table */
+    inline bool is_inline() const { return inline_size > 0 && _table.empty(); }
     void destroy() { _table.destroy(); _size = _capacity = 0; }
-    void clear() { _table.clear(); _size = 0; }
+    void clear();
 private:
     constexpr static const bool empty_value = std::is_empty<Value>::value;
     constexpr static const size_t default_capacity = 16;
@@ -79,6 +178,26 @@ private:
     vector_type _table{};
     size_t _size{0};
     size_t _capacity;
+    /* tag of live entries, a zeroed slot is never live */
+    tag_type _generation{1};
+    struct InlineStorage {
+        Key keys[hashtable_helper::padded_slots<Key>(inline_size > 0 ? inline_size : 1)]{};
+        Entry entries[inline_size > 0 ? inline_size : 1];
+    };
+#if __cplusplus >= 202002L
+    [[no_unique_address]]
+#endif /* __cplusplus c++20 or greater */
+    std::conditional_t<(inline_size > 0), InlineStorage, EmptyObject> _inline{};
+
+    inline Entry *inline_entries()
+    {
+        if constexpr (inline_size > 0) {
+            return _inline.entries;
+        } else {
+            return NULL;
+        }
+    }
+    void upgrade();
 
     static inline uint32 _hash(const Key &key)
     {
@@ -88,24 +207,62 @@ private:
 
 template <typename Key, template<typename> class VectorType = HashTableVector>
 using HashSet = HashTable<Key, EmptyObject, VectorType>;
+template <typename Key, typename Value, template<typename> class VectorType = HashTableVector>
+using GenerationalHashTable = HashTable<Key, Value, VectorType, true>;
+template <typename Key, template<typename> class VectorType = HashTableVector>
+using GenerationalHashSet = HashTable<Key, EmptyObject, VectorType, true>;
+template <typename Key, typename Value, size_t inline_size = 16, template<typename> class VectorType = HashTableVector>
+using SmallHashTable = HashTable<Key, Value, VectorType, false, inline_size>;
+template <typename Key, size_t inline_size = 16, template<typename> class VectorType = HashTableVector>
+using SmallHashSet = HashTable<Key, EmptyObject, VectorType, false, inline_size>;
 
-template <typename Key, typename Value, template<typename> class VectorType>
-HashTable<Key, Value, VectorType>::HashTable(size_t capacity)
+template <typename Key, typename Value, template<typename> class VectorType, bool generational, size_t inline_size>
+HashTable<Key, Value, VectorType, generational, inline_size>::HashTable(size_t capacity)
     : _capacity(capacity * 2)
 {
     static_assert(std::is_standard_layout<Key>::value && std::is_standard_layout<Value>::value,
                   "only pod type allowed for disk hash table");
-    _table.resize(_capacity);
+    if (capacity > inline_size) {
+        _table.resize(_capacity);
+    }
+}
+
+template <typename Key, typename Value, template<typename> class VectorType, bool generational, size_t inline_size>
+void HashTable<Key, Value, VectorType, generational, inline_size>::upgrade()
+{
+    if constexpr (inline_size > 0) {
+        _capacity = std::max(_capacity, default_capacity * 2);
+        _table.resize(_capacity);
+        size_t old_size = _size;
+        _size = 0;
+        for (size_t i = 0; i < old_size; ++i) {
+            insert(_inline.entries[i].key, _inline.entries[i].value);
+        }
+    }
 }
 
-template <typename Key, typename Value, template<typename> class VectorType>
-bool HashTable<Key, Value, VectorType>::insert(const Key &k, const Value &v)
+template <typename Key, typename Value, template<typename> class VectorType, bool generational, size_t inline_size>
+bool HashTable<Key, Value, VectorType, generational, inline_size>::insert(const Key &k, const Value &v)
 {
+    if constexpr (inline_size > 0) {
+        if (is_inline()) {
+            if (hashtable_helper::linear_find(_inline.keys, _size, k) != _size) {
+                return false;
+            }
+            if (_size < inline_size) {
+                _inline.keys[_size] = k;
+                _inline.entries[_size] = {0, k, v, _generation};
+                ++_size;
+                return true;
+            }
+            upgrade();
+        }
+    }
     bool res = false;
-    Entry entry = {_hash(k), k, v, true};
+    Entry entry = {_hash(k), k, v, _generation};
     for (uint32 cur_pos = entry.hash_value;; ++cur_pos) {
         auto cur_entry = _table[cur_pos % _capacity];
-        if (!cur_entry.valid) {
+        if (cur_entry.valid != _generation) {
             _table.set(cur_pos % _capacity, entry);
             res = true;
             break;
@@ -124,31 +281,41 @@ bool HashTable<Key, Value, VectorType>::insert(const Key &k, const Value &v)
     return res;
 }
 
-template <typename Key, typename Value, template<typename> class VectorType>
-void HashTable<Key, Value, VectorType>::extend()
+template <typename Key, typename Value, template<typename> class VectorType, bool generational, size_t inline_size>
+void HashTable<Key, Value, VectorType, generational, inline_size>::extend()
 {
     size_t old_capacity = _capacity;
     _capacity *= 2lu;
+    /* rehash into a fresh table, moving entries in place breaks probe chains of colliding keys */
+    vector_type old_table;
+    old_table.swap(_table);
     _table.resize(_capacity);
     for (size_t i = 0; i < old_capacity; ++i) {
-        auto entry = _table[i];
-        if (!entry.valid || entry.hash_value % _capacity == i) {
+        const Entry &entry = old_table[i];
+        if (entry.valid != _generation) {
             continue;
         }
-        _table.set(entry.hash_value % _capacity, entry);
-        entry.valid = false;
-        _table.set(i, entry);
+        for (uint32 cur_pos = entry.hash_value;; ++cur_pos) {
+            if (_table[cur_pos % _capacity].valid != _generation) {
+                _table.set(cur_pos % _capacity, entry);
+                break;
+            }
+        }
     }
-    
+    old_table.destroy();
 }
 
-template <typename Key, typename Value, template<typename> class VectorType>
-typename HashTable<Key, Value, VectorType>::iterator HashTable<Key, Value, VectorType>::find(const Key &k)
+template <typename Key, typename Value, template<typename> class VectorType, bool generational, size_t inline_size>
+typename HashTable<Key, Value, VectorType, generational, inline_size>::iterator HashTable<Key, Value, VectorType, generational, inline_size>::find(const Key &k, uint32 hash_value)
 {
-    uint32 hash_value = _hash(k);
+    if constexpr (inline_size > 0) {
+        if (is_inline()) {
+            return _inline.entries + hashtable_helper::linear_find(_inline.keys, _size, k);
+        }
+    }
     for (uint32 cur_pos = hash_value;; ++cur_pos) {
         auto cur_entry = _table[cur_pos % _capacity];
-        if (!cur_entry.valid) {
+        if (cur_entry.valid != _generation) {
             return end();
         }
         if (hash_value == cur_entry.hash_value && k == cur_entry.key) {
@@ -157,6 +324,45 @@ typename HashTable<Key, Value, VectorType>::iterator HashTable<Key, Value, Vecto
     }
 }
 
+#ifdef CONTAINER_HAS_INTERLEAVE
+template <typename Key, typename Value, template<typename> class VectorType, bool generational, size_t inline_size>
+Interleaved<typename HashTable<Key, Value, VectorType, generational, inline_size>::iterator> HashTable<Key, Value, VectorType, generational, inline_size>::find_interleaved(Key k)
+{
+    if (is_inline()) {
+        co_return find(k, 0);
+    }
+    uint32 hash_value = _hash(k);
+    co_await prefetch_and_yield(&_table[hash_value % _capacity], sizeof(Entry));
+    co_return find(k, hash_value);
+}
+#endif /* CONTAINER_HAS_INTERLEAVE */
+
+template <typename Key, typename Value, template<typename> class VectorType, bool generational, size_t inline_size>
+void HashTable<Key, Value, VectorType, generational, inline_size>::clear()
+{
+    if (is_inline()) {
+        _size = 0;
+        return;
+    }
+    _size = 0;
+    if constexpr (generational) {
+        if (++_generation != 0) {
+            return;
+        }
+        /* generation wraps around, stale tags may collide with new ones */
+        for (auto it = _table.begin(); it != _table.end(); ++it) {
+            it->valid = 0;
+        }
+        _generation = 1;
+    } else {
+        _table.clear();
+        /* table with inline array falls back to it and keeps the memory released */
+        if (inline_size == 0) {
+            _table.resize(_capacity);
+        }
+    }
+}
+
 } /* namespace mem_container */
 
 #endif /* CONTAINER_HASHTABLE_H */
@@ -0,0 +1,36 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * fork join helper shared by the hash table operators
+ */
+
+#ifndef CONTAINER_HASHTABLE_PARALLEL_H
+#define CONTAINER_HASHTABLE_PARALLEL_H
+
+#include <thread>
+#include <functional>
+
+#include "../definition.h"
+
+namespace mem_container {
+namespace hashtable_helper {
+/* run func(t) for t in [0, nthread) on nthread threads and wait for all, nthread 1 stays on the caller */
+template <typename Func>
+void run_parallel(size_t nthread, Func &&func)
+{
+    if (nthread <= 1) {
+        func(size_t(0));
+        return;
+    }
+    std::thread *workers = new std::thread[nthread];
+    for (size_t t = 0; t < nthread; ++t) {
+        workers[t] = std::thread(std::ref(func), t);
+    }
+    for (size_t t = 0; t < nthread; ++t) {
+        workers[t].join();
+    }
+    delete[] workers;
+}
+} /* namespace hashtable_helper */
+} /* namespace mem_container */
+
+#endif /* CONTAINER_HASHTABLE_PARALLEL_H */
@@ -1,7 +1,13 @@
 #include "../test/test.h"
 
 #include <random>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include "hashtable.h"
+#include "fixed_bytes.h"
+#include "hash_join.h"
+#include "hash_aggregate.h"
 
 using namespace mem_container;
 
@@ -55,6 +61,490 @@ TEST_F(DefaultTester, Large) {
     ht.destroy();
 }
 
+TEST_F(DefaultTester, GenerationalClear) {
+    GenerationalHashSet<int> ht;
+    bool res;
+    for (int round = 0; round < 100; ++round) {
+        for (int i = round; i < round + 50; ++i) {
+            res = ht.insert(i, {});
+            EXPECT_TRUE(res);
+        }
+        EXPECT_EQ(ht.size(), 50);
+        for (int i = round; i < round + 50; ++i) {
+            res = ht.contains(i);
+            EXPECT_TRUE(res);
+        }
+        res = ht.contains(round + 50);
+        EXPECT_FALSE(res);
+        ht.clear();
+        EXPECT_EQ(ht.size(), 0);
+        for (int i = round; i < round + 50; ++i) {
+            res = ht.contains(i);
+            EXPECT_FALSE(res);
+        }
+    }
+
+    HashSet<int> plain;
+    plain.insert(1, {});
+    plain.clear();
+    res = plain.contains(1);
+    EXPECT_FALSE(res);
+    res = plain.insert(1, {});
+    EXPECT_TRUE(res);
+
+    ht.destroy();
+    plain.destroy();
+}
+
+TEST_F(DefaultTester, BenchmarkClear) {
+    constexpr int N = 1'000'000;
+    constexpr int M = 8;
+    HashSet<int> ht(256);
+    GenerationalHashSet<int> ght(256);
+    std::clock_t start = std::clock();
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < M; ++j) {
+            ht.insert(i + j, {});
+        }
+        ht.clear();
+    }
+    std::cout << "Clear: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < M; ++j) {
+            ght.insert(i + j, {});
+        }
+        ght.clear();
+    }
+    std::cout << "Generational clear: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+
+    ht.destroy();
+    ght.destroy();
+}
+
+template <typename Key>
+static void small_table_test() {
+    SmallHashTable<Key, Key, 16> ht;
+    bool res;
+    for (Key i = 0; i < 16; ++i) {
+        res = ht.insert(i * 7, i);
+        EXPECT_TRUE(res);
+        EXPECT_TRUE(ht.is_inline());
+    }
+    res = ht.insert(14, 0);
+    EXPECT_FALSE(res);
+    for (Key i = 0; i < 16; ++i) {
+        auto it = ht.find(i * 7);
+        EXPECT_TRUE(it != ht.end());
+        EXPECT_EQ(it->value, i);
+        res = ht.contains(i * 7 + 1);
+        EXPECT_FALSE(res);
+    }
+    for (Key i = 16; i < 100; ++i) {
+        res = ht.insert(i * 7, i);
+        EXPECT_TRUE(res);
+        EXPECT_FALSE(ht.is_inline());
+    }
+    EXPECT_EQ(ht.size(), 100);
+    for (Key i = 0; i < 100; ++i) {
+        auto it = ht.find(i * 7);
+        EXPECT_TRUE(it != ht.end());
+        EXPECT_EQ(it->value, i);
+    }
+    ht.clear();
+    EXPECT_TRUE(ht.is_inline());
+    res = ht.contains(0);
+    EXPECT_FALSE(res);
+    res = ht.insert(0, 0);
+    EXPECT_TRUE(res);
+    ht.destroy();
+}
+
+TEST_F(DefaultTester, SmallTable) {
+    small_table_test<int>();
+    small_table_test<long>();
+    small_table_test<short>();
+}
+
+TEST_F(DefaultTester, BenchmarkSmall) {
+    constexpr int N = 1'000'000;
+    constexpr int M = 12;
+    std::mt19937 gen(SEED);
+    int keys[M];
+    for (int j = 0; j < M; ++j) {
+        keys[j] = int(gen());
+    }
+    size_t found = 0;
+    std::clock_t start = std::clock();
+    for (int i = 0; i < N; ++i) {
+        HashSet<int> ht;
+        for (int j = 0; j < M; ++j) {
+            ht.insert(keys[j] + i, {});
+        }
+        for (int j = 0; j < M; ++j) {
+            found += ht.contains(keys[j] + i + (j & 1));
+        }
+        ht.destroy();
+    }
+    std::cout << "HashSet: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    start = std::clock();
+    for (int i = 0; i < N; ++i) {
+        SmallHashSet<int> ht;
+        for (int j = 0; j < M; ++j) {
+            ht.insert(keys[j] + i, {});
+        }
+        for (int j = 0; j < M; ++j) {
+            found -= ht.contains(keys[j] + i + (j & 1));
+        }
+        ht.destroy();
+    }
+    std::cout << "SmallHashSet: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+    EXPECT_EQ(found, 0);
+}
+
+template <size_t N>
+static FixedBytes<N> make_bytes(uint64_t seed) {
+    FixedBytes<N> res;
+    std::mt19937_64 gen(seed);
+    for (size_t i = 0; i < N; ++i) {
+        res[i] = uint8_t(gen());
+    }
+    return res;
+}
+
+template <size_t N>
+static void fixed_bytes_test() {
+    HashSet<FixedBytes<N>> ht;
+    SmallHashSet<FixedBytes<N>, 8> sht;
+    bool res;
+    for (uint64_t i = 0; i < 1000; ++i) {
+        res = ht.insert(make_bytes<N>(i), {});
+        EXPECT_TRUE(res);
+        res = sht.insert(make_bytes<N>(i), {});
+        EXPECT_TRUE(res);
+    }
+    for (uint64_t i = 0; i < 1000; ++i) {
+        res = ht.contains(make_bytes<N>(i));
+        EXPECT_TRUE(res);
+        res = sht.contains(make_bytes<N>(i));
+        EXPECT_TRUE(res);
+        auto key = make_bytes<N>(i);
+        key[N - 1] ^= 1;
+        res = ht.contains(key);
+        EXPECT_FALSE(res);
+        EXPECT_TRUE(key != make_bytes<N>(i));
+        EXPECT_TRUE(key.hash() != make_bytes<N>(i).hash());
+    }
+    ht.destroy();
+    sht.destroy();
+}
+
+TEST_F(DefaultTester, FixedBytes) {
+    fixed_bytes_test<16>();
+    fixed_bytes_test<20>();
+    fixed_bytes_test<32>();
+    fixed_bytes_test<64>();
+}
+
+/* the way fixed width ids were keyed before FixedBytes */
+struct ByteId {
+    uint8_t data[32];
+    bool operator==(const ByteId &other) const {
+        for (size_t i = 0; i < sizeof(data); ++i) {
+            if (data[i] != other.data[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+template <>
+struct std::hash<ByteId> {
+    size_t operator()(const ByteId &key) const {
+        size_t h = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(key.data); ++i) {
+            h = (h ^ key.data[i]) * 1099511628211ull;
+        }
+        return h;
+    }
+};
+
+TEST_F(DefaultTester, BenchmarkFixedBytes) {
+    constexpr int N = 1'000'000;
+    FixedBytes<32> *keys = new FixedBytes<32>[N];
+    for (int i = 0; i < N; ++i) {
+        keys[i] = make_bytes<32>(i);
+    }
+    HashSet<ByteId> ht(N);
+    std::clock_t start = std::clock();
+    for (int i = 0; i < N; ++i) {
+        ht.insert(*reinterpret_cast<ByteId *>(&keys[i]), {});
+    }
+    for (int i = 0; i < N; ++i) {
+        EXPECT_TRUE(ht.contains(*reinterpret_cast<ByteId *>(&keys[i])));
+    }
+    std::cout << "Byte loop: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+
+    HashSet<FixedBytes<32>> fht(N);
+    start = std::clock();
+    for (int i = 0; i < N; ++i) {
+        fht.insert(keys[i], {});
+    }
+    for (int i = 0; i < N; ++i) {
+        EXPECT_TRUE(fht.contains(keys[i]));
+    }
+    std::cout << "FixedBytes: " << (std::clock() - start) / (double)CLOCKS_PER_SEC << "s" << std::endl;
+
+    ht.destroy();
+    fht.destroy();
+    delete[] keys;
+}
+
+#include <unordered_map>
+TEST_F(DefaultTester, HashJoin) {
+    constexpr int N = 100'000;
+    std::mt19937 gen(SEED);
+    int *build_keys = new int[N];
+    long *build_values = new long[N];
+    int *probe_keys = new int[N];
+    std::unordered_map<int, size_t> expect;
+    for (int i = 0; i < N; ++i) {
+        build_keys[i] = int(gen() % (N / 4));
+        build_values[i] = build_keys[i] * 3l;
+        probe_keys[i] = int(gen() % (N / 2));
+        ++expect[build_keys[i]];
+    }
+    size_t nmatch = 0;
+    for (int i = 0; i < N; ++i) {
+        auto it = expect.find(probe_keys[i]);
+        nmatch += it == expect.end() ? 0 : it->second;
+    }
+    for (size_t nthread : {1, 4}) {
+        HashJoin<int, long> join(nthread, 4096);
+        join.build(build_keys, build_values, N);
+        EXPECT_TRUE(join.partitions() > 1);
+        std::atomic<size_t> checked{0};
+        size_t res = join.probe(probe_keys, N, [&](size_t, size_t row, long value) {
+            EXPECT_EQ(probe_keys[row] * 3l, value);
+            ++checked;
+        });
+        EXPECT_EQ(res, nmatch);
+        EXPECT_EQ(checked.load(), nmatch);
+        join.destroy();
+    }
+    delete[] build_keys;
+    delete[] build_values;
+    delete[] probe_keys;
+}
+
+/* zipfian ranks over [0, n) by inverse cdf */
+struct ZipfGenerator {
+    double *cdf;
+    size_t n;
+    ZipfGenerator(size_t n, double s) : cdf(new double[n]), n(n) {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += 1.0 / std::pow(double(i + 1), s);
+            cdf[i] = sum;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            cdf[i] /= sum;
+        }
+    }
+    ~ZipfGenerator() { delete[] cdf; }
+    template <typename Gen>
+    size_t operator()(Gen &gen) {
+        double u = std::uniform_real_distribution<double>(0, 1)(gen);
+        return std::min(size_t(std::lower_bound(cdf, cdf + n, u) - cdf), n - 1);
+    }
+};
+
+TEST_F(DefaultTester, BenchmarkHashJoin) {
+    constexpr int N = 4'000'000;
+    constexpr int M = 8'000'000;
+    std::mt19937 gen(SEED);
+    ZipfGenerator zipf(N, 0.8);
+    int *build_keys = new int[N];
+    int *build_values = new int[N];
+    int *probe_keys = new int[M];
+    /* scatter zipf ranks so that hot keys are not neighbours */
+    for (int i = 0; i < N; ++i) {
+        build_keys[i] = int(zipf(gen) * 2654435761u % N);
+        build_values[i] = i;
+    }
+    for (int i = 0; i < M; ++i) {
+        probe_keys[i] = int(gen() % N);
+    }
+    auto run = [&](const char *name, size_t nthread, size_t partition_bytes) {
+        HashJoin<int, int> join(nthread, partition_bytes);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        join.build(build_keys, build_values, N);
+        size_t res = join.probe(probe_keys, M, [](size_t, size_t, int) {});
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << name << ": " << elapsed.count() << "s, " << join.partitions() << " partitions, " << res << " matches" << std::endl;
+        join.destroy();
+    };
+    run("No partition", 1, SIZE_MAX);
+    run("Radix partition", 1, HashJoin<int, int>::default_partition_bytes);
+    run("Radix partition 4 threads", 4, HashJoin<int, int>::default_partition_bytes);
+    delete[] build_keys;
+    delete[] build_values;
+    delete[] probe_keys;
+}
+
+struct SumCount {
+    struct state_type { long sum; long count; };
+    void operator()(state_type &state, int input) const { state.sum += input; ++state.count; }
+    void merge(state_type &into, const state_type &from) const { into.sum += from.sum; into.count += from.count; }
+};
+
+TEST_F(DefaultTester, HashAggregate) {
+    constexpr int N = 200'000;
+    std::mt19937 gen(SEED);
+    int *keys = new int[N];
+    int *inputs = new int[N];
+    for (int cardinality : {10, 5'000, N}) {
+        std::unordered_map<int, SumCount::state_type> expect;
+        for (int i = 0; i < N; ++i) {
+            keys[i] = int(gen() % cardinality);
+            inputs[i] = int(gen() % 100);
+            expect[keys[i]].sum += inputs[i];
+            ++expect[keys[i]].count;
+        }
+        for (size_t nthread : {1, 4}) {
+            HashAggregate<int, int, SumCount> agg(nthread, 1024);
+            agg.aggregate(keys, inputs, N);
+            EXPECT_EQ(agg.size(), expect.size());
+            size_t visited = 0;
+            agg.for_each([&](int key, const SumCount::state_type &state) {
+                EXPECT_EQ(expect[key].sum, state.sum);
+                EXPECT_EQ(expect[key].count, state.count);
+                ++visited;
+            });
+            EXPECT_EQ(visited, expect.size());
+            EXPECT_TRUE(agg.search(keys[0]) != NULL);
+            EXPECT_TRUE(agg.search(-1) == NULL);
+            agg.destroy();
+        }
+    }
+    delete[] keys;
+    delete[] inputs;
+}
+
+TEST_F(DefaultTester, BenchmarkHashAggregate) {
+    constexpr int N = 8'000'000;
+    std::mt19937 gen(SEED);
+    int *keys = new int[N];
+    int *inputs = new int[N];
+    for (int cardinality : {1'000, N / 2}) {
+        for (int i = 0; i < N; ++i) {
+            keys[i] = int(gen() % cardinality);
+            inputs[i] = i & 0xFF;
+        }
+        std::cout << "Groups " << cardinality << std::endl;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        HashTable<int, SumCount::state_type> ht;
+        for (int i = 0; i < N; ++i) {
+            auto it = ht.find(keys[i]);
+            if (it == ht.end()) {
+                ht.insert(keys[i], {inputs[i], 1});
+            } else {
+                SumCount()(it->value, inputs[i]);
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Single table: " << elapsed.count() << "s" << std::endl;
+        ht.destroy();
+        for (size_t nthread : {1, 4}) {
+            HashAggregate<int, int, SumCount> agg(nthread);
+            start = std::chrono::steady_clock::now();
+            agg.aggregate(keys, inputs, N);
+            elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << "HashAggregate " << nthread << " threads: " << elapsed.count() << "s" << std::endl;
+            agg.destroy();
+        }
+    }
+    delete[] keys;
+    delete[] inputs;
+}
+
+TEST_F(DefaultTester, Interleaved) {
+    constexpr int N = 100'000;
+    std::mt19937 gen(SEED);
+    HashTable<int, int> ht;
+    SmallHashTable<int, int> small;
+    int *keys = new int[2 * N];
+    for (int i = 0; i < 2 * N; ++i) {
+        keys[i] = int(gen() % (4 * N));
+        if (i % 2 == 0) {
+            ht.insert(keys[i], i);
+        }
+        if (i < 8) {
+            small.insert(keys[i], i);
+        }
+    }
+    HashTable<int, int>::iterator *results = new HashTable<int, int>::iterator[2 * N];
+    for (size_t group : {1, 3, 16, 64, 1000}) {
+        ht.find_batch(keys, 2 * N, results, group);
+        for (int i = 0; i < 2 * N; ++i) {
+            EXPECT_TRUE((results[i] == ht.find(keys[i])));
+        }
+        SmallHashTable<int, int>::iterator small_results[16];
+        small.find_batch(keys, 16, small_results, group);
+        for (int i = 0; i < 16; ++i) {
+            EXPECT_TRUE((small_results[i] == small.find(keys[i])));
+        }
+    }
+    ht.find_batch(keys, 0, results);
+    delete[] results;
+    delete[] keys;
+    ht.destroy();
+    small.destroy();
+}
+
+/* random lookups on a table far larger than cache, one at a time and interleaved by group size */
+TEST_F(DefaultTester, BenchmarkInterleaved) {
+    constexpr int N = 8'000'000;
+    std::mt19937 gen(SEED);
+    HashTable<int, int> ht(N);
+    for (int i = 0; i < N; ++i) {
+        ht.insert(int(gen()), i);
+    }
+    int *keys = new int[N];
+    for (int i = 0; i < N; ++i) {
+        keys[i] = int(gen());
+    }
+    /* half of them hit */
+    gen.seed(SEED);
+    for (int i = 0; i < N; i += 2) {
+        keys[i] = int(gen());
+        gen();
+    }
+    HashTable<int, int>::iterator *results = new HashTable<int, int>::iterator[N];
+    size_t expect = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < N; ++i) {
+        results[i] = ht.find(keys[i]);
+        expect += results[i] != ht.end();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "One at a time: " << N / elapsed.count() / 1e6 << "M lookups/s" << std::endl;
+    for (size_t group : {1, 2, 4, 8, 16, 32, 64}) {
+        start = std::chrono::steady_clock::now();
+        ht.find_batch(keys, N, results, group);
+        size_t found = 0;
+        for (int i = 0; i < N; ++i) {
+            found += results[i] != ht.end();
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Interleaved, group " << group << ": " << N / elapsed.count() / 1e6 << "M lookups/s" << std::endl;
+        EXPECT_EQ(found, expect);
+    }
+    delete[] results;
+    delete[] keys;
+    ht.destroy();
+}
+
 TEST_F(DefaultTester, Benchmark) {
     constexpr int N = 10'000'000;
     HashSet<int> ht(N);
@@ -95,6 +585,18 @@ TEST_F(DefaultTester, Reference) {
 int main() {
     RUN_TEST(DefaultTester, Simple);
     RUN_TEST(DefaultTester, Large);
+    RUN_TEST(DefaultTester, GenerationalClear);
+    RUN_TEST(DefaultTester, BenchmarkClear);
+    RUN_TEST(DefaultTester, SmallTable);
+    RUN_TEST(DefaultTester, BenchmarkSmall);
+    RUN_TEST(DefaultTester, FixedBytes);
+    RUN_TEST(DefaultTester, BenchmarkFixedBytes);
+    RUN_TEST(DefaultTester, HashJoin);
+    RUN_TEST(DefaultTester, BenchmarkHashJoin);
+    RUN_TEST(DefaultTester, HashAggregate);
+    RUN_TEST(DefaultTester, BenchmarkHashAggregate);
+    RUN_TEST(DefaultTester, Interleaved);
+    RUN_TEST(DefaultTester, BenchmarkInterleaved);
     RUN_TEST(DefaultTester, Benchmark);
     RUN_TEST(DefaultTester, Reference);
 }
@@ -0,0 +1,185 @@
+/**
+ * Copyright © 2024 Mingwei Huang
+ * interleaved execution of independent lookups on c++20 coroutines (asynchronous memory access chaining)
+ */
+
+#ifndef CONTAINER_INTERLEAVE_H
+#define CONTAINER_INTERLEAVE_H
+
+#if defined(__cpp_impl_coroutine)
+#include <new>
+#include <cstdlib>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <algorithm>
+
+#include "definition.h"
+
+#define CONTAINER_HAS_INTERLEAVE 1
+
+namespace mem_container {
+namespace interleave_helper {
+constexpr static const size_t cache_line_size = 64;
+/* lookups in flight at a time, more than the line fill buffers of a core gains nothing */
+constexpr static const size_t max_group = 64;
+
+/*
+ * coroutine frames are recycled per thread, a batch creates and drops one for every lookup.
+ * frames of one size are cached, a frame of another size goes straight to malloc
+ */
+class FrameCache {
+public:
+    constexpr static const size_t capacity = max_group * 2;
+    ~FrameCache()
+    {
+        for (size_t i = 0; i < _count; ++i) {
+            free(_frames[i]);
+        }
+    }
+    inline void *alloc(size_t bytes)
+    {
+        if (bytes == _bytes && _count > 0) {
+            return _frames[--_count];
+        }
+        void *res = malloc(bytes);
+        if (!res) {
+            throw std::bad_alloc();
+        }
+        return res;
+    }
+    inline void release(void *frame, size_t bytes)
+    {
+        if (_count == 0) {
+            _bytes = bytes;
+        }
+        if (bytes == _bytes && _count < capacity) {
+            _frames[_count++] = frame;
+        } else {
+            free(frame);
+        }
+    }
+    static inline FrameCache &local()
+    {
+        static thread_local FrameCache cache;
+        return cache;
+    }
+private:
+    void *_frames[capacity];
+    size_t _count{0};
+    size_t _bytes{0};
+};
+} /* namespace interleave_helper */
+
+/*
+ * a lookup written as a coroutine prefetches the memory it reads next and suspends right away,
+ * the batch resumes another one meanwhile. by the time it gets back to this lookup the lines
+ * are likely in cache, so the misses of a group of lookups overlap instead of adding up.
+ * the lookup runs up to its first suspension as soon as it is created
+ */
+template <typename T>
+class Interleaved {
+public:
+    struct promise_type {
+        T value{};
+        Interleaved get_return_object() { return Interleaved(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(T res) { value = res; }
+        void unhandled_exception() { std::terminate(); }
+        static void *operator new(size_t bytes) { return interleave_helper::FrameCache::local().alloc(bytes); }
+        static void operator delete(void *frame, size_t bytes) { interleave_helper::FrameCache::local().release(frame, bytes); }
+    };
+
+    Interleaved() = default;
+    Interleaved(const Interleaved &) = delete;
+    Interleaved &operator=(const Interleaved &) = delete;
+    Interleaved(Interleaved &&other) : _handle(std::exchange(other._handle, nullptr)) {}
+    Interleaved &operator=(Interleaved &&other)
+    {
+        if (this != &other) {
+            destroy();
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    }
+    ~Interleaved() { destroy(); }
+
+    inline bool done() const { return _handle.done(); }
+    inline void resume() { _handle.resume(); }
+    inline const T &result() const { return _handle.promise().value; }
+    void destroy()
+    {
+        if (_handle) {
+            _handle.destroy();
+            _handle = nullptr;
+        }
+    }
+private:
+    std::coroutine_handle<promise_type> _handle{nullptr};
+
+    explicit Interleaved(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+};
+
+/* co_await before reading bytes at addr, the lines are requested and the lookup yields */
+struct PrefetchYield {
+    const void *addr;
+    size_t bytes;
+    inline bool await_ready() const noexcept { return false; }
+    inline void await_suspend(std::coroutine_handle<>) const noexcept
+    {
+        for (size_t i = 0; i < bytes; i += interleave_helper::cache_line_size) {
+            __builtin_prefetch((const char *)addr + i);
+        }
+    }
+    inline void await_resume() const noexcept {}
+};
+
+inline PrefetchYield prefetch_and_yield(const void *addr, size_t bytes = interleave_helper::cache_line_size)
+{
+    return PrefetchYield{addr, bytes};
+}
+
+/*
+ * run the lookups make(0) .. make(n - 1), keeping group of them in flight and resuming them
+ * round robin, finish(i, result) is called as lookup i completes, not necessarily in order.
+ * group 1 runs them one after another
+ */
+template <typename Make, typename Finish>
+void interleave(size_t n, size_t group, Make &&make, Finish &&finish)
+{
+    using task_type = decltype(make(size_t(0)));
+    group = std::clamp<size_t>(group, 1, interleave_helper::max_group);
+    task_type tasks[interleave_helper::max_group];
+    size_t index[interleave_helper::max_group];
+    size_t active = 0;
+    size_t next = 0;
+    for (; active < group && next < n; ++active, ++next) {
+        tasks[active] = make(next);
+        index[active] = next;
+    }
+    while (active > 0) {
+        for (size_t s = 0; s < active;) {
+            if (!tasks[s].done()) {
+                tasks[s].resume();
+                ++s;
+                continue;
+            }
+            finish(index[s], tasks[s].result());
+            if (next < n) {
+                /* the new lookup already issued its first prefetch, it is resumed next round */
+                tasks[s] = make(next);
+                index[s] = next++;
+                ++s;
+            } else {
+                tasks[s] = std::move(tasks[--active]);
+                index[s] = index[active];
+            }
+        }
+    }
+}
+} /* namespace mem_container */
+
+#endif /* __cpp_impl_coroutine */
+
+#endif /* CONTAINER_INTERLEAVE_H */